@@ -0,0 +1,417 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+#include <libsoup/soup.h>
+
+#include "defs.h"
+#include "pt-update.h"
+
+
+/* most ids one lookup request may carry. */
+#define MAX_LOOKUP_IDS 100
+
+/* missing parents of fresh updates are fetched in the background, in one
+ * batch per PREFETCH_DELAY_SEC, but not their parents in turn. opening a
+ * conversation fetches whatever it still lacks right away, a level per
+ * round, at most MAX_FETCH_ROUNDS deep.
+ */
+#define PREFETCH_DELAY_SEC 2
+#define MAX_FETCH_ROUNDS 8
+
+/* longest reply chain that's followed. */
+#define MAX_DEPTH 500
+
+
+/* one open conversation window. */
+struct conversation
+{
+	uint64_t focus_id;
+	int rounds;					/* of fetching missing ancestors */
+	GHashTable *members;		/* &id -> same */
+	GtkWidget *window;
+	struct update_model *model;
+	void *fetch_data;			/* of the account it was opened from */
+};
+
+
+/* process-wide state. */
+static struct update_store *conv_updates = NULL;
+static struct request_sched *conv_reqs = NULL;
+static status_fetch_fn conv_fetch_fn = NULL;
+
+static GList *open_convs = NULL;
+/* ids to fetch in the background, ones that have been asked for, and ones
+ * that were asked for but didn't come back (deleted, protected, etc). the
+ * latter aren't asked for again. the background ids map to the fetch_fn
+ * data of the account that saw them.
+ */
+static GHashTable *prefetch_ids = NULL, *inflight = NULL, *unavailable = NULL;
+static guint prefetch_source = 0;
+
+
+static inline bool id_in_set(GHashTable *set, uint64_t id) {
+	return g_hash_table_lookup(set, &id) != NULL;
+}
+
+
+static bool id_set_add(GHashTable *set, uint64_t id)
+{
+	if(id_in_set(set, id)) return false;
+	uint64_t *key = g_memdup(&id, sizeof(id));
+	g_hash_table_insert(set, key, key);
+	return true;
+}
+
+
+static GHashTable *id_set_new(void) {
+	return g_hash_table_new_full(&g_int64_hash, &g_int64_equal, &g_free, NULL);
+}
+
+
+/* adds the conversation around c->focus_id to its members: up to the oldest
+ * stored ancestor, then all stored replies under that. new members are
+ * offered to the view. the parent of the oldest ancestor goes in
+ * `missing' when it's not stored, and may be fetched.
+ */
+static void collect(struct conversation *c, GArray *missing)
+{
+	uint64_t top = c->focus_id;
+	for(int depth=0; depth < MAX_DEPTH; depth++) {
+		uint64_t parent = update_store_get_parent(conv_updates, top);
+		if(parent == 0) break;
+		if(!update_store_has(conv_updates, parent)) {
+			if(!id_in_set(unavailable, parent)) {
+				g_array_append_val(missing, parent);
+			}
+			break;
+		}
+		top = parent;
+	}
+
+	GArray *queue = g_array_new(FALSE, FALSE, sizeof(uint64_t)),
+		*fresh = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	g_array_append_val(queue, top);
+	for(guint i=0; i < queue->len; i++) {
+		uint64_t id = g_array_index(queue, uint64_t, i);
+		if(id_set_add(c->members, id)) g_array_append_val(fresh, id);
+		update_store_get_replies(conv_updates, id, queue);
+	}
+	update_model_add_ids(c->model, (const uint64_t *)fresh->data,
+		fresh->len);
+	g_array_free(queue, TRUE);
+	g_array_free(fresh, TRUE);
+}
+
+
+/* view filter. updates that arrive later join when they reply to a member,
+ * directly or through stored intermediates.
+ */
+static bool in_conversation(
+	struct update_store *updates,
+	uint64_t id,
+	void *dataptr)
+{
+	struct conversation *c = dataptr;
+	uint64_t cur = id;
+	for(int depth=0; cur != 0 && depth < MAX_DEPTH; depth++) {
+		if(id_in_set(c->members, cur)) {
+			id_set_add(c->members, id);
+			return true;
+		}
+		cur = update_store_get_parent(updates, cur);
+	}
+	return false;
+}
+
+
+static void queue_parents(
+	struct update **updates,
+	size_t num_updates,
+	void *fetch_data)
+{
+	for(size_t i=0; i < num_updates; i++) {
+		uint64_t parent = updates[i]->in_rep_to_sid;
+		if(parent != 0 && !update_store_has(conv_updates, parent)
+			&& !id_in_set(unavailable, parent)
+			&& !g_hash_table_lookup_extended(prefetch_ids, &parent,
+				NULL, NULL))
+		{
+			g_hash_table_insert(prefetch_ids,
+				g_memdup(&parent, sizeof(parent)), fetch_data);
+		}
+	}
+}
+
+
+static gboolean on_prefetch_timeout(gpointer dataptr);
+
+
+static void schedule_prefetch(void)
+{
+	if(prefetch_source == 0 && g_hash_table_size(prefetch_ids) > 0) {
+		prefetch_source = g_timeout_add_seconds(PREFETCH_DELAY_SEC,
+			&on_prefetch_timeout, NULL);
+	}
+}
+
+
+/* one lookup request in flight. */
+struct lookup
+{
+	void *fetch_data;
+	size_t num_ids;
+	uint64_t ids[];
+};
+
+
+static void request_ids(const GArray *ids, void *fetch_data);
+
+
+/* brings a conversation up to date with the store, and adds what it still
+ * lacks to `missing' unless it's out of rounds. a round is only spent when
+ * something goes out for it; a parent that's already on its way, as when
+ * an unrelated lookup completes first, doesn't count.
+ */
+static void refresh(struct conversation *c, GArray *missing)
+{
+	size_t before = missing->len;
+	collect(c, missing);
+	guint n = before;
+	for(guint i = before; i < missing->len; i++) {
+		uint64_t id = g_array_index(missing, uint64_t, i);
+		if(!id_in_set(inflight, id)) g_array_index(missing, uint64_t, n++) = id;
+	}
+	g_array_set_size(missing, n);
+	if(n > before && c->rounds++ >= MAX_FETCH_ROUNDS) {
+		g_array_set_size(missing, before);
+	}
+}
+
+
+/* fetches what open conversations still lack, a level of ancestry per
+ * round, each with its own account, and takes the background queue along.
+ * what one conversation sent for isn't asked for again by the next.
+ */
+static void refresh_open_convs(void)
+{
+	GArray *missing = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	for(GList *cur = g_list_first(open_convs);
+		cur != NULL;
+		cur = g_list_next(cur))
+	{
+		struct conversation *c = cur->data;
+		g_array_set_size(missing, 0);
+		refresh(c, missing);
+		if(missing->len > 0) request_ids(missing, c->fetch_data);
+	}
+	g_array_free(missing, TRUE);
+}
+
+
+static void on_lookup_done(
+	GPtrArray *updates,
+	const GError *err,
+	void *dataptr)
+{
+	struct lookup *l = dataptr;
+	if(conv_updates == NULL) goto end;	/* shut down in the meantime */
+
+	for(size_t i=0; i < l->num_ids; i++) {
+		g_hash_table_remove(inflight, &l->ids[i]);
+	}
+	if(updates == NULL) {
+		/* try again some other time. */
+		g_debug("%s: lookup of %zu statuses failed: %s", __func__,
+			l->num_ids, err->message);
+		goto end;
+	}
+
+	/* the results' own missing parents aren't queued: the background only
+	 * goes one level up from the timeline, and open conversations walk
+	 * further on their own rounds.
+	 */
+	for(guint i=0; i < updates->len; i++) {
+		update_store_add(conv_updates, g_ptr_array_index(updates, i));
+	}
+	for(size_t i=0; i < l->num_ids; i++) {
+		if(!update_store_has(conv_updates, l->ids[i])) {
+			id_set_add(unavailable, l->ids[i]);
+		}
+	}
+	refresh_open_convs();
+	schedule_prefetch();
+
+end:
+	g_free(l);
+}
+
+
+static void send_lookup(struct lookup *l, enum request_class cls) {
+	(*conv_fetch_fn)(l->ids, l->num_ids, cls, &on_lookup_done, l,
+		l->fetch_data);
+}
+
+
+/* requests `ids' for the account of `fetch_data' together with the
+ * background queue, deduplicated, in as few requests per account as it
+ * takes. ids that are stored, known unavailable, or already on their way
+ * are skipped.
+ */
+static void request_ids(const GArray *ids, void *fetch_data)
+{
+	/* the background queue rides along with what a window is waiting on.
+	 * each id goes with the account that wants it; a window's account
+	 * takes over from the background's.
+	 */
+	enum request_class cls = ids != NULL ? REQ_LOOKUP : REQ_BACKGROUND;
+	GHashTable *owners = prefetch_ids;
+	prefetch_ids = id_set_new();
+	for(guint i=0; ids != NULL && i < ids->len; i++) {
+		uint64_t id = g_array_index(ids, uint64_t, i);
+		g_hash_table_replace(owners, g_memdup(&id, sizeof(id)), fetch_data);
+	}
+
+	/* fetch_data -> the lookup being filled for it. */
+	GHashTable *batches = g_hash_table_new(&g_direct_hash, &g_direct_equal);
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, owners);
+	while(g_hash_table_iter_next(&iter, &key, &value)) {
+		uint64_t id = *(uint64_t *)key;
+		if(update_store_has(conv_updates, id) || id_in_set(unavailable, id)
+			|| !id_set_add(inflight, id))
+		{
+			continue;
+		}
+
+		struct lookup *l = g_hash_table_lookup(batches, value);
+		if(l == NULL) {
+			l = g_malloc(sizeof(struct lookup)
+				+ sizeof(uint64_t) * MAX_LOOKUP_IDS);
+			l->fetch_data = value;
+			l->num_ids = 0;
+			g_hash_table_insert(batches, value, l);
+		}
+		l->ids[l->num_ids++] = id;
+		if(l->num_ids == MAX_LOOKUP_IDS) {
+			send_lookup(l, cls);
+			g_hash_table_remove(batches, value);
+		}
+	}
+	g_hash_table_iter_init(&iter, batches);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		send_lookup(value, cls);
+	}
+	g_hash_table_destroy(batches);
+	g_hash_table_destroy(owners);
+}
+
+
+static gboolean on_prefetch_timeout(gpointer dataptr)
+{
+	prefetch_source = 0;
+	request_ids(NULL, NULL);
+	return FALSE;
+}
+
+
+void conversations_note_updates(
+	struct update **updates,
+	size_t num_updates,
+	void *fetch_data)
+{
+	if(conv_updates == NULL) return;
+
+	queue_parents(updates, num_updates, fetch_data);
+	schedule_prefetch();
+}
+
+
+static void on_conv_window_destroy(GtkWidget *wnd, gpointer dataptr)
+{
+	struct conversation *c = dataptr;
+	open_convs = g_list_remove(open_convs, c);
+	update_model_free(c->model);
+	g_hash_table_destroy(c->members);
+	g_slice_free(struct conversation, c);
+}
+
+
+void conversation_open(
+	uint64_t status_id,
+	struct user_lookup *users,
+	void *fetch_data)
+{
+	g_return_if_fail(conv_updates != NULL);
+
+	GtkBuilder *b = gtk_builder_new();
+	GError *err = NULL;
+	char *objs[] = { "conversation_wnd", NULL };
+	if(gtk_builder_add_objects_from_file(b, "piiptyyt.ui", objs, &err) == 0) {
+		g_warning("%s: can't load window: %s", __func__, err->message);
+		g_error_free(err);
+		g_object_unref(b);
+		return;
+	}
+
+	struct conversation *c = g_slice_new(struct conversation);
+	c->focus_id = status_id;
+	c->rounds = 0;
+	c->members = id_set_new();
+	c->fetch_data = fetch_data;
+	c->window = GTK_WIDGET(ui_object(b, "conversation_wnd"));
+	c->model = update_model_new(
+		GTK_TREE_VIEW(ui_object(b, "conversation_view")),
+		conv_updates, conv_reqs);
+	update_model_set_filter(c->model, &in_conversation, c);
+	if(users != NULL) update_model_set_user_lookup(c->model, users);
+	g_signal_connect(c->window, "destroy",
+		G_CALLBACK(&on_conv_window_destroy), c);
+	open_convs = g_list_prepend(open_convs, c);
+	g_object_unref(b);
+
+	gtk_widget_show(c->window);
+
+	/* what's stored shows up now. the rest comes as lookups complete. */
+	GArray *missing = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	refresh(c, missing);
+	if(missing->len > 0) request_ids(missing, c->fetch_data);
+	g_array_free(missing, TRUE);
+}
+
+
+void conversations_init(
+	struct update_store *updates,
+	struct request_sched *reqs,
+	status_fetch_fn fetch_fn)
+{
+	assert(conv_updates == NULL);
+	conv_updates = updates;
+	conv_reqs = reqs;
+	conv_fetch_fn = fetch_fn;
+	prefetch_ids = id_set_new();
+	inflight = id_set_new();
+	unavailable = id_set_new();
+}
+
+
+void conversations_shutdown(void)
+{
+	while(open_convs != NULL) {
+		struct conversation *c = open_convs->data;
+		gtk_widget_destroy(c->window);	/* removes it from open_convs */
+	}
+	if(prefetch_source != 0) g_source_remove(prefetch_source);
+	prefetch_source = 0;
+	g_hash_table_destroy(prefetch_ids);
+	g_hash_table_destroy(inflight);
+	g_hash_table_destroy(unavailable);
+	conv_reqs = NULL;
+	conv_updates = NULL;
+}
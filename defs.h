@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/time.h>
+#include <sys/types.h>
 #include <glib.h>
 #include <gtk/gtk.h>
 #include <json-glib/json-glib.h>
@@ -19,12 +20,14 @@
 #define PT_ERR_DOM (piiptyyt_error_domain())
 
 
-/* persistent, named client state. */
+/* persistent, named client state; one per account. */
 struct piiptyyt_state
 {
 	char *username;
 	char *auth_token, *auth_secret;
 	uint64_t userid;
+	/* not saved. made from the secrets on the first signed request. */
+	struct oauth_signer *signer;
 };
 
 
@@ -54,25 +57,73 @@ struct field_desc
 
 struct update;			/* in "pt-update.h" */
 struct user_info;		/* in "pt-user-info.h" */
-
-/* update display data model.
+struct update_store;	/* private to updatestore.c */
+struct id_index;		/* private to idindex.c */
+struct _pt_cache;		/* in "pt-cache.h" */
+struct mute_filter;		/* private to mutefilter.c */
+struct request_sched;	/* private to reqsched.c */
+
+/* called when the view has scrolled past the oldest update that's
+ * available locally. it should start a fetch and return; the fetched
+ * updates go to add_updates_to_model(), followed by a call to
+ * update_model_older_fetched(). there's one such fetch in flight per view.
+ */
+struct update_model;
+typedef void (*update_model_fetch_fn)(
+	struct update_model *model,
+	uint64_t below_id,
+	void *dataptr);
+
+/* decides whether the update `id' in `store' belongs in a view. */
+typedef bool (*update_filter_fn)(
+	struct update_store *store,
+	uint64_t id,
+	void *dataptr);
+
+/* update display data model, i.e. one timeline view. the sorted id index
+ * lives in `store'; the updates themselves are in `updates', which may be
+ * shared by several views. updates added through any of them are offered to
+ * all, and show up in those whose filter_fn accepts them (or has none).
  *
- * downsides: changing current_ids is always an O(n) operation, where n =
- * max(num_updates, num_updates'). this isn't really significant with fewer
- * than 2k updates, as that will significantly eject other data from a 16k L1
- * data cache.
+ * the view is kept to at most max_rows while it's scrolled to the top; rows
+ * dropped from it stay in `updates' until that has more than max_stored.
+ * scrolling to the bottom brings older rows back from `updates', and then
+ * from fetch_older_fn.
  *
  * TODO: make this private, move it into model.c entirely
  */
 struct update_model
 {
-	int count;
-	uint64_t *current_ids;	/* largest first, always sorted */
-	GtkListStore *store;
+	struct update_store *updates;
+	struct _pt_timeline_model *store;
 	GtkTreeView *view;
 	GtkCellRenderer *update_col_r, *pic_col_r;
-	SoupSession *http_session;
+	struct request_sched *reqs;
 	GdkPixbuf *default_userpic;
+
+	update_filter_fn filter_fn;
+	void *filter_data;
+	size_t max_rows, max_stored;
+	GArray *pending;			/* ids waiting for insertion, newest first */
+	guint insert_tick_id;
+	GHashTable *user_rows;		/* &user_id -> struct user_rows */
+	GtkAdjustment *vadj;
+	bool paging_back;
+	uint64_t fetch_exhausted_id;	/* nothing older than this upstream */
+	uint64_t fetching_below;		/* older fetch in flight, or 0 */
+	update_model_fetch_fn fetch_older_fn;
+	void *fetch_older_data;
+	struct user_lookup *users;	/* for bare authors, or NULL */
+
+	/* rows between window_hi and window_lo (ids, inclusive) are prepared
+	 * for drawing: markup, userpic and full layout. the rest are laid out
+	 * as placeholders.
+	 */
+	size_t prefetch_rows;
+	uint64_t window_hi, window_lo;
+	guint viewport_idle_id;
+	GHashTable *rendering;		/* &id -> same; markup being formatted */
+	GList *markup_reqs;			/* of struct markup_req, in flight */
 };
 
 
@@ -80,22 +131,331 @@ struct update_model
 
 extern GObject *ui_object(GtkBuilder *b, const char *id);
 extern GQuark piiptyyt_error_domain(void);
+/* `path' under the API's base URI, or the streaming API's. g_free() the
+ * result.
+ */
+extern char *api_uri(const char *path);
+extern char *stream_uri(const char *path);
 
 
 /* from model.c */
 
 extern struct update_model *update_model_new(
 	GtkTreeView *view,
-	GtkListStore *store,
-	SoupSession *session);
+	struct update_store *updates,
+	struct request_sched *reqs);
 extern void update_model_free(struct update_model *model);
 
+/* offers ids of updates that're already in the store to this one view,
+ * which inserts those that pass its filter.
+ */
+extern void update_model_add_ids(
+	struct update_model *model,
+	const uint64_t *ids,
+	size_t num_ids);
+
+/* brings the store's mute verdicts and every view on it up to date after
+ * the filter's rules were edited. muted rows disappear at once; unmuted ones
+ * come back over the next few frames.
+ */
+extern void update_models_apply_mutes(
+	struct update_store *updates,
+	struct mute_filter *filter);
+
+/* must be called before any updates are added. */
+extern void update_model_set_filter(
+	struct update_model *model,
+	update_filter_fn fn,
+	void *dataptr);
+
+/* how many rows above and below the visible ones are prepared ahead of
+ * scrolling.
+ */
+extern void update_model_set_prefetch_rows(
+	struct update_model *model,
+	size_t rows);
+
+/* zero leaves a limit as it was. */
+extern void update_model_set_limits(
+	struct update_model *model,
+	size_t max_rows,
+	size_t max_stored);
+/* authors of prepared rows that are bare are wanted from `users'. */
+extern void update_model_set_user_lookup(
+	struct update_model *model,
+	struct user_lookup *users);
+/* repaints the rows by `user_ids' in every view on `updates', after their
+ * user info was filled in or changed. every facade by them is dropped,
+ * since its markup was made with what they showed before.
+ */
+extern void update_models_users_changed(
+	struct update_store *updates,
+	const uint64_t *user_ids,
+	size_t num_ids);
+extern void update_model_set_fetch_older_fn(
+	struct update_model *model,
+	update_model_fetch_fn fn,
+	void *dataptr);
+/* ends the older fetch for `below_id'. num_fetched is -1 when it failed;
+ * when it's 0, nothing is asked for below that id again.
+ */
+extern void update_model_older_fetched(
+	struct update_model *model,
+	uint64_t below_id,
+	ssize_t num_fetched);
+
+/* updates go into the store at once, and show up in the view over the next
+ * few frames.
+ */
 extern void add_updates_to_model(
 	struct update_model *model,
 	struct update **updates,
 	size_t num_updates);
 
 
+/* from reqsched.c
+ *
+ * a scheduler in front of a SoupSession. requests are queued by class, and
+ * each class has its own connection limit and order of service, so that a
+ * screenful of userpics doesn't hold up the next timeline poll.
+ *
+ * it also budgets each endpoint's rate limit per account, as seen in response
+ * headers. a spent endpoint's requests wait for the window to reset, and
+ * background requests leave a reserve for the rest and are spread over the
+ * window.
+ *
+ * API responses that carry an ETag or a Last-Modified are kept, and asked
+ * for again conditionally; a 304 reaches the caller as a 200 with the kept
+ * body.
+ */
+
+/* in order of priority. */
+enum request_class {
+	REQ_TIMELINE = 0,		/* polls, backfill, paging back */
+	REQ_LOOKUP,				/* statuses and users by id */
+	REQ_BACKGROUND,			/* API calls that nobody's waiting on */
+	REQ_USERPIC,			/* userpics of rows on screen */
+	REQ_USERPIC_PREFETCH,	/* of rows near them */
+	REQ__NUM_CLASSES
+};
+
+extern struct request_sched *request_sched_new(SoupSession *session);
+extern void request_sched_free(struct request_sched *s);
+extern SoupSession *request_sched_get_session(struct request_sched *s);
+extern void request_sched_set_limit(
+	struct request_sched *s,
+	enum request_class cls,
+	int max_conns);
+/* like soup_session_queue_message(), which it ends up calling once `cls'
+ * has a connection to spare. takes the caller's reference to `msg'.
+ * userpic classes are served newest first, the others in order of arrival.
+ */
+extern void request_sched_queue(
+	struct request_sched *s,
+	enum request_class cls,
+	SoupMessage *msg,
+	SoupSessionCallback callback,
+	gpointer dataptr);
+/* moves a waiting request to the front of `cls', if that's at least as
+ * urgent as where it is. returns false when `msg' isn't waiting (i.e. it's
+ * been sent already, or wasn't queued here).
+ */
+extern bool request_sched_promote(
+	struct request_sched *s,
+	SoupMessage *msg,
+	enum request_class cls);
+/* the callback gets SOUP_STATUS_CANCELLED, right away if `msg' was still
+ * waiting, or from the session if it had been sent.
+ */
+extern void request_sched_cancel(struct request_sched *s, SoupMessage *msg);
+
+struct rate_limit
+{
+	int limit, remaining;	/* limit is -1 when not given */
+	int64_t reset;			/* unix time */
+};
+
+/* rate limits go by credentials, so each account has a budget of its own
+ * for every endpoint. `account' is the user ID of the one `msg' is signed
+ * for; untagged requests, and those tagged 0, share one.
+ */
+extern void request_sched_set_account(SoupMessage *msg, uint64_t account);
+/* gets the rate limit of `endpoint' (a URI path) for `account' (or 0)
+ * from the latest response that carried one. returns false when there's
+ * been none yet.
+ */
+extern bool request_sched_get_rate_limit(
+	struct request_sched *s,
+	uint64_t account,
+	const char *endpoint,
+	struct rate_limit *out);
+/* what's come back from one endpoint (a URI path) over all accounts. */
+struct traffic_stats
+{
+	uint64_t requests, not_modified;
+	uint64_t wire_bytes;		/* response bodies as sent */
+	uint64_t wire_unknown;		/* compressed without Content-Length */
+	uint64_t decoded_bytes;		/* and as handed to callers */
+};
+
+extern bool request_sched_get_traffic(
+	struct request_sched *s,
+	const char *endpoint,
+	struct traffic_stats *out);
+extern int request_sched_waiting(struct request_sched *s, enum request_class cls);
+extern int request_sched_running(struct request_sched *s, enum request_class cls);
+
+
+/* from fetch.c
+ *
+ * fetches a JSON array of statuses without blocking the main loop. `msg' is
+ * queued on `reqs' under `cls' and consumed; the response is decoded on a worker
+ * thread, and the done callback runs on the main loop with updates that
+ * have their users and mute verdicts filled in. `updates' is NULL on
+ * failure, with `err' set; both belong to the caller of the callback, so
+ * the callee takes references to what it keeps.
+ *
+ * users are resolved against the user cache of `store'. when a response
+ * changes how a user shows, the rows by them in views on `store' repaint.
+ */
+typedef void (*fetch_done_fn)(
+	GPtrArray *updates,
+	const GError *err,
+	void *dataptr);
+
+extern void fetch_updates_async(
+	struct request_sched *reqs,
+	enum request_class cls,
+	SoupMessage *msg,
+	struct update_store *store,
+	struct mute_filter *mutes,
+	fetch_done_fn done_fn,
+	void *dataptr);
+
+/* decodes stream lines of one JSON message each, the same way. lines that
+ * don't parse, and messages that aren't statuses, are skipped. the lines
+ * are copied.
+ */
+extern void decode_stream_lines_async(
+	const char *const *lines,
+	size_t num_lines,
+	struct update_store *store,
+	struct mute_filter *mutes,
+	fetch_done_fn done_fn,
+	void *dataptr);
+
+
+/* from stream.c
+ *
+ * a streaming connection: a long-lived request whose response is
+ * newline-delimited messages. it's reconnected with backoff whenever it
+ * ends or stalls.
+ */
+
+struct stream;		/* private to stream.c */
+
+/* makes the request for each (re)connection. returns NULL to try again
+ * later.
+ */
+typedef SoupMessage *(*stream_request_fn)(void *dataptr);
+/* receives the complete, nonempty lines of one chunk, without their line
+ * breaks. `lines' is NULL-terminated and valid for the call only.
+ */
+typedef void (*stream_lines_fn)(
+	const char *const *lines,
+	size_t num_lines,
+	void *dataptr);
+
+extern struct stream *stream_new(
+	SoupSession *session,
+	stream_request_fn request_fn,
+	stream_lines_fn lines_fn,
+	void *dataptr);
+extern void stream_free(struct stream *s);
+/* true while connected with a successful response. */
+extern bool stream_is_live(struct stream *s);
+/* changes each time a connection goes live. lines delivered under the same
+ * value came over one connection, with nothing missed between them.
+ */
+extern unsigned stream_connection(struct stream *s);
+
+
+/* from userlookup.c
+ *
+ * fills in bare users (those seen only as an id, or in a trimmed user
+ * object) through users/lookup. users that are wanted close together in
+ * time go out in one request of up to 100 ids, and no id is asked for
+ * while it's already on its way.
+ */
+
+struct user_lookup;		/* private to userlookup.c */
+
+/* makes the signed users/lookup request for `ids'. NULL skips them. */
+typedef SoupMessage *(*user_lookup_msg_fn)(
+	const uint64_t *ids,
+	size_t num_ids,
+	void *dataptr);
+/* gets the user objects that came back for `ids', which may be fewer. on
+ * failure `users' is NULL and `err' is set. both belong to the caller.
+ */
+typedef void (*user_lookup_done_fn)(
+	const uint64_t *ids,
+	size_t num_ids,
+	JsonArray *users,
+	const GError *err,
+	void *dataptr);
+
+extern struct user_lookup *user_lookup_new(
+	struct request_sched *reqs,
+	user_lookup_msg_fn msg_fn,
+	user_lookup_done_fn done_fn,
+	void *dataptr);
+extern void user_lookup_free(struct user_lookup *l);
+extern void user_lookup_want(struct user_lookup *l, uint64_t user_id);
+/* ids waiting to go out, or on their way. */
+extern size_t user_lookup_pending(struct user_lookup *l);
+
+
+/* from conversation.c
+ *
+ * conversation views, built from the reply links in the update store.
+ * missing parents are fetched through a status_fetch_fn, in batches: in the
+ * background for fresh updates, and at once for an opened conversation.
+ * either way they're fetched with the account that asked, as given by its
+ * `fetch_data'.
+ */
+
+/* starts a fetch of the statuses `ids', at most 100 of them, which ends in
+ * `done_fn'. ids that don't come back are taken to be unavailable. `cls' is
+ * REQ_LOOKUP when there's a window waiting, and REQ_BACKGROUND otherwise.
+ */
+typedef void (*status_fetch_fn)(
+	const uint64_t *ids,
+	size_t num_ids,
+	enum request_class cls,
+	fetch_done_fn done_fn,
+	void *done_data,
+	void *dataptr);
+
+extern void conversations_init(
+	struct update_store *updates,
+	struct request_sched *reqs,
+	status_fetch_fn fetch_fn);
+extern void conversations_shutdown(void);
+/* queues missing parents of freshly fetched updates for the background. */
+extern void conversations_note_updates(
+	struct update **updates,
+	size_t num_updates,
+	void *fetch_data);
+/* opens a window on the conversation that `status_id' is a part of. its
+ * bare authors are looked up through `users', if not NULL.
+ */
+extern void conversation_open(
+	uint64_t status_id,
+	struct user_lookup *users,
+	void *fetch_data);
+
+
 /* from usercache.c
  *
  * the PtCache reference may be shared using g_object_ref(), but it should
@@ -110,16 +470,197 @@ extern void user_cache_close(struct _pt_cache *uc);	/* unrefs "uc" */
  * usercache call unless retained.
  */
 extern struct user_info *get_user_info(struct _pt_cache *ui_cache, uint64_t id);
+/* *changed_p (if not NULL) gets the PT_USER_INFO_* bits of the fields that
+ * the JSON changed, or 0 when it changed nothing.
+ */
 extern struct user_info *get_user_info_from_json(
 	struct _pt_cache *cache,
-	JsonObject *userinfo_obj);
+	JsonObject *userinfo_obj,
+	uint64_t *changed_p);
+
+
+/* from idindex.c
+ *
+ * a set of status ids ordered largest first, with position-by-id and
+ * id-by-position lookups in O(log n). inserting a batch of k ids costs
+ * O(k log n) no matter where they fall.
+ */
+
+extern struct id_index *id_index_new(void);
+extern void id_index_free(struct id_index *ix);
+extern size_t id_index_count(const struct id_index *ix);
+/* `pos' must be less than the count. */
+extern uint64_t id_index_nth(const struct id_index *ix, size_t pos);
+/* returns -1 when `id' isn't present. */
+extern ssize_t id_index_position(const struct id_index *ix, uint64_t id);
+/* the number of ids larger than `id', which is its position when present
+ * and where it'd go otherwise.
+ */
+extern size_t id_index_rank(const struct id_index *ix, uint64_t id);
+/* returns false when `id' was already present. */
+extern bool id_index_insert(struct id_index *ix, uint64_t id);
+/* returns false when `id' wasn't present. */
+extern bool id_index_remove(struct id_index *ix, uint64_t id);
+/* drops all but the `count' largest ids. */
+extern void id_index_truncate(struct id_index *ix, size_t count);
+
+
+/* from idranges.c
+ *
+ * a set of status ids kept as disjoint closed ranges, for tracking which
+ * stretches of a timeline have been seen in full.
+ */
+
+struct id_range {
+	uint64_t lo, hi;		/* inclusive */
+};
+
+struct id_ranges;		/* private to idranges.c */
+
+extern struct id_ranges *id_ranges_new(void);
+extern struct id_ranges *id_ranges_copy(const struct id_ranges *r);
+extern void id_ranges_free(struct id_ranges *r);
+extern size_t id_ranges_count(const struct id_ranges *r);
+/* ranges are in ascending order. */
+extern const struct id_range *id_ranges_nth(
+	const struct id_ranges *r,
+	size_t n);
+/* merges with ranges that overlap or adjoin [lo, hi]. */
+extern void id_ranges_add(struct id_ranges *r, uint64_t lo, uint64_t hi);
+extern bool id_ranges_contains(const struct id_ranges *r, uint64_t id);
+/* appends the gaps between ranges to `out', a GArray of struct id_range,
+ * newest first. returns how many there were.
+ */
+extern size_t id_ranges_gaps(const struct id_ranges *r, GArray *out);
+/* drops the oldest ranges until at most `max_count' remain. */
+extern void id_ranges_limit(struct id_ranges *r, size_t max_count);
+
+
+/* from mutefilter.c
+ *
+ * mute rules for words, users and clients. an update is muted when its text
+ * contains any of the words as a whole word (ignoring ASCII case), or its
+ * author or client
+ * is muted. rules are checked once per update at ingest; the verdict is kept
+ * in the update store.
+ */
+
+/* bits of mute_filter_take_changes() */
+#define MUTE_RULES_ADDED 1
+#define MUTE_RULES_REMOVED 2
+
+extern struct mute_filter *mute_filter_new(void);
+extern void mute_filter_free(struct mute_filter *f);
+/* these return false when the rule was already there, or wasn't. */
+extern bool mute_filter_add_word(struct mute_filter *f, const char *word);
+extern bool mute_filter_remove_word(struct mute_filter *f, const char *word);
+extern bool mute_filter_add_user(struct mute_filter *f, uint64_t user_id);
+extern bool mute_filter_remove_user(struct mute_filter *f, uint64_t user_id);
+/* `source' is the client name, as in PtUpdate->source. */
+extern bool mute_filter_add_source(struct mute_filter *f, const char *source);
+extern bool mute_filter_remove_source(
+	struct mute_filter *f,
+	const char *source);
+/* returns MUTE_RULES_* for edits since the last call, and resets them. */
+extern unsigned mute_filter_take_changes(struct mute_filter *f);
+extern bool mute_filter_match_text(struct mute_filter *f, const char *text);
+/* user_id may be 0 and text, source NULL for unknown. */
+extern bool mute_filter_match(
+	struct mute_filter *f,
+	const char *text,
+	uint64_t user_id,
+	const char *source);
+
+
+/* from updatestore.c
+ *
+ * retains updates in columnar form. PtUpdate objects handed out are facades
+ * built on demand; they shouldn't be modified. there's one store per
+ * process, shared by all timeline views.
+ */
+
+extern struct update_store *update_store_new(struct _pt_cache *user_cache);
+extern void update_store_free(struct update_store *store);
+/* borrowed. */
+extern struct _pt_cache *update_store_get_user_cache(
+	struct update_store *store);
+extern size_t update_store_count(struct update_store *store);
+extern bool update_store_has(struct update_store *store, uint64_t id);
+/* copies the update's contents into the store, and keeps `u' around as the
+ * facade for its id. returns false if the id was already present.
+ */
+extern bool update_store_add(struct update_store *store, struct update *u);
+/* returns a new reference, or NULL when `id' isn't in the store. */
+extern struct update *update_store_get(struct update_store *store, uint64_t id);
+extern bool update_store_is_muted(struct update_store *store, uint64_t id);
+/* re-evaluates mute verdicts after the filter's rules changed; `changes' is
+ * from mute_filter_take_changes(). only the updates whose verdict could flip
+ * are looked at. ids whose verdict did flip are appended to muted_out and
+ * unmuted_out (of uint64_t) when those aren't NULL.
+ */
+extern void update_store_refilter(
+	struct update_store *store,
+	struct mute_filter *filter,
+	unsigned changes,
+	GArray *muted_out,
+	GArray *unmuted_out);
+/* the status `id' replies to, or 0 when it's not a reply or not stored.
+ * the parent itself may not be in the store.
+ */
+extern uint64_t update_store_get_parent(struct update_store *store, uint64_t id);
+/* appends ids of stored replies to `id' to ids_out (of uint64_t). returns
+ * the number appended.
+ */
+extern size_t update_store_get_replies(
+	struct update_store *store,
+	uint64_t id,
+	GArray *ids_out);
+/* returns a string owned by the store, valid until the next trim, or NULL. */
+extern const char *update_store_get_text(
+	struct update_store *store,
+	uint64_t id);
+/* returns 0 when `id' isn't in the store, or its author isn't known. */
+extern uint64_t update_store_get_author(
+	struct update_store *store,
+	uint64_t id);
+/* views pin the updates they show, so that the store keeps them. */
+extern void update_store_pin(struct update_store *store, uint64_t id);
+extern void update_store_unpin(struct update_store *store, uint64_t id);
+/* drops unpinned updates, smallest id first, along with their facades until
+ * no more than `max_count' remain or all that remain are pinned. returns
+ * the number dropped.
+ */
+extern size_t update_store_trim(struct update_store *store, size_t max_count);
+/* appends up to `max_count' ids smaller than `below' to ids_out (of
+ * uint64_t), largest first. returns the number appended. costs
+ * O(max_count log n).
+ */
+extern size_t update_store_older(
+	struct update_store *store,
+	uint64_t below,
+	size_t max_count,
+	GArray *ids_out);
+/* appends ids of the author's updates to ids_out (of uint64_t), in store
+ * order. returns the number appended.
+ */
+extern size_t update_store_find_author(
+	struct update_store *store,
+	uint64_t author_id,
+	GArray *ids_out);
+/* drops the PtUpdate kept for `id', so that the next update_store_get()
+ * builds it over, e.g. with its author's info filled in since.
+ */
+extern void update_store_drop_facade(struct update_store *store, uint64_t id);
 
 
 /* from state.c */
 
 extern struct piiptyyt_state *state_empty(void);
-extern struct piiptyyt_state *state_read(GError **err_p);
-extern bool state_write(const struct piiptyyt_state *st, GError **err_p);
+/* every account's state, in the order they were added. the array frees
+ * its members.
+ */
+extern GPtrArray *state_read_accounts(GError **err_p);
+extern bool state_write_accounts(GPtrArray *accounts, GError **err_p);
 extern void state_free(struct piiptyyt_state *state);
 
 
@@ -140,13 +681,19 @@ extern bool oauth_login(
 /* from format.c */
 
 /* reads prior fields. existing strings are g_free()'d. returns true on
- * success, false [with error] on failure.
+ * success, false [with error] on failure; on failure *dest is left as it
+ * was.
+ *
+ * when changed_p is not NULL, *changed_p is set to a mask where bit i is set
+ * iff fields[i] was present and got a different value. num_fields must
+ * therefore not exceed 64.
  */
 extern bool format_from_json(
 	void *dest,
 	JsonObject *obj,
 	const struct field_desc *fields,
 	size_t num_fields,
+	uint64_t *changed_p,
 	GError **err_p);
 
 /* the sqlite formatters interpret the `fields' array as a sequence of fields
@@ -187,6 +734,8 @@ extern bool store_to_sqlite(
 #define OA_REQ_ACCESS_TOKEN 1
 #define OA_REQ_RESOURCE 2
 
+struct oauth_signer;	/* private to oauth.c */
+
 struct oauth_request
 {
 	GStringChunk *strs;
@@ -198,6 +747,7 @@ struct oauth_request
 	int sig_method;
 	char *timestamp, *nonce, *callback_url;
 	char *signature;
+	struct oauth_signer *signer;	/* not owned */
 };
 
 extern void oa_req_free(struct oauth_request *req);
@@ -212,6 +762,9 @@ extern void oa_set_token(
 	const char *token,
 	const char *secret);
 extern void oa_set_verifier(struct oauth_request *req, const char *verifier);
+extern void oa_set_signer(
+	struct oauth_request *req,
+	struct oauth_signer *signer);
 extern void oa_set_extra_param(
 	struct oauth_request *req,
 	const char *key,
@@ -224,6 +777,13 @@ extern char *oa_request_params_to_post_body(
 	int kind);
 extern char **oa_parse_response(const char *body, ...)
 	G_GNUC_NULL_TERMINATED;
+/* keys HMAC-SHA1 once for a consumer and token secret pair. returns NULL on
+ * gcrypt failure.
+ */
+extern struct oauth_signer *oa_signer_new(
+	const char *consumer_secret,
+	const char *token_secret);
+extern void oa_signer_free(struct oauth_signer *s);
 
 
 #endif
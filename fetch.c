@@ -0,0 +1,310 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <json-glib/json-glib.h>
+#include <libsoup/soup.h>
+
+#include "defs.h"
+#include "pt-update.h"
+#include "pt-user-info.h"
+#include "pt-cache.h"
+
+
+#define MAX_DECODE_THREADS 2
+
+
+/* the update fetch pipeline. requests go out on the session's own queue;
+ * responses are decoded into PtUpdates, markup and all, on a worker
+ * thread; the results come back to the main loop in an idle callback,
+ * which resolves users against the user cache and runs the mute filter
+ * before handing them over.
+ *
+ * the user cache and the mute filter are main-thread objects (PtCache over
+ * sqlite, and a lazily compiled automaton), so they're left to the last
+ * step. the worker does the part that scales with response size.
+ */
+struct fetch_job
+{
+	struct update_store *store;	/* not owned */
+	PtCache *user_cache;		/* ref, of `store' */
+	struct mute_filter *mutes;	/* not owned */
+	fetch_done_fn done_fn;
+	void *done_data;
+	bool lenient;				/* skip what isn't a status */
+
+	/* worker input: a response body, or stream lines. */
+	SoupBuffer *body;
+	char **lines;
+
+	/* worker output. user_objs[i] is the "user" member for updates[i], or
+	 * NULL; they point into `parser', or into `messages' for stream lines.
+	 */
+	JsonParser *parser;
+	JsonArray *messages;
+	GPtrArray *updates;
+	JsonObject **user_objs;
+	GError *err;
+};
+
+
+static void fetch_job_free(struct fetch_job *job)
+{
+	if(job->body != NULL) soup_buffer_free(job->body);
+	g_strfreev(job->lines);
+	if(job->updates != NULL) g_ptr_array_free(job->updates, TRUE);
+	g_free(job->user_objs);
+	if(job->messages != NULL) json_array_unref(job->messages);
+	if(job->parser != NULL) g_object_unref(job->parser);
+	if(job->err != NULL) g_error_free(job->err);
+	g_object_unref(job->user_cache);
+	g_slice_free(struct fetch_job, job);
+}
+
+
+static void finish_job(struct fetch_job *job)
+{
+	(*job->done_fn)(job->updates, job->err, job->done_data);
+	fetch_job_free(job);
+}
+
+
+/* main loop side: users, then mutes, then delivery. a page usually has many
+ * updates by few users, so each user's JSON is looked at once. users whose
+ * shown fields changed get their stored rows repainted; the fresh updates
+ * already have markup made with the new info.
+ */
+static gboolean on_job_decoded(gpointer dataptr)
+{
+	struct fetch_job *job = dataptr;
+	if(job->updates == NULL) {
+		finish_job(job);
+		return FALSE;
+	}
+
+	GHashTable *seen = g_hash_table_new(&g_int64_hash, &g_int64_equal);
+	GArray *changed_users = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	for(guint i=0; i < job->updates->len; i++) {
+		PtUpdate *u = g_ptr_array_index(job->updates, i);
+		JsonObject *uobj = job->user_objs[i];
+		if(uobj != NULL) {
+			uint64_t uid = json_object_get_int_member(uobj, "id");
+			PtUserInfo *ui = g_hash_table_lookup(seen, &uid);
+			if(ui == NULL) {
+				uint64_t changed = 0;
+				ui = get_user_info_from_json(job->user_cache, uobj, &changed);
+				if(ui != NULL) g_hash_table_insert(seen, &ui->id, ui);
+				if(ui != NULL && (changed & PT_USER_INFO_DISPLAY_FIELDS) != 0) {
+					g_array_append_val(changed_users, ui->id);
+				}
+			}
+			if(ui != NULL) u->user = g_object_ref(ui);
+		}
+		if(u->user == NULL && u->markup_cache != NULL) {
+			/* made for a user that didn't resolve. */
+			g_free(u->markup_cache);
+			u->markup_cache = NULL;
+		}
+
+		u->muted = mute_filter_match(job->mutes, u->text,
+			u->user != NULL ? u->user->id : 0, u->source);
+	}
+	g_hash_table_destroy(seen);
+	if(changed_users->len > 0) {
+		update_models_users_changed(job->store,
+			(const uint64_t *)changed_users->data, changed_users->len);
+	}
+	g_array_free(changed_users, TRUE);
+
+	finish_job(job);
+	return FALSE;
+}
+
+
+/* parses each stream line by itself, so that a bad one costs only itself.
+ * what isn't an object (e.g. a bare number) is skipped too. the copies kept
+ * in the array share their objects with the parsers' nodes.
+ */
+static JsonArray *parse_lines(char **lines)
+{
+	JsonArray *list = json_array_new();
+	for(int i=0; lines[i] != NULL; i++) {
+		JsonParser *p = json_parser_new();
+		GError *err = NULL;
+		if(!json_parser_load_from_data(p, lines[i], -1, &err)) {
+			g_debug("%s: skipping line %d: %s", __func__, i, err->message);
+			g_error_free(err);
+		} else {
+			JsonNode *root = json_parser_get_root(p);
+			if(root != NULL && JSON_NODE_HOLDS_OBJECT(root)) {
+				json_array_add_element(list, json_node_copy(root));
+			}
+		}
+		g_object_unref(p);
+	}
+	return list;
+}
+
+
+/* worker side. touches nothing but the job, and PtUpdateClass's source memo
+ * which has a lock of its own.
+ */
+static void decode_job_fn(gpointer dataptr, gpointer userdata)
+{
+	struct fetch_job *job = dataptr;
+
+	JsonArray *list = NULL;
+	if(job->lines != NULL) {
+		list = job->messages = parse_lines(job->lines);
+	} else {
+		job->parser = json_parser_new();
+		if(!json_parser_load_from_data(job->parser, job->body->data,
+			job->body->length, &job->err))
+		{
+			goto end;
+		}
+		JsonNode *root = json_parser_get_root(job->parser);
+		if(root == NULL || !JSON_NODE_HOLDS_ARRAY(root)) {
+			g_set_error(&job->err, piiptyyt_error_domain(), 0,
+				"response is not an array");
+			goto end;
+		}
+		list = json_node_get_array(root);
+	}
+	guint len = json_array_get_length(list);
+	job->updates = g_ptr_array_new_with_free_func(&g_object_unref);
+	job->user_objs = g_new0(JsonObject *, len);
+	for(guint i=0; i < len; i++) {
+		JsonObject *obj = json_array_get_object_element(list, i);
+		if(job->lenient && (obj == NULL || !json_object_has_member(obj, "text")
+			|| !json_object_has_member(obj, "id")))
+		{
+			/* friend lists, deletion notices, events, etc. */
+			continue;
+		}
+		PtUpdate *u = obj == NULL ? NULL
+			: pt_update_new_from_json(obj, NULL, &job->err);
+		if(u == NULL && job->lenient) {
+			g_debug("%s: skipping element %u: %s", __func__, i,
+				job->err->message);
+			g_clear_error(&job->err);
+			continue;
+		} else if(u == NULL) {
+			if(job->err == NULL) {
+				g_set_error(&job->err, piiptyyt_error_domain(), 0,
+					"element %u is not an object", i);
+			}
+			g_ptr_array_free(job->updates, TRUE);
+			job->updates = NULL;
+			break;
+		}
+
+		if(json_object_has_member(obj, "user")
+			&& !json_object_get_null_member(obj, "user"))
+		{
+			JsonObject *uobj = json_object_get_object_member(obj, "user");
+			job->user_objs[job->updates->len] = uobj;
+			/* the markup too, unless the user was trimmed to its id. */
+			if(uobj != NULL && json_object_has_member(uobj, "screen_name")) {
+				pt_update_render_markup(u,
+					json_object_get_string_member(uobj, "screen_name"));
+			}
+		}
+		g_ptr_array_add(job->updates, u);
+	}
+
+end:
+	if(job->body != NULL) {
+		soup_buffer_free(job->body);
+		job->body = NULL;
+	}
+	g_idle_add(&on_job_decoded, job);
+}
+
+
+static GThreadPool *decode_pool(void)
+{
+	static GThreadPool *pool = NULL;
+	if(pool == NULL) {
+		GError *err = NULL;
+		pool = g_thread_pool_new(&decode_job_fn, NULL,
+			MAX_DECODE_THREADS, FALSE, &err);
+		if(pool == NULL) {
+			g_error("%s: can't start decode threads: %s", __func__,
+				err->message);
+		}
+	}
+	return pool;
+}
+
+
+static void on_response(
+	SoupSession *session,
+	SoupMessage *msg,
+	gpointer dataptr)
+{
+	struct fetch_job *job = dataptr;
+	if(msg->status_code != SOUP_STATUS_OK) {
+		g_set_error(&job->err, piiptyyt_error_domain(), msg->status_code,
+			"HTTP %u %s", msg->status_code,
+			soup_status_get_phrase(msg->status_code));
+		finish_job(job);
+		return;
+	}
+
+	/* the message goes away after this callback. */
+	job->body = soup_message_body_flatten(msg->response_body);
+	g_thread_pool_push(decode_pool(), job, NULL);
+}
+
+
+static struct fetch_job *fetch_job_new(
+	struct update_store *store,
+	struct mute_filter *mutes,
+	fetch_done_fn done_fn,
+	void *dataptr)
+{
+	struct fetch_job *job = g_slice_new0(struct fetch_job);
+	job->store = store;
+	job->user_cache = g_object_ref(update_store_get_user_cache(store));
+	job->mutes = mutes;
+	job->done_fn = done_fn;
+	job->done_data = dataptr;
+	return job;
+}
+
+
+void fetch_updates_async(
+	struct request_sched *reqs,
+	enum request_class cls,
+	SoupMessage *msg,
+	struct update_store *store,
+	struct mute_filter *mutes,
+	fetch_done_fn done_fn,
+	void *dataptr)
+{
+	struct fetch_job *job = fetch_job_new(store, mutes, done_fn, dataptr);
+	/* consumes the caller's reference. */
+	request_sched_queue(reqs, cls, msg, &on_response, job);
+}
+
+
+void decode_stream_lines_async(
+	const char *const *lines,
+	size_t num_lines,
+	struct update_store *store,
+	struct mute_filter *mutes,
+	fetch_done_fn done_fn,
+	void *dataptr)
+{
+	struct fetch_job *job = fetch_job_new(store, mutes, done_fn, dataptr);
+	job->lenient = true;
+	job->lines = g_new(char *, num_lines + 1);
+	for(size_t i=0; i < num_lines; i++) job->lines[i] = g_strdup(lines[i]);
+	job->lines[num_lines] = NULL;
+	g_thread_pool_push(decode_pool(), job, NULL);
+}
@@ -66,17 +66,96 @@ fail:
 }
 
 
-/* FIXME: an error exit at field i leaves fields [0..i) modified. */
+/* scratch storage for one field during format_from_json()'s decoding pass. */
+union field_value
+{
+	uint64_t i;
+	bool b;
+	char *s;
+	GDateTime *t;
+};
+
+
+static void free_field_value(char type, union field_value *val)
+{
+	switch(tolower(type)) {
+	case 's':
+		g_free(val->s);
+		val->s = NULL;
+		break;
+	case 't':
+		if(val->t != NULL) g_date_time_unref(val->t);
+		val->t = NULL;
+		break;
+	}
+}
+
+
+static bool str_equal0(const char *a, const char *b)
+{
+	if(a == NULL || b == NULL) return a == b;
+	else return strcmp(a, b) == 0;
+}
+
+
+/* exchanges *val with the field at `ptr' when their values differ. returns
+ * true in that case. either way *val is left for the caller to free.
+ */
+static bool swap_field_value(char type, void *ptr, union field_value *val)
+{
+	switch(tolower(type)) {
+	case 'i':
+		if(*(uint64_t *)ptr == val->i) return false;
+		*(uint64_t *)ptr = val->i;
+		return true;
+	case 'b':
+		if(*(bool *)ptr == val->b) return false;
+		*(bool *)ptr = val->b;
+		return true;
+	case 's': {
+		char *old = *(char **)ptr;
+		if(str_equal0(old, val->s)) return false;
+		*(char **)ptr = val->s;
+		val->s = old;
+		return true;
+		}
+	case 't': {
+		GDateTime *old = *(GDateTime **)ptr;
+		if(old == val->t
+			|| (old != NULL && val->t != NULL && g_date_time_equal(old, val->t)))
+		{
+			return false;
+		}
+		*(GDateTime **)ptr = val->t;
+		val->t = old;
+		return true;
+		}
+	default:
+		assert(false);
+		return false;
+	}
+}
+
+
 bool format_from_json(
 	void *dest,
 	JsonObject *obj,
 	const struct field_desc *fields,
 	size_t num_fields,
+	uint64_t *changed_p,
 	GError **err_p)
 {
+	assert(num_fields <= 64);
+
+	/* decode everything into scratch storage first, so that an error leaves
+	 * *dest untouched.
+	 */
+	union field_value vals[num_fields];
+	bool present[num_fields];
 	for(size_t i=0; i < num_fields; i++) {
 		const char *name = fields[i].name;
 		JsonNode *node = json_object_get_member(obj, name);
+		present[i] = (node != NULL);
 		if(node == NULL) {
 			/* not present. skip. */
 			continue;
@@ -87,34 +166,42 @@ bool format_from_json(
 			g_set_error(err_p, 0, 0,
 				"%s: field `%s' is null, but not allowed to",
 				__func__, name);
+			for(size_t j=0; j < i; j++) {
+				if(present[j]) free_field_value(fields[j].type, &vals[j]);
+			}
 			return false;
 		}
-		void *ptr = dest + fields[i].offset;
+		union field_value *val = &vals[i];
 		switch(tolower(fields[i].type)) {
 		case 'i':
-			*(uint64_t *)ptr = is_null ? 0 : json_object_get_int_member(obj, name);
+			val->i = is_null ? 0 : json_object_get_int_member(obj, name);
 			break;
 		case 'b':
-			*(bool *)ptr = is_null ? false : json_object_get_boolean_member(obj, name);
+			val->b = is_null ? false : json_object_get_boolean_member(obj, name);
 			break;
 		case 's':
-			g_free(*(char **)ptr);
-			*(char **)ptr = is_null ? NULL : g_strdup(json_object_get_string_member(obj, name));
+			val->s = is_null ? NULL : g_strdup(json_object_get_string_member(obj, name));
 			break;
-		case 't': {
-			GDateTime **dt_p = ptr;
-			if(*dt_p != NULL) {
-				g_date_time_unref(*dt_p);
-				*dt_p = NULL;
-			}
-			*dt_p = parse_datetime(json_object_get_string_member(obj, name));
+		case 't':
+			val->t = is_null ? NULL : parse_datetime(json_object_get_string_member(obj, name));
 			break;
-			}
 		default:
 			assert(false);
 		}
 	}
 
+	/* commit. */
+	uint64_t changed = 0;
+	for(size_t i=0; i < num_fields; i++) {
+		if(!present[i]) continue;
+		void *ptr = dest + fields[i].offset;
+		if(swap_field_value(fields[i].type, ptr, &vals[i])) {
+			changed |= (uint64_t)1 << i;
+		}
+		free_field_value(fields[i].type, &vals[i]);
+	}
+	if(changed_p != NULL) *changed_p = changed;
+
 	return true;
 }
 
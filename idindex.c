@@ -0,0 +1,395 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <glib.h>
+
+#include "defs.h"
+
+
+/* ids per leaf, and children per interior node. 64 ids make a leaf eight
+ * cache lines.
+ */
+#define IX_ORDER 64
+
+
+struct ix_node
+{
+	bool leaf;
+	int n;			/* ids in a leaf, children in an interior node */
+};
+
+struct ix_leaf
+{
+	struct ix_node hdr;
+	uint64_t ids[IX_ORDER];		/* largest first */
+};
+
+struct ix_interior
+{
+	struct ix_node hdr;
+	uint64_t keys[IX_ORDER];	/* first (largest) id under each child */
+	size_t counts[IX_ORDER];	/* number of ids under each child */
+	struct ix_node *child[IX_ORDER];
+};
+
+
+/* a counted B+-tree. positions count from the largest id, like the rows of a
+ * timeline.
+ */
+struct id_index
+{
+	struct ix_node *root;	/* NULL when empty */
+	size_t count;
+};
+
+
+#define LEAF(n) ((struct ix_leaf *)(n))
+#define INTERIOR(n) ((struct ix_interior *)(n))
+
+
+static inline uint64_t first_id(const struct ix_node *n) {
+	return n->leaf ? LEAF(n)->ids[0] : INTERIOR(n)->keys[0];
+}
+
+
+static size_t node_total(const struct ix_node *n)
+{
+	if(n->leaf) return n->n;
+	size_t acc = 0;
+	for(int i=0; i < n->n; i++) acc += INTERIOR(n)->counts[i];
+	return acc;
+}
+
+
+/* index of the child whose range covers `id': the last one whose first id is
+ * >= id, or 0 when id is larger than all of them.
+ */
+static int pick_child(const struct ix_interior *n, uint64_t id)
+{
+	int lo = 1, hi = n->hdr.n;
+	while(lo < hi) {
+		int mid = (lo + hi) / 2;
+		if(n->keys[mid] >= id) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo - 1;
+}
+
+
+/* index of the first id in the leaf that's <= id. */
+static int leaf_search(const struct ix_leaf *n, uint64_t id)
+{
+	int lo = 0, hi = n->hdr.n;
+	while(lo < hi) {
+		int mid = (lo + hi) / 2;
+		if(n->ids[mid] > id) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+
+static void free_node(struct ix_node *n)
+{
+	if(n->leaf) g_slice_free(struct ix_leaf, LEAF(n));
+	else {
+		struct ix_interior *in = INTERIOR(n);
+		for(int i=0; i < in->hdr.n; i++) free_node(in->child[i]);
+		g_slice_free(struct ix_interior, in);
+	}
+}
+
+
+struct id_index *id_index_new(void)
+{
+	struct id_index *ix = g_new(struct id_index, 1);
+	ix->root = NULL;
+	ix->count = 0;
+	return ix;
+}
+
+
+void id_index_free(struct id_index *ix)
+{
+	if(ix->root != NULL) free_node(ix->root);
+	g_free(ix);
+}
+
+
+size_t id_index_count(const struct id_index *ix) {
+	return ix->count;
+}
+
+
+uint64_t id_index_nth(const struct id_index *ix, size_t pos)
+{
+	assert(pos < ix->count);
+	const struct ix_node *n = ix->root;
+	while(!n->leaf) {
+		const struct ix_interior *in = INTERIOR(n);
+		int i = 0;
+		while(pos >= in->counts[i]) {
+			pos -= in->counts[i++];
+			assert(i < in->hdr.n);
+		}
+		n = in->child[i];
+	}
+	assert(pos < n->n);
+	return LEAF(n)->ids[pos];
+}
+
+
+/* the leaf where `id' is or would go, its index there in *i_p, and in
+ * *pos_p the number of ids larger than it.
+ */
+static const struct ix_leaf *find_leaf(
+	const struct id_index *ix,
+	uint64_t id,
+	size_t *pos_p,
+	int *i_p)
+{
+	size_t pos = 0;
+	const struct ix_node *n = ix->root;
+	while(!n->leaf) {
+		const struct ix_interior *in = INTERIOR(n);
+		int c = pick_child(in, id);
+		for(int i=0; i < c; i++) pos += in->counts[i];
+		n = in->child[c];
+	}
+	*i_p = leaf_search(LEAF(n), id);
+	*pos_p = pos + *i_p;
+	return LEAF(n);
+}
+
+
+ssize_t id_index_position(const struct id_index *ix, uint64_t id)
+{
+	if(ix->root == NULL) return -1;
+
+	size_t pos;
+	int i;
+	const struct ix_leaf *leaf = find_leaf(ix, id, &pos, &i);
+	if(i < leaf->hdr.n && leaf->ids[i] == id) return pos;
+	else return -1;
+}
+
+
+size_t id_index_rank(const struct id_index *ix, uint64_t id)
+{
+	if(ix->root == NULL) return 0;
+	size_t pos;
+	int i;
+	find_leaf(ix, id, &pos, &i);
+	return pos;
+}
+
+
+/* inserts `id' under `n'. returns false when it was already present. when
+ * `n' had to split, *split_p is set to its new right-hand sibling.
+ */
+static bool node_insert(struct ix_node *n, uint64_t id, struct ix_node **split_p)
+{
+	*split_p = NULL;
+
+	if(n->leaf) {
+		struct ix_leaf *l = LEAF(n);
+		int pos = leaf_search(l, id);
+		if(pos < l->hdr.n && l->ids[pos] == id) return false;
+
+		if(l->hdr.n == IX_ORDER) {
+			/* split in half, then insert into whichever half it goes. */
+			struct ix_leaf *r = g_slice_new(struct ix_leaf);
+			r->hdr.leaf = true;
+			r->hdr.n = IX_ORDER / 2;
+			memcpy(r->ids, &l->ids[IX_ORDER / 2],
+				sizeof(uint64_t) * (IX_ORDER / 2));
+			l->hdr.n = IX_ORDER / 2;
+			*split_p = &r->hdr;
+			if(pos > IX_ORDER / 2) {
+				l = r;
+				pos -= IX_ORDER / 2;
+			}
+		}
+		memmove(&l->ids[pos + 1], &l->ids[pos],
+			sizeof(uint64_t) * (l->hdr.n - pos));
+		l->ids[pos] = id;
+		l->hdr.n++;
+		return true;
+	}
+
+	struct ix_interior *in = INTERIOR(n);
+	int c = pick_child(in, id);
+	struct ix_node *child_split;
+	if(!node_insert(in->child[c], id, &child_split)) return false;
+
+	in->keys[c] = first_id(in->child[c]);
+	if(child_split == NULL) {
+		in->counts[c]++;
+		return true;
+	}
+
+	in->counts[c] = node_total(in->child[c]);
+	int pos = c + 1;
+	if(in->hdr.n == IX_ORDER) {
+		struct ix_interior *r = g_slice_new(struct ix_interior);
+		r->hdr.leaf = false;
+		r->hdr.n = IX_ORDER / 2;
+		memcpy(r->keys, &in->keys[IX_ORDER / 2],
+			sizeof(uint64_t) * (IX_ORDER / 2));
+		memcpy(r->counts, &in->counts[IX_ORDER / 2],
+			sizeof(size_t) * (IX_ORDER / 2));
+		memcpy(r->child, &in->child[IX_ORDER / 2],
+			sizeof(struct ix_node *) * (IX_ORDER / 2));
+		in->hdr.n = IX_ORDER / 2;
+		*split_p = &r->hdr;
+		if(pos > IX_ORDER / 2) {
+			in = r;
+			pos -= IX_ORDER / 2;
+		}
+	}
+	int tail = in->hdr.n - pos;
+	memmove(&in->keys[pos + 1], &in->keys[pos], sizeof(uint64_t) * tail);
+	memmove(&in->counts[pos + 1], &in->counts[pos], sizeof(size_t) * tail);
+	memmove(&in->child[pos + 1], &in->child[pos],
+		sizeof(struct ix_node *) * tail);
+	in->keys[pos] = first_id(child_split);
+	in->counts[pos] = node_total(child_split);
+	in->child[pos] = child_split;
+	in->hdr.n++;
+	return true;
+}
+
+
+bool id_index_insert(struct id_index *ix, uint64_t id)
+{
+	if(ix->root == NULL) {
+		struct ix_leaf *l = g_slice_new(struct ix_leaf);
+		l->hdr.leaf = true;
+		l->hdr.n = 1;
+		l->ids[0] = id;
+		ix->root = &l->hdr;
+		ix->count = 1;
+		return true;
+	}
+
+	struct ix_node *split;
+	if(!node_insert(ix->root, id, &split)) return false;
+	ix->count++;
+
+	if(split != NULL) {
+		/* grow a new root. */
+		struct ix_interior *r = g_slice_new(struct ix_interior);
+		r->hdr.leaf = false;
+		r->hdr.n = 2;
+		r->child[0] = ix->root;
+		r->child[1] = split;
+		for(int i=0; i < 2; i++) {
+			r->keys[i] = first_id(r->child[i]);
+			r->counts[i] = node_total(r->child[i]);
+		}
+		ix->root = &r->hdr;
+	}
+	return true;
+}
+
+
+/* removes `id' from under `n'. returns false when it wasn't there. children
+ * that become empty are freed; the rest aren't rebalanced, since removal is
+ * rare next to insertion.
+ */
+static bool node_remove(struct ix_node *n, uint64_t id)
+{
+	if(n->leaf) {
+		struct ix_leaf *l = LEAF(n);
+		int pos = leaf_search(l, id);
+		if(pos == l->hdr.n || l->ids[pos] != id) return false;
+		memmove(&l->ids[pos], &l->ids[pos + 1],
+			sizeof(uint64_t) * (l->hdr.n - pos - 1));
+		l->hdr.n--;
+		return true;
+	}
+
+	struct ix_interior *in = INTERIOR(n);
+	int c = pick_child(in, id);
+	if(!node_remove(in->child[c], id)) return false;
+
+	if(--in->counts[c] > 0) in->keys[c] = first_id(in->child[c]);
+	else {
+		free_node(in->child[c]);
+		int tail = in->hdr.n - c - 1;
+		memmove(&in->keys[c], &in->keys[c + 1], sizeof(uint64_t) * tail);
+		memmove(&in->counts[c], &in->counts[c + 1], sizeof(size_t) * tail);
+		memmove(&in->child[c], &in->child[c + 1],
+			sizeof(struct ix_node *) * tail);
+		in->hdr.n--;
+	}
+	return true;
+}
+
+
+/* don't leave a chain of single children on top. */
+static void collapse_root(struct id_index *ix)
+{
+	while(!ix->root->leaf && ix->root->n == 1) {
+		struct ix_interior *old = INTERIOR(ix->root);
+		ix->root = old->child[0];
+		g_slice_free(struct ix_interior, old);
+	}
+}
+
+
+bool id_index_remove(struct id_index *ix, uint64_t id)
+{
+	if(ix->root == NULL || !node_remove(ix->root, id)) return false;
+
+	if(--ix->count == 0) {
+		free_node(ix->root);
+		ix->root = NULL;
+	} else {
+		collapse_root(ix);
+	}
+	return true;
+}
+
+
+/* keeps the first `keep' ids under `n', which must be fewer than it has. */
+static void node_truncate(struct ix_node *n, size_t keep)
+{
+	assert(keep > 0);
+	if(n->leaf) {
+		assert(keep < n->n);
+		n->n = keep;
+		return;
+	}
+
+	struct ix_interior *in = INTERIOR(n);
+	int c = 0;
+	while(keep > in->counts[c]) keep -= in->counts[c++];
+	for(int i = c + 1; i < in->hdr.n; i++) free_node(in->child[i]);
+	in->hdr.n = c + 1;
+	if(keep < in->counts[c]) {
+		node_truncate(in->child[c], keep);
+		in->counts[c] = keep;
+	}
+}
+
+
+void id_index_truncate(struct id_index *ix, size_t count)
+{
+	if(count >= ix->count) return;
+	if(count == 0) {
+		free_node(ix->root);
+		ix->root = NULL;
+		ix->count = 0;
+		return;
+	}
+
+	node_truncate(ix->root, count);
+	ix->count = count;
+	/* nodes along the right edge may now be sparse, which is fine. */
+	collapse_root(ix);
+}
@@ -0,0 +1,128 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <glib.h>
+
+#include "defs.h"
+
+
+/* disjoint, non-adjacent closed ranges sorted by `lo'. there are few of
+ * them at any time (gaps get filled, and ranges merge), so a flat array
+ * does.
+ */
+struct id_ranges
+{
+	GArray *ranges;		/* of struct id_range */
+};
+
+
+struct id_ranges *id_ranges_new(void)
+{
+	struct id_ranges *r = g_new(struct id_ranges, 1);
+	r->ranges = g_array_new(FALSE, FALSE, sizeof(struct id_range));
+	return r;
+}
+
+
+struct id_ranges *id_ranges_copy(const struct id_ranges *r)
+{
+	struct id_ranges *c = id_ranges_new();
+	g_array_append_vals(c->ranges, r->ranges->data, r->ranges->len);
+	return c;
+}
+
+
+void id_ranges_free(struct id_ranges *r)
+{
+	if(r == NULL) return;
+	g_array_free(r->ranges, TRUE);
+	g_free(r);
+}
+
+
+size_t id_ranges_count(const struct id_ranges *r) {
+	return r->ranges->len;
+}
+
+
+const struct id_range *id_ranges_nth(const struct id_ranges *r, size_t n)
+{
+	assert(n < r->ranges->len);
+	return &g_array_index(r->ranges, struct id_range, n);
+}
+
+
+/* index of the first range whose hi + 1 >= id, i.e. the first that `id'
+ * could touch. may be `len'.
+ */
+static guint first_touching(const struct id_ranges *r, uint64_t id)
+{
+	guint lo = 0, hi = r->ranges->len;
+	while(lo < hi) {
+		guint mid = (lo + hi) / 2;
+		const struct id_range *m = &g_array_index(r->ranges,
+			struct id_range, mid);
+		if(m->hi < UINT64_MAX && m->hi + 1 < id) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+
+void id_ranges_add(struct id_ranges *r, uint64_t lo, uint64_t hi)
+{
+	g_return_if_fail(lo <= hi);
+
+	/* ranges [i, j) overlap or adjoin the new one, and merge into it. */
+	guint i = first_touching(r, lo), j = i;
+	while(j < r->ranges->len) {
+		const struct id_range *x = &g_array_index(r->ranges,
+			struct id_range, j);
+		if(hi < UINT64_MAX && x->lo > hi + 1) break;
+		lo = MIN(lo, x->lo);
+		hi = MAX(hi, x->hi);
+		j++;
+	}
+
+	struct id_range merged = { .lo = lo, .hi = hi };
+	if(j > i) {
+		g_array_index(r->ranges, struct id_range, i) = merged;
+		g_array_remove_range(r->ranges, i + 1, j - i - 1);
+	} else {
+		g_array_insert_val(r->ranges, i, merged);
+	}
+}
+
+
+bool id_ranges_contains(const struct id_ranges *r, uint64_t id)
+{
+	guint i = first_touching(r, id);
+	if(i == r->ranges->len) return false;
+	const struct id_range *x = &g_array_index(r->ranges, struct id_range, i);
+	return x->lo <= id && id <= x->hi;
+}
+
+
+size_t id_ranges_gaps(const struct id_ranges *r, GArray *out)
+{
+	size_t n = 0;
+	for(guint i = r->ranges->len; i > 1; i--) {
+		const struct id_range *above = &g_array_index(r->ranges,
+				struct id_range, i - 1),
+			*below = &g_array_index(r->ranges, struct id_range, i - 2);
+		struct id_range gap = { .lo = below->hi + 1, .hi = above->lo - 1 };
+		g_array_append_val(out, gap);
+		n++;
+	}
+	return n;
+}
+
+
+void id_ranges_limit(struct id_ranges *r, size_t max_count)
+{
+	if(r->ranges->len > max_count) {
+		g_array_remove_range(r->ranges, 0, r->ranges->len - max_count);
+	}
+}
@@ -147,11 +147,12 @@ static bool launch_authorization_browser(
 	const char *req_token,
 	GError **err_p)
 {
-	const char *auth_uri = "https://api.twitter.com/oauth/authorize";
-	char *browser_uri = g_strdup_printf("%s?oauth_token=%s", auth_uri,
-		req_token);
+	char *auth_uri = api_uri("/oauth/authorize"),
+		*browser_uri = g_strdup_printf("%s?oauth_token=%s", auth_uri,
+			req_token);
 	gboolean ok = gtk_show_uri(NULL, browser_uri, time(NULL), err_p);
 	g_free(browser_uri);
+	g_free(auth_uri);
 	return ok != FALSE;
 }
 
@@ -165,11 +166,11 @@ bool oauth_login(
 	GError **err_p)
 {
 #if !USE_LOCAL_CGI
-	const char *token_uri = "https://api.twitter.com/oauth/request_token";
-	const char *access_uri = "https://api.twitter.com/oauth/access_token";
+	char *token_uri = api_uri("/oauth/request_token"),
+		*access_uri = api_uri("/oauth/access_token");
 #else
-	const char *token_uri = "https://localhost/cgi-bin/oauth.cgi/request_token";
-	const char *access_uri = "https://localhost/cgi-bin/oauth.cgi/access_token";
+	char *token_uri = g_strdup("https://localhost/cgi-bin/oauth.cgi/request_token"),
+		*access_uri = g_strdup("https://localhost/cgi-bin/oauth.cgi/access_token");
 #endif
 
 	SoupSession *ss = soup_session_async_new();
@@ -258,6 +259,8 @@ bool oauth_login(
 end:
 	g_object_unref(msg);
 	g_object_unref(ss);
+	g_free(token_uri);
+	g_free(access_uri);
 
 	return ok;
 }
@@ -1,7 +1,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <assert.h>
 #include <gtk/gtk.h>
 #include <glib.h>
@@ -10,10 +12,47 @@
 
 #include "defs.h"
 #include "pt-update.h"
+#include "pt-user-info.h"
 #include "pt-cache.h"
+#include "pt-timeline-model.h"
 
 
-#define UPDATE_INTERVAL_MSEC (15 * 1000)
+/* the home timeline is polled every MIN_POLL_SEC to MAX_POLL_SEC seconds,
+ * aiming for POLL_TARGET new updates per poll. the arrival rate is a moving
+ * average with RATE_WEIGHT given to the latest poll.
+ *
+ * TODO: get these from config
+ */
+#define MIN_POLL_SEC 20
+#define MAX_POLL_SEC 600
+#define FIRST_POLL_SEC 60
+#define POLL_TARGET 10
+#define RATE_WEIGHT 0.3
+#define MIN_POLL_COUNT 20
+#define MAX_POLL_COUNT 200
+
+/* gaps in the timeline, e.g. from a poll that came back full after a
+ * suspend, are filled in with up to MAX_BACKFILL requests at once. a lone
+ * gap is split between them when it's at least MIN_SPLIT_IDS wide (about
+ * four seconds' worth of snowflake ids). backfill runs as background
+ * requests, which the request scheduler paces to the rate limit. only the
+ * newest MAX_COVERED_RANGES stretches of coverage are remembered.
+ */
+#define MAX_BACKFILL 3
+#define BACKFILL_COUNT 200
+#define MIN_SPLIT_IDS ((uint64_t)1 << 34)
+#define MAX_COVERED_RANGES 64
+
+#define HOME_TIMELINE_PATH "/1/statuses/home_timeline.json"
+#define STATUS_LOOKUP_PATH "/1/statuses/lookup.json"
+#define USERS_LOOKUP_PATH "/1/users/lookup.json"
+#define USER_STREAM_PATH "/2/user.json"
+
+/* where the REST and streaming APIs live, unless PIIPTYYT_API_BASE and
+ * PIIPTYYT_STREAM_BASE say otherwise (e.g. to point at utils/mockapi).
+ */
+#define DEFAULT_API_BASE "https://api.twitter.com"
+#define DEFAULT_STREAM_BASE "https://userstream.twitter.com"
 
 #define ERROR_FAIL(err) toplevel_err(__FILE__, __LINE__, __func__, (err))
 
@@ -31,38 +70,233 @@ static void toplevel_err(
 }
 
 
-static bool read_config(void)
+/* the [mute] lists as last read, so that a reload can take out the rules
+ * that went away. NULL for an empty list.
+ */
+struct mute_rules {
+	char **words, **users, **sources;
+};
+
+/* settings from $XDG_CONFIG_HOME/piiptyyt/config. a count of zero leaves the
+ * model's own default.
+ */
+static struct {
+	size_t max_rows, max_stored, prefetch_rows;
+	struct mute_rules mutes;
+} config;
+
+
+/* reads a count from `key' in `group' into *val_p, leaving it as it was when
+ * the key isn't there. false when it's malformed or negative.
+ */
+static bool config_count(
+	GKeyFile *kf,
+	const char *group,
+	const char *key,
+	size_t *val_p)
 {
-	bool ok = true;
-#if 0
+	if(!g_key_file_has_key(kf, group, key, NULL)) return true;
+
 	GError *err = NULL;
-	char *cfg_path = g_build_filename(g_get_user_config_dir(),
-		"piiptyyt", "config", NULL);
-	GKeyFile *kf = g_key_file_new();
-	if(!g_key_file_load_from_file(kf, cfg_path, 0, &err)) {
-		if(err->code != ENOENT) {
-			fprintf(stderr, "can't load config: %s (code %d)\n",
-				err->message, err->code);
-			ok = false;
-		} else {
-			/* fill defaults in. */
-			twitter_username = NULL;
-		}
+	int val = g_key_file_get_integer(kf, group, key, &err);
+	if(err != NULL) {
+		fprintf(stderr, "config: [%s] %s: %s\n", group, key, err->message);
+		g_error_free(err);
+		return false;
+	} else if(val < 0) {
+		fprintf(stderr, "config: [%s] %s: can't be negative\n", group, key);
+		return false;
 	} else {
-		/* FIXME: move these into a "per-account" group, specialized by
-		 * service
-		 */
-		twitter_username = g_key_file_get_string(kf, "auth", "username", NULL);
+		*val_p = val;
+		return true;
+	}
+}
+
+
+static char *config_path(void) {
+	return g_build_filename(g_get_user_config_dir(), "piiptyyt", "config",
+		NULL);
+}
+
+
+/* loads the config file into `kf'. a missing file leaves it empty. */
+static bool load_config(GKeyFile *kf)
+{
+	GError *err = NULL;
+	char *cfg_path = config_path();
+	bool ok = g_key_file_load_from_file(kf, cfg_path, 0, &err);
+	if(!ok && err->domain == G_FILE_ERROR && err->code == G_FILE_ERROR_NOENT) {
+		/* the defaults stand. */
+		ok = true;
+	} else if(!ok) {
+		fprintf(stderr, "can't load config: %s (code %d)\n",
+			err->message, err->code);
 	}
 
 	g_free(cfg_path);
 	if(err != NULL) g_error_free(err);
+	return ok;
+}
+
+
+static bool parse_user_id(const char *str, uint64_t *id_p)
+{
+	char *end = NULL;
+	errno = 0;
+	uint64_t id = g_ascii_strtoull(str, &end, 10);
+	if(errno != 0 || end == str || *end != '\0' || id == 0) return false;
+	*id_p = id;
+	return true;
+}
+
+
+static char **config_list(GKeyFile *kf, const char *group, const char *key)
+{
+	char **list = g_key_file_get_string_list(kf, group, key, NULL, NULL);
+	for(int i=0; list != NULL && list[i] != NULL; i++) g_strstrip(list[i]);
+	return list;
+}
+
+
+static void free_mute_rules(struct mute_rules *rules)
+{
+	g_strfreev(rules->words);
+	g_strfreev(rules->users);
+	g_strfreev(rules->sources);
+	rules->words = rules->users = rules->sources = NULL;
+}
+
+
+/* reads the [mute] lists of words, user ids and client names. false when a
+ * user isn't given as a numeric id.
+ */
+static bool read_mute_rules(GKeyFile *kf, struct mute_rules *rules)
+{
+	rules->words = config_list(kf, "mute", "words");
+	rules->users = config_list(kf, "mute", "users");
+	rules->sources = config_list(kf, "mute", "sources");
+	for(int i=0; rules->users != NULL && rules->users[i] != NULL; i++) {
+		uint64_t id;
+		if(rules->users[i][0] != '\0'
+			&& !parse_user_id(rules->users[i], &id))
+		{
+			fprintf(stderr, "config: [mute] users: `%s' isn't a user id\n",
+				rules->users[i]);
+			free_mute_rules(rules);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static bool read_config(void)
+{
+	GKeyFile *kf = g_key_file_new();
+	bool ok = load_config(kf)
+		&& config_count(kf, "view", "max_rows", &config.max_rows)
+		&& config_count(kf, "view", "max_stored", &config.max_stored)
+		&& config_count(kf, "view", "prefetch_rows", &config.prefetch_rows)
+		&& read_mute_rules(kf, &config.mutes);
 	g_key_file_free(kf);
-#endif
 	return ok;
 }
 
 
+typedef bool (*mute_rule_fn)(struct mute_filter *f, const char *rule);
+
+static bool add_user_rule(struct mute_filter *f, const char *rule) {
+	uint64_t id;
+	return parse_user_id(rule, &id) && mute_filter_add_user(f, id);
+}
+
+
+static bool remove_user_rule(struct mute_filter *f, const char *rule) {
+	uint64_t id;
+	return parse_user_id(rule, &id) && mute_filter_remove_user(f, id);
+}
+
+
+static bool strv_has(char **strv, const char *str)
+{
+	for(int i=0; strv != NULL && strv[i] != NULL; i++) {
+		if(strcmp(strv[i], str) == 0) return true;
+	}
+	return false;
+}
+
+
+static void apply_rule_list(
+	struct mute_filter *f,
+	char **old,
+	char **new,
+	mute_rule_fn add_fn,
+	mute_rule_fn remove_fn)
+{
+	for(int i=0; old != NULL && old[i] != NULL; i++) {
+		if(old[i][0] != '\0' && !strv_has(new, old[i])) {
+			(*remove_fn)(f, old[i]);
+		}
+	}
+	for(int i=0; new != NULL && new[i] != NULL; i++) {
+		if(new[i][0] != '\0') (*add_fn)(f, new[i]);
+	}
+}
+
+
+/* takes the rules that're in `old' but not in `new' out of `f', and puts
+ * those of `new' in.
+ */
+static void apply_mute_rules(
+	struct mute_filter *f,
+	const struct mute_rules *old,
+	const struct mute_rules *new)
+{
+	apply_rule_list(f, old->words, new->words,
+		&mute_filter_add_word, &mute_filter_remove_word);
+	apply_rule_list(f, old->users, new->users,
+		&add_user_rule, &remove_user_rule);
+	apply_rule_list(f, old->sources, new->sources,
+		&mute_filter_add_source, &mute_filter_remove_source);
+}
+
+
+struct mute_watch {
+	struct update_store *updates;
+	struct mute_filter *mutes;
+};
+
+
+/* edits to the mute rules take effect as the config file is saved. the rest
+ * of it is only read at startup.
+ */
+static void on_config_changed(
+	GFileMonitor *mon,
+	GFile *file,
+	GFile *other_file,
+	GFileMonitorEvent event,
+	gpointer dataptr)
+{
+	struct mute_watch *w = dataptr;
+	if(event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT
+		&& event != G_FILE_MONITOR_EVENT_CREATED
+		&& event != G_FILE_MONITOR_EVENT_DELETED)
+	{
+		return;
+	}
+
+	GKeyFile *kf = g_key_file_new();
+	struct mute_rules rules;
+	if(load_config(kf) && read_mute_rules(kf, &rules)) {
+		apply_mute_rules(w->mutes, &config.mutes, &rules);
+		free_mute_rules(&config.mutes);
+		config.mutes = rules;
+		update_models_apply_mutes(w->updates, w->mutes);
+	}
+	g_key_file_free(kf);
+}
+
+
 GQuark piiptyyt_error_domain(void)
 {
 	static GQuark the_val;
@@ -75,6 +309,27 @@ GQuark piiptyyt_error_domain(void)
 }
 
 
+static char *base_uri(const char *env_var, const char *fallback, const char *path)
+{
+	const char *base = g_getenv(env_var);
+	if(base == NULL || base[0] == '\0') base = fallback;
+	/* "http://host:port/" and "http://host:port" alike. */
+	size_t len = strlen(base);
+	while(len > 0 && base[len - 1] == '/') len--;
+	return g_strdup_printf("%.*s%s", (int)len, base, path);
+}
+
+
+char *api_uri(const char *path) {
+	return base_uri("PIIPTYYT_API_BASE", DEFAULT_API_BASE, path);
+}
+
+
+char *stream_uri(const char *path) {
+	return base_uri("PIIPTYYT_STREAM_BASE", DEFAULT_STREAM_BASE, path);
+}
+
+
 GtkBuilder *load_ui(void)
 {
 	GtkBuilder *b = gtk_builder_new();
@@ -102,25 +357,32 @@ static gboolean main_wnd_delete(GtkWidget *obj, GdkEvent *ev, void *data) {
 }
 
 
+/* a query parameter. those whose value is NULL are left out. */
+struct req_param {
+	const char *key, *value;
+};
+
+
 /* FIXME: move this into twitterapi.c or some such */
 SoupMessage *make_resource_request_msg(
 	const char *uri,
 	struct piiptyyt_state *state,
-	...)
+	const struct req_param *params,
+	size_t num_params)
 {
 	struct oauth_request *oa = oa_req_new_with_params(
 		CONSUMER_KEY, CONSUMER_SECRET, uri, "GET", SIG_HMAC_SHA1, NULL);
 	oa_set_token(oa, state->auth_token, state->auth_secret);
+	if(state->signer == NULL) {
+		state->signer = oa_signer_new(CONSUMER_SECRET, state->auth_secret);
+	}
+	oa_set_signer(oa, state->signer);
 
-	va_list al;
-	va_start(al, state);
-	for(;;) {
-		const char *key = va_arg(al, const char *);
-		if(key == NULL) break;
-		const char *value = va_arg(al, const char *);
-		oa_set_extra_param(oa, key, value);
+	for(size_t i=0; i < num_params; i++) {
+		if(params[i].value != NULL) {
+			oa_set_extra_param(oa, params[i].key, params[i].value);
+		}
 	}
-	va_end(al);
 
 	if(!oa_sign_request(oa, OA_REQ_RESOURCE)) {
 		/* FIXME */
@@ -132,86 +394,237 @@ SoupMessage *make_resource_request_msg(
 	GHashTable *query = oa_request_params(oa, OA_REQ_RESOURCE);
 	soup_uri_set_query_from_form(soup_message_get_uri(msg), query);
 	g_hash_table_destroy(query);
+	request_sched_set_account(msg, state->userid);
 
 	oa_req_free(oa);
 	return msg;
 }
 
 
-/* returned GPtrArray has a null-safe free-function for convenience. */
-static GPtrArray *parse_update_array(
-	const void *data,
-	size_t length,
-	PtCache *user_cache,
-	GError **err_p)
+/* one account's session: its credentials and poll schedule, and its own
+ * view on the update store that every account shares along with the user
+ * cache, the mute filter and the connections.
+ */
+struct account
 {
-	JsonParser *parser = json_parser_new();
-	gboolean ok = json_parser_load_from_data(parser, data, length, err_p);
-	if(!ok) {
-		g_object_unref(parser);
-		return NULL;
-	}
+	struct piiptyyt_state *state;
+	PtCache *user_cache;
+	struct mute_filter *mutes;
+	struct request_sched *reqs;
+	struct user_lookup *users;	/* looks up with its credentials */
+	struct update_model *model;
+	GHashTable *timeline;	/* ids that came in on its home timeline */
+	struct tv_size_alloc_ctx *tvsa;
+	struct poller *poll;
+	bool trim_users;		/* timelines carry bare user ids */
+};
 
-	/* FIXME: add checks under each "get" call, since this data comes from an
-	 * untrusted source.
-	 */
-	JsonArray *list = json_node_get_array(
-		json_parser_get_root(parser));
-	GList *contents = json_array_get_elements(list);
-	GPtrArray *updates = g_ptr_array_new_with_free_func(
-		(GDestroyNotify)&g_object_unref);
-	for(GList *cur = g_list_first(contents);
-		cur != NULL;
-		cur = g_list_next(cur))
-	{
-		PtUpdate *u = pt_update_new_from_json(
-			json_node_get_object(cur->data), user_cache, err_p);
-		if(u == NULL) {
-			g_ptr_array_free(updates, TRUE);
-			updates = NULL;
-			break;
-		}
 
-		g_ptr_array_add(updates, u);
+/* the trim_user parameter's value, or NULL to leave it out. */
+static const char *trim_user_arg(const struct account *acct) {
+	return acct->trim_users ? "true" : NULL;
+}
+
+
+/* the store is shared, so each account's view only takes what's on its own
+ * timeline.
+ */
+static bool on_account_timeline(
+	struct update_store *store,
+	uint64_t id,
+	void *dataptr)
+{
+	struct account *acct = dataptr;
+	return g_hash_table_lookup(acct->timeline, &id) != NULL;
+}
+
+
+static gboolean id_not_stored(gpointer key, gpointer value, gpointer dataptr) {
+	return !update_store_has(dataptr, *(const uint64_t *)key);
+}
+
+
+static void add_to_timeline(struct account *acct, GPtrArray *updates)
+{
+	for(guint i=0; i < updates->len; i++) {
+		const struct update *u = g_ptr_array_index(updates, i);
+		uint64_t *key = g_memdup(&u->id, sizeof(u->id));
+		g_hash_table_replace(acct->timeline, key, key);
 	}
+	add_updates_to_model(acct->model, (struct update **)updates->pdata,
+		updates->len);
+	conversations_note_updates((struct update **)updates->pdata,
+		updates->len, acct);
+
+	/* what the store has dropped can't come back from it. */
+	struct update_store *store = acct->model->updates;
+	if(g_hash_table_size(acct->timeline) > 2 * update_store_count(store)) {
+		g_hash_table_foreach_remove(acct->timeline, &id_not_stored, store);
+	}
+}
 
-	g_list_free(contents);
-	g_object_unref(parser);
 
-	return updates;
+struct fetch_more_ctx {
+	struct account *acct;
+	uint64_t low_update_id;
+};
+
+static void on_more_updates(
+	GPtrArray *updates,
+	const GError *err,
+	void *dataptr)
+{
+	struct fetch_more_ctx *ctx = dataptr;
+	if(updates == NULL) {
+		fprintf(stderr, "could not get twet: %s\n", err->message);
+	} else {
+		add_to_timeline(ctx->acct, updates);
+	}
+	if(ctx->low_update_id > 0) {
+		update_model_older_fetched(ctx->acct->model, ctx->low_update_id,
+			updates == NULL ? -1 : (ssize_t)updates->len);
+	}
+	g_slice_free(struct fetch_more_ctx, ctx);
 }
 
 
+/* when low_update_id is nonzero, only updates older than it are fetched.
+ * returns at once; the updates show up once they've arrived.
+ */
 static void fetch_more_updates(
-	struct piiptyyt_state *state,
-	PtCache *user_cache,
-	struct update_model *model,
+	struct account *acct,
 	size_t max_count,
 	uint64_t low_update_id)
 {
-	/* experimental: fetch 20 most recent twates, parse them, output something
-	 * about them.
-	 */
-	const char *status_uri = "https://api.twitter.com/1/statuses/home_timeline.json";
-	SoupMessage *msg = make_resource_request_msg(status_uri, state, NULL);
-	soup_session_send_message(model->http_session, msg);
-	if(msg->status_code != SOUP_STATUS_OK) {
-		fprintf(stderr, "could not get twet: %d %s\n", msg->status_code,
-			soup_status_get_phrase(msg->status_code));
-	} else {
-		GError *err = NULL;
-		GPtrArray *updates = parse_update_array(msg->response_body->data,
-			msg->response_body->length, user_cache, &err);
-		if(updates == NULL) {
-			fprintf(stderr, "can't parse updates: %s\n", err->message);
-			g_error_free(err);
-		} else {
-			add_updates_to_model(model, (struct update **)updates->pdata,
-				updates->len);
-			g_ptr_array_free(updates, TRUE);
+	char count_str[32], max_id_str[32];
+	snprintf(count_str, sizeof(count_str), "%zu", max_count);
+	snprintf(max_id_str, sizeof(max_id_str), "%llu",
+		(unsigned long long)low_update_id - 1);
+	char *uri = api_uri(HOME_TIMELINE_PATH);
+	const struct req_param params[] = {
+		{ "count", count_str },
+		{ "max_id", low_update_id > 0 ? max_id_str : NULL },
+		{ "trim_user", trim_user_arg(acct) },
+	};
+	SoupMessage *msg = make_resource_request_msg(uri, acct->state,
+		params, G_N_ELEMENTS(params));
+	g_free(uri);
+
+	struct fetch_more_ctx *ctx = g_slice_new(struct fetch_more_ctx);
+	ctx->acct = acct;
+	ctx->low_update_id = low_update_id;
+	fetch_updates_async(acct->reqs, REQ_TIMELINE, msg,
+		acct->model->updates, acct->mutes, &on_more_updates, ctx);
+}
+
+
+static void fetch_older_updates(
+	struct update_model *model,
+	uint64_t below_id,
+	void *dataptr)
+{
+	fetch_more_updates(dataptr, 20, below_id);
+}
+
+
+/* status_fetch_fn for conversations. uses the batched lookup endpoint, so
+ * that a whole set of missing parents costs one request.
+ */
+static void fetch_updates_by_id(
+	const uint64_t *ids,
+	size_t num_ids,
+	enum request_class cls,
+	fetch_done_fn done_fn,
+	void *done_data,
+	void *dataptr)
+{
+	struct account *acct = dataptr;
+	GString *id_list = g_string_sized_new(num_ids * 20);
+	for(size_t i=0; i < num_ids; i++) {
+		g_string_append_printf(id_list, "%s%llu", i > 0 ? "," : "",
+			(unsigned long long)ids[i]);
+	}
+	char *uri = api_uri(STATUS_LOOKUP_PATH);
+	const struct req_param params[] = {
+		{ "id", id_list->str },
+		{ "trim_user", trim_user_arg(acct) },
+	};
+	SoupMessage *msg = make_resource_request_msg(uri, acct->state,
+		params, G_N_ELEMENTS(params));
+	g_free(uri);
+	g_string_free(id_list, TRUE);
+	fetch_updates_async(acct->reqs, cls, msg, acct->model->updates,
+		acct->mutes, done_fn, done_data);
+}
+
+
+/* user_lookup_msg_fn. */
+static SoupMessage *make_user_lookup_msg(
+	const uint64_t *ids,
+	size_t num_ids,
+	void *dataptr)
+{
+	struct account *acct = dataptr;
+	GString *id_list = g_string_sized_new(num_ids * 20);
+	for(size_t i=0; i < num_ids; i++) {
+		g_string_append_printf(id_list, "%s%llu", i > 0 ? "," : "",
+			(unsigned long long)ids[i]);
+	}
+	char *uri = api_uri(USERS_LOOKUP_PATH);
+	const struct req_param params[] = { { "user_id", id_list->str } };
+	SoupMessage *msg = make_resource_request_msg(uri, acct->state,
+		params, G_N_ELEMENTS(params));
+	g_free(uri);
+	g_string_free(id_list, TRUE);
+	return msg;
+}
+
+
+/* the users go into the shared user cache, so this repaints every
+ * account's rows by those whose shown fields changed.
+ */
+static void on_users_looked_up(
+	const uint64_t *ids,
+	size_t num_ids,
+	JsonArray *users,
+	const GError *err,
+	void *dataptr)
+{
+	struct account *acct = dataptr;
+	if(users == NULL) return;
+
+	GArray *changed = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	guint len = json_array_get_length(users);
+	for(guint i=0; i < len; i++) {
+		JsonObject *obj = json_array_get_object_element(users, i);
+		uint64_t fields = 0;
+		PtUserInfo *ui = obj == NULL ? NULL
+			: get_user_info_from_json(acct->user_cache, obj, &fields);
+		if(ui != NULL && (fields & PT_USER_INFO_DISPLAY_FIELDS) != 0) {
+			g_array_append_val(changed, ui->id);
 		}
 	}
-	g_object_unref(msg);
+	if(changed->len > 0) {
+		update_models_users_changed(acct->model->updates,
+			(const uint64_t *)changed->data, changed->len);
+	}
+	g_array_free(changed, TRUE);
+}
+
+
+static void on_tv_row_activated(
+	GtkTreeView *view,
+	GtkTreePath *path,
+	GtkTreeViewColumn *column,
+	gpointer dataptr)
+{
+	struct account *acct = dataptr;
+	PtTimelineModel *tm = PT_TIMELINE_MODEL(gtk_tree_view_get_model(view));
+	int pos = gtk_tree_path_get_indices(path)[0];
+	if(pos >= 0 && pos < pt_timeline_model_get_count(tm)) {
+		conversation_open(pt_timeline_model_get_id(tm, pos), acct->users,
+			acct);
+	}
 }
 
 
@@ -256,64 +669,460 @@ static void on_tv_size_allocate(
 }
 
 
-struct update_interval_ctx {
-	guint event_name;
+struct poller
+{
+	struct account *acct;
+	struct stream *stream;	/* or NULL */
+	bool stopped;			/* its window is gone */
+
+	uint64_t newest_id;		/* since_id for the next poll */
+	double rate;			/* new updates per second; < 0 when unknown */
+	gint64 sent_at;			/* monotonic time of the last poll, or 0 */
+	double window;			/* seconds since the one before; 0 if none */
+	size_t count;			/* asked for in the poll in flight */
+	unsigned interval;		/* seconds */
+	guint event_name;		/* 0 while a poll is in flight */
+
+	/* stretches of the timeline that've been fetched in full, and the gaps
+	 * between them being fetched now.
+	 */
+	struct id_ranges *covered;
+	GArray *backfills;		/* of struct id_range */
+	unsigned stream_conn;	/* connection of the last stream batch */
+	uint64_t stream_last_id;	/* newest id from it, or 0 */
 };
 
-static gboolean on_update_interval(gpointer dataptr)
+
+struct backfill_req
 {
-	struct update_interval_ctx *ctx = dataptr;
+	struct poller *p;
+	struct id_range range;
+};
 
-	printf("would fetch more tweates here\n");
 
-// end:
-	/* wait another interval from the end of this process, rather than from
-	 * the beginning.
-	 */
-	ctx->event_name = g_timeout_add(UPDATE_INTERVAL_MSEC,
-		&on_update_interval, ctx);
+static gboolean on_poll_interval(gpointer dataptr);
+static void schedule_backfill(struct poller *p);
+
+
+/* records what a page of home_timeline covers. one that came back short
+ * reaches all the way down to `since_id'; a full one only to its oldest
+ * update, leaving a gap under it. `max_id' is 0 for the top of the
+ * timeline.
+ */
+static void cover_page(
+	struct poller *p,
+	uint64_t since_id,
+	uint64_t max_id,
+	GPtrArray *updates,
+	bool full)
+{
+	uint64_t lo = UINT64_MAX, hi = 0;
+	for(guint i=0; i < updates->len; i++) {
+		const struct update *u = g_ptr_array_index(updates, i);
+		lo = MIN(lo, u->id);
+		hi = MAX(hi, u->id);
+	}
+	if(max_id != 0) hi = max_id;
+	if(!full && since_id != 0) lo = since_id + 1;
+	if(lo <= hi) {
+		id_ranges_add(p->covered, lo, hi);
+		id_ranges_limit(p->covered, MAX_COVERED_RANGES);
+	}
+}
+
+
+static void on_backfill_updates(
+	GPtrArray *updates,
+	const GError *err,
+	void *dataptr)
+{
+	struct backfill_req *req = dataptr;
+	struct poller *p = req->p;
+	for(guint i=0; i < p->backfills->len; i++) {
+		const struct id_range *r = &g_array_index(p->backfills,
+			struct id_range, i);
+		if(r->lo == req->range.lo && r->hi == req->range.hi) {
+			g_array_remove_index_fast(p->backfills, i);
+			break;
+		}
+	}
+
+	if(updates == NULL) {
+		/* the gap stays, and is tried again after the next poll. */
+		g_debug("%s: backfill of [%llu, %llu] failed: %s", __func__,
+			(unsigned long long)req->range.lo,
+			(unsigned long long)req->range.hi, err->message);
+	} else {
+		add_to_timeline(p->acct, updates);
+		cover_page(p, req->range.lo - 1, req->range.hi, updates,
+			updates->len >= BACKFILL_COUNT);
+		schedule_backfill(p);
+	}
+	g_free(req);
+}
+
+
+static void request_backfill(struct poller *p, uint64_t lo, uint64_t hi)
+{
+	char since_id_str[32], max_id_str[32];
+	snprintf(since_id_str, sizeof(since_id_str), "%llu",
+		(unsigned long long)(lo - 1));
+	snprintf(max_id_str, sizeof(max_id_str), "%llu", (unsigned long long)hi);
+	char *uri = api_uri(HOME_TIMELINE_PATH);
+	const struct req_param params[] = {
+		{ "count", G_STRINGIFY(BACKFILL_COUNT) },
+		{ "since_id", since_id_str },
+		{ "max_id", max_id_str },
+		{ "trim_user", trim_user_arg(p->acct) },
+	};
+	SoupMessage *msg = make_resource_request_msg(uri, p->acct->state,
+		params, G_N_ELEMENTS(params));
+	g_free(uri);
+
+	struct backfill_req *req = g_new(struct backfill_req, 1);
+	req->p = p;
+	req->range = (struct id_range){ .lo = lo, .hi = hi };
+	g_array_append_val(p->backfills, req->range);
+	fetch_updates_async(p->acct->reqs, REQ_BACKGROUND, msg,
+		p->acct->model->updates, p->acct->mutes, &on_backfill_updates, req);
+}
+
+
+/* fills free backfill slots with the newest gaps that aren't already being
+ * fetched. when there's just the one gap, it's split by id so that the
+ * pieces come in parallel; each piece closes up from its top, and what a
+ * full page leaves over is picked up on the next round.
+ */
+static void schedule_backfill(struct poller *p)
+{
+	if(p->stopped || p->backfills->len >= MAX_BACKFILL) return;
+
+	struct id_ranges *known = id_ranges_copy(p->covered);
+	for(guint i=0; i < p->backfills->len; i++) {
+		const struct id_range *r = &g_array_index(p->backfills,
+			struct id_range, i);
+		id_ranges_add(known, r->lo, r->hi);
+	}
+	GArray *gaps = g_array_new(FALSE, FALSE, sizeof(struct id_range));
+	size_t n_gaps = id_ranges_gaps(known, gaps);
+	for(size_t i=0; i < n_gaps && p->backfills->len < MAX_BACKFILL; i++) {
+		const struct id_range *g = &g_array_index(gaps, struct id_range, i);
+		uint64_t slots = 1, width = g->hi - g->lo;
+		if(i + 1 == n_gaps) {
+			slots = MIN(MAX_BACKFILL - p->backfills->len,
+				width / MIN_SPLIT_IDS + 1);
+		}
+		uint64_t hi = g->hi;
+		for(uint64_t k = slots; k > 0; k--) {
+			uint64_t lo = k == 1 ? g->lo : hi - (hi - g->lo) / k;
+			request_backfill(p, lo, hi);
+			hi = lo - 1;
+		}
+	}
+	g_array_free(gaps, TRUE);
+	id_ranges_free(known);
+}
+
+
+/* picks the next interval from the arrival rate, then stretches it to fit
+ * the rate limit. half of the remaining budget is left for paging back and
+ * backfill.
+ */
+static void schedule_poll(struct poller *p, bool failed, bool overflowed)
+{
+	if(p->stopped) return;
+
+	double iv;
+	if(failed) iv = MAX(p->interval, MIN_POLL_SEC) * 2;
+	else if(overflowed) iv = MIN_POLL_SEC;
+	else if(p->rate > 0) iv = POLL_TARGET / p->rate;
+	else iv = p->rate < 0 ? FIRST_POLL_SEC : MAX_POLL_SEC;
+	iv = CLAMP(iv, MIN_POLL_SEC, MAX_POLL_SEC);
+
+	struct rate_limit rl;
+	struct account *acct = p->acct;
+	if(request_sched_get_rate_limit(acct->reqs, acct->state->userid,
+		HOME_TIMELINE_PATH, &rl))
+	{
+		int64_t left = rl.reset - (int64_t)time(NULL);
+		if(left > 0 && rl.remaining <= 1) iv = MAX(iv, left + 1);
+		else if(left > 0) iv = MAX(iv, (double)left / (rl.remaining / 2));
+	}
+
+	p->interval = (unsigned)iv;
+	p->event_name = g_timeout_add_seconds(p->interval, &on_poll_interval, p);
+}
+
+
+static void on_poll_updates(
+	GPtrArray *updates,
+	const GError *err,
+	void *dataptr)
+{
+	struct poller *p = dataptr;
+	if(updates == NULL) {
+		fprintf(stderr, "could not poll twets: %s\n", err->message);
+		schedule_poll(p, true, false);
+		return;
+	}
+
+	size_t fresh = 0;
+	uint64_t newest = p->newest_id;
+	for(guint i=0; i < updates->len; i++) {
+		struct update *u = g_ptr_array_index(updates, i);
+		if(u->id > p->newest_id) fresh++;
+		newest = MAX(newest, u->id);
+	}
+	add_to_timeline(p->acct, updates);
+
+	/* the first poll has no since_id, so it says nothing of the rate. */
+	if(p->newest_id != 0 && p->window > 0) {
+		double r = fresh / MAX(1.0, p->window);
+		p->rate = p->rate < 0 ? r : RATE_WEIGHT * r + (1 - RATE_WEIGHT) * p->rate;
+	}
+	cover_page(p, p->newest_id, 0, updates, updates->len >= p->count);
+	p->newest_id = newest;
+	schedule_backfill(p);
+
+	/* a full page means there's likely more; come back soon. */
+	schedule_poll(p, false, fresh > 0 && fresh >= p->count);
+}
+
+
+/* asks for enough to cover what's likely arrived since the last poll, with
+ * room to spare.
+ */
+static void poll_now(struct poller *p)
+{
+	gint64 now = g_get_monotonic_time();
+	p->window = p->sent_at == 0 ? 0 : (now - p->sent_at) / 1e6;
+	size_t count = MIN_POLL_COUNT;
+	if(p->rate > 0) {
+		count = CLAMP((size_t)(p->rate * p->window * 2), MIN_POLL_COUNT,
+			MAX_POLL_COUNT);
+	}
+
+	char count_str[32], since_id_str[32];
+	snprintf(count_str, sizeof(count_str), "%zu", count);
+	snprintf(since_id_str, sizeof(since_id_str), "%llu",
+		(unsigned long long)p->newest_id);
+	char *uri = api_uri(HOME_TIMELINE_PATH);
+	const struct req_param params[] = {
+		{ "count", count_str },
+		{ "since_id", p->newest_id > 0 ? since_id_str : NULL },
+		{ "trim_user", trim_user_arg(p->acct) },
+	};
+	SoupMessage *msg = make_resource_request_msg(uri, p->acct->state,
+		params, G_N_ELEMENTS(params));
+	g_free(uri);
+
+	p->count = count;
+	p->sent_at = now;
+	p->event_name = 0;
+	fetch_updates_async(p->acct->reqs, REQ_TIMELINE, msg,
+		p->acct->model->updates, p->acct->mutes, &on_poll_updates, p);
+}
+
+
+static gboolean on_poll_interval(gpointer dataptr)
+{
+	struct poller *p = dataptr;
+	if(p->stream != NULL && stream_is_live(p->stream)
+		&& g_get_monotonic_time() - p->sent_at
+			< (gint64)MAX_POLL_SEC * G_USEC_PER_SEC)
+	{
+		/* the stream has it covered. polls only fill in gaps, but they
+		 * resume as soon as the stream goes down.
+		 */
+		p->event_name = g_timeout_add_seconds(MIN_POLL_SEC,
+			&on_poll_interval, p);
+	} else {
+		poll_now(p);
+	}
 	return FALSE;
 }
 
 
-int main(int argc, char *argv[])
+static SoupMessage *make_stream_msg(void *dataptr)
 {
-	g_thread_init(NULL);
-	gtk_init(&argc, &argv);
+	struct poller *p = dataptr;
+	char *uri = stream_uri(USER_STREAM_PATH);
+	SoupMessage *msg = make_resource_request_msg(uri, p->acct->state, NULL, 0);
+	g_free(uri);
+	return msg;
+}
 
-	if(!gcry_check_version(GCRYPT_VERSION)) {
-		fprintf(stderr, "libgcrypt version mismatch!\n");
-		return EXIT_FAILURE;
+
+struct stream_batch
+{
+	struct poller *p;
+	unsigned conn;			/* stream_connection() at arrival */
+};
+
+
+/* a connection delivers everything after it goes live, so the timeline is
+ * covered from the first update it brought on up. a new connection starts
+ * a new stretch, and the gap before it gets backfilled.
+ */
+static void on_stream_updates(
+	GPtrArray *updates,
+	const GError *err,
+	void *dataptr)
+{
+	struct stream_batch *batch = dataptr;
+	struct poller *p = batch->p;
+	if(updates == NULL) {
+		g_debug("%s: can't decode stream messages: %s", __func__,
+			err->message);
+		g_free(batch);
+		return;
 	}
-	gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
 
-	GtkBuilder *b = load_ui();
+	uint64_t lo = UINT64_MAX, hi = 0;
+	for(guint i=0; i < updates->len; i++) {
+		struct update *u = g_ptr_array_index(updates, i);
+		p->newest_id = MAX(p->newest_id, u->id);
+		lo = MIN(lo, u->id);
+		hi = MAX(hi, u->id);
+	}
+	add_to_timeline(p->acct, updates);
 
-	/* FIXME: error checks */
-	struct piiptyyt_state *state = state_read(NULL);
-	if(state == NULL) {
-		state = state_empty();
-		state_write(state, NULL);
+	if(updates->len > 0) {
+		if(batch->conn == p->stream_conn && p->stream_last_id != 0) {
+			lo = MIN(lo, p->stream_last_id);
+		}
+		if(batch->conn != p->stream_conn) p->stream_last_id = 0;
+		p->stream_conn = batch->conn;
+		p->stream_last_id = MAX(p->stream_last_id, hi);
+		id_ranges_add(p->covered, lo, hi);
+		id_ranges_limit(p->covered, MAX_COVERED_RANGES);
+		schedule_backfill(p);
 	}
+	g_free(batch);
+}
 
-	if(!read_config()) {
-		fprintf(stderr, "config read error!\n");
-		return EXIT_FAILURE;
+
+/* each line is one JSON message. those of a chunk go to one decode job,
+ * which parses them one by one and skips the ones that are malformed.
+ */
+static void on_stream_lines(
+	const char *const *lines,
+	size_t num_lines,
+	void *dataptr)
+{
+	struct poller *p = dataptr;
+	struct stream_batch *batch = g_new(struct stream_batch, 1);
+	batch->p = p;
+	batch->conn = stream_connection(p->stream);
+	decode_stream_lines_async(lines, num_lines, p->acct->model->updates,
+		p->acct->mutes, &on_stream_updates, batch);
+}
+
+
+/* asks for the PIN with a dialog of its own, so that no window opens for an
+ * account before it's known which one it is.
+ */
+static bool account_login(struct piiptyyt_state *state)
+{
+	GtkBuilder *b = gtk_builder_new();
+	GError *err = NULL;
+	char *ui_ids[] = { "login_pin_dialog", NULL };
+	if(gtk_builder_add_objects_from_file(b, "piiptyyt.ui", ui_ids, &err) == 0) {
+		ERROR_FAIL(err);
 	}
 
-	/* FIXME: stick this in a global somewhere */
-	PtCache *uc = user_cache_open();
-	if(uc == NULL) {
-		fprintf(stderr, "can't open user cache!\n");
-		return EXIT_FAILURE;
+	char *username, *token, *secret;
+	uint64_t userid;
+	bool ok = oauth_login(b, &username, &token, &secret, &userid, &err);
+	gtk_widget_destroy(GTK_WIDGET(ui_object(b, "login_pin_dialog")));
+	g_object_unref(b);
+	if(!ok) {
+		printf("login failed: %s (code %d).\n", err->message, err->code);
+		g_error_free(err);
+		return false;
+	}
+
+	g_free(state->auth_token); state->auth_token = token;
+	g_free(state->auth_secret); state->auth_secret = secret;
+	oa_signer_free(state->signer); state->signer = NULL;
+	g_free(state->username); state->username = username;
+	state->userid = userid;
+	printf("got new oauth tokens.\n");
+	return true;
+}
+
+
+/* logs in the accounts without tokens, i.e. a first run's or the one that
+ * "--add-account" made. logging in as an account that's already known
+ * renews its tokens instead of adding it twice.
+ */
+static bool login_new_accounts(GPtrArray *states)
+{
+	for(guint i=0; i < states->len; i++) {
+		struct piiptyyt_state *st = g_ptr_array_index(states, i);
+		if(st->auth_token != NULL && st->auth_token[0] != '\0') continue;
+		if(!account_login(st)) return false;
+
+		for(guint j=0; j < states->len; j++) {
+			struct piiptyyt_state *known = g_ptr_array_index(states, j);
+			if(j == i || known->userid != st->userid) continue;
+			printf("%s is already known; keeping the new tokens.\n",
+				st->username);
+			struct piiptyyt_state tmp = *known;
+			*known = *st;
+			*st = tmp;
+			g_ptr_array_remove_index(states, i--);
+			break;
+		}
 	}
+	return true;
+}
+
 
-	GtkListStore *tweet_model = GTK_LIST_STORE(ui_object(b, "tweet_model"));
-	gtk_list_store_clear(tweet_model);
+/* ends the account's stream and polls. what's in flight still lands in its
+ * model, but nothing more is sent for it.
+ */
+static void stop_polling(struct account *acct)
+{
+	struct poller *poll = acct->poll;
+	if(poll == NULL || poll->stopped) return;
+	poll->stopped = true;
+	if(poll->stream != NULL) {
+		stream_free(poll->stream);
+		poll->stream = NULL;
+	}
+	if(poll->event_name != 0) {
+		g_source_remove(poll->event_name);
+		poll->event_name = 0;
+	}
+}
+
+
+/* the session lasts as long as some account's window is open. */
+static unsigned n_main_wnds = 0;
+
+static void on_main_wnd_destroy(GtkWidget *wnd, gpointer dataptr)
+{
+	stop_polling(dataptr);
+	if(--n_main_wnds == 0) gtk_main_quit();
+}
+
+
+/* gives the account a main window of its own, logging in first if it
+ * doesn't have a token yet. returns false if that failed.
+ */
+static void open_account(struct account *acct, struct update_store *updates)
+{
+	GtkBuilder *b = load_ui();
 	GtkTreeView *tweet_view = GTK_TREE_VIEW(ui_object(b, "tweet_view"));
-	SoupSession *ss = soup_session_async_new();
-	struct update_model *model = update_model_new(
-		tweet_view, tweet_model, ss);
+	acct->timeline = g_hash_table_new_full(&g_int64_hash, &g_int64_equal,
+		&g_free, NULL);
+	acct->model = update_model_new(tweet_view, updates, acct->reqs);
+	update_model_set_filter(acct->model, &on_account_timeline, acct);
+	update_model_set_limits(acct->model, config.max_rows, config.max_stored);
+	if(config.prefetch_rows > 0) {
+		update_model_set_prefetch_rows(acct->model, config.prefetch_rows);
+	}
 
 	g_object_set(ui_object(b, "view_userpic_renderer"),
 		"yalign", 0.0f,
@@ -324,9 +1133,7 @@ int main(int argc, char *argv[])
 
 #if 1
 	/* the semi-sucky brute force solution. see below for related whining.
-	 *
-	 * TODO: make this per-window once multiaccount support and the like kick
-	 * in. it's really one-per-tweetview.
+	 * it's really one-per-tweetview.
 	 */
 	struct tv_size_alloc_ctx *tvsa = g_malloc0(sizeof(*tvsa));
 	tvsa->status_cellr = status_cr;
@@ -335,6 +1142,7 @@ int main(int argc, char *argv[])
 	g_object_connect(tweet_view,
 		"signal::size-allocate", &on_tv_size_allocate, tvsa,
 		NULL);
+	acct->tvsa = tvsa;
 #else
 	/* wrap-width, together with the width of the userpic column, establishes
 	 * the minimum size of the window.
@@ -355,47 +1163,181 @@ int main(int argc, char *argv[])
 	g_signal_connect(main_wnd, "delete-event",
 		G_CALLBACK(&main_wnd_delete), NULL);
 	g_signal_connect(main_wnd, "destroy",
-		G_CALLBACK(&gtk_main_quit), NULL);
+		G_CALLBACK(&on_main_wnd_destroy), acct);
+	n_main_wnds++;
 	gtk_widget_show(GTK_WIDGET(main_wnd));
 
-	if(state->auth_token == NULL || state->auth_token[0] == '\0') {
-		char *username, *token, *secret;
-		uint64_t userid;
-		GError *err = NULL;
-		if(oauth_login(b, &username, &token, &secret, &userid, &err)) {
-			g_free(state->auth_token); state->auth_token = token;
-			g_free(state->auth_secret); state->auth_secret = secret;
-			g_free(state->username); state->username = username;
-			state->userid = userid;
-			printf("got new oauth tokens.\n");
-			state_write(state, NULL);
-			printf("tokens saved.\n");
-		} else {
-			printf("login failed: %s (code %d).\n", err->message, err->code);
-			g_error_free(err);
-			/* FIXME: have a retry policy. */
+	char *title = g_strdup_printf("piiptyyt: %s", acct->state->username);
+	gtk_window_set_title(GTK_WINDOW(main_wnd), title);
+	g_free(title);
+	update_model_set_fetch_older_fn(acct->model, &fetch_older_updates, acct);
+	g_signal_connect(tweet_view, "row-activated",
+		G_CALLBACK(&on_tv_row_activated), acct);
+
+	g_object_unref(b);
+}
+
+
+static void start_polling(struct account *acct, SoupSession *ss)
+{
+	struct poller *poll = g_new0(struct poller, 1);
+	poll->acct = acct;
+	poll->rate = -1;
+	poll->covered = id_ranges_new();
+	poll->backfills = g_array_new(FALSE, FALSE, sizeof(struct id_range));
+	acct->poll = poll;
+	poll_now(poll);
+	poll->stream = stream_new(ss, &make_stream_msg, &on_stream_lines, poll);
+}
+
+
+/* called after the request scheduler is gone, so that nothing's in flight
+ * for the poller.
+ */
+static void close_account(struct account *acct)
+{
+	struct poller *poll = acct->poll;
+	if(poll != NULL) {
+		if(poll->event_name != 0) {
+			gboolean ok = g_source_remove(poll->event_name);
+			if(!ok) g_debug("poll timeout %u not found", poll->event_name);
+		}
+		id_ranges_free(poll->covered);
+		g_array_free(poll->backfills, TRUE);
+		g_free(poll);
+	}
+	update_model_free(acct->model);
+	g_hash_table_destroy(acct->timeline);
+	g_free(acct->tvsa);
+	g_free(acct);
+}
+
+
+/* "--add-account" logs another account in next to those already known.
+ * each account polls on its own schedule and with its own rate limits, and
+ * all of them share one user cache, one update store and one connection
+ * pool.
+ */
+int main(int argc, char *argv[])
+{
+	g_thread_init(NULL);
+	gtk_init(&argc, &argv);
+
+	if(!gcry_check_version(GCRYPT_VERSION)) {
+		fprintf(stderr, "libgcrypt version mismatch!\n");
+		return EXIT_FAILURE;
+	}
+	gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
+
+	bool add_account = false, trim_users = false;
+	for(int i=1; i < argc; i++) {
+		if(strcmp(argv[i], "--add-account") == 0) add_account = true;
+		else if(strcmp(argv[i], "--trim-users") == 0) trim_users = true;
+		else {
+			fprintf(stderr, "unknown argument `%s'\n", argv[i]);
 			return EXIT_FAILURE;
 		}
 	}
 
-	g_object_unref(b);
-	b = NULL;
+	/* FIXME: error checks */
+	GPtrArray *states = state_read_accounts(NULL);
+	if(states == NULL) {
+		states = g_ptr_array_new_with_free_func(
+			(GDestroyNotify)&state_free);
+	}
+	if(states->len == 0 || add_account) {
+		g_ptr_array_add(states, state_empty());
+	}
 
-	fetch_more_updates(state, uc, model, 20, 0);
+	if(!read_config()) {
+		fprintf(stderr, "config read error!\n");
+		return EXIT_FAILURE;
+	}
+
+	if(!login_new_accounts(states)) {
+		/* FIXME: have a retry policy. */
+		return EXIT_FAILURE;
+	}
 
-	struct update_interval_ctx *uictx = g_new(struct update_interval_ctx, 1);
-	uictx->event_name = g_timeout_add(UPDATE_INTERVAL_MSEC,
-		&on_update_interval, uictx);
+	/* FIXME: stick this in a global somewhere */
+	PtCache *uc = user_cache_open();
+	if(uc == NULL) {
+		fprintf(stderr, "can't open user cache!\n");
+		return EXIT_FAILURE;
+	}
+
+	/* API calls of all three request classes go to the one host. JSON
+	 * compresses well, so everything is asked for gzipped.
+	 */
+	SoupSession *ss = soup_session_async_new_with_options(
+		SOUP_SESSION_MAX_CONNS_PER_HOST, 5,
+		SOUP_SESSION_ADD_FEATURE_BY_TYPE, SOUP_TYPE_CONTENT_DECODER,
+		NULL);
+	struct update_store *updates = update_store_new(uc);
+	struct mute_filter *mutes = mute_filter_new();
+	static const struct mute_rules no_rules;
+	apply_mute_rules(mutes, &no_rules, &config.mutes);
+	/* there's nothing in the store to refilter yet. */
+	mute_filter_take_changes(mutes);
+	struct mute_watch mute_watch = { .updates = updates, .mutes = mutes };
+	char *cfg_path = config_path();
+	GFile *cfg_file = g_file_new_for_path(cfg_path);
+	GFileMonitor *cfg_mon = g_file_monitor_file(cfg_file,
+		G_FILE_MONITOR_NONE, NULL, NULL);
+	if(cfg_mon != NULL) {
+		g_signal_connect(cfg_mon, "changed",
+			G_CALLBACK(&on_config_changed), &mute_watch);
+	}
+	g_object_unref(cfg_file);
+	g_free(cfg_path);
+	struct request_sched *reqs = request_sched_new(ss);
+
+	GPtrArray *accounts = g_ptr_array_new();
+	for(guint i=0; i < states->len; i++) {
+		struct account *acct = g_new0(struct account, 1);
+		acct->state = g_ptr_array_index(states, i);
+		acct->user_cache = uc;
+		acct->mutes = mutes;
+		acct->reqs = reqs;
+		acct->trim_users = trim_users;
+		g_ptr_array_add(accounts, acct);
+		open_account(acct, updates);
+	}
+	state_write_accounts(states, NULL);
+
+	/* conversations and bare users are looked up with the credentials of
+	 * the account whose window wants them.
+	 */
+	conversations_init(updates, reqs, &fetch_updates_by_id);
+	for(guint i=0; i < accounts->len; i++) {
+		struct account *acct = g_ptr_array_index(accounts, i);
+		acct->users = user_lookup_new(reqs, &make_user_lookup_msg,
+			&on_users_looked_up, acct);
+		update_model_set_user_lookup(acct->model, acct->users);
+		start_polling(acct, ss);
+	}
 
 	gtk_main();
 
-	gboolean ok = g_source_remove(uictx->event_name);
-	if(!ok) g_debug("ui refresh timeout %u not found", uictx->event_name);
+	for(guint i=0; i < accounts->len; i++) {
+		struct account *acct = g_ptr_array_index(accounts, i);
+		stop_polling(acct);
+		user_lookup_free(acct->users);
+	}
+	request_sched_free(reqs);
 
 	/* TODO: check errors etc */
-	state_write(state, NULL);
-	state_free(state);
-	update_model_free(model);
+	state_write_accounts(states, NULL);
+	conversations_shutdown();
+	for(guint i=0; i < accounts->len; i++) {
+		close_account(g_ptr_array_index(accounts, i));
+	}
+	g_ptr_array_free(accounts, TRUE);
+	g_ptr_array_free(states, TRUE);
+	if(cfg_mon != NULL) g_object_unref(cfg_mon);
+	update_store_free(updates);
+	mute_filter_free(mutes);
+	free_mute_rules(&config.mutes);
 	user_cache_close(uc);
 	g_object_unref(ss);
 
@@ -12,61 +12,483 @@
 #include "defs.h"
 #include "pt-update.h"
 #include "pt-user-info.h"
+#include "pt-timeline-model.h"
 
 
-#define id_in_model(m, id) (find_id_in_model((m), (id)) != NULL)
+/* unless the config says otherwise; see update_model_set_limits(). */
+#define DEFAULT_MAX_ROWS 500
+#define DEFAULT_MAX_STORED 5000
 
+/* rows brought back from the store per page-back */
+#define PAGE_ROWS 50
 
-static int uint64_desc_cmp(const void *ap, const void *bp)
+/* queued rows are inserted on frame clock ticks, INSERT_CHUNK at a time
+ * until FRAME_BUDGET_USEC is spent. that leaves most of a 60 Hz frame for
+ * layout and drawing. a queue of DETACH_ROWS or more goes in all at once
+ * with the model detached from the view.
+ */
+#define FRAME_BUDGET_USEC 4000
+#define INSERT_CHUNK 16
+#define DETACH_ROWS 1000
+
+/* rows prepared above and below the visible ones, unless the config says
+ * otherwise.
+ */
+#define DEFAULT_PREFETCH_ROWS 25
+
+
+/* views that are currently alive, for sharing updates between them. */
+static GList *live_models = NULL;
+
+
+static int sort_updates_by_id_desc(const void *ap, const void *bp)
 {
-	const uint64_t *a = ap, *b = bp;
-	if(*a > *b) return -1;
-	else if(*a < *b) return 1;
+	struct update *a = *(struct update *const *)ap,
+		*b = *(struct update *const *)bp;
+	if(a->id > b->id) return -1;
+	else if(a->id < b->id) return 1;
 	else return 0;
 }
 
 
-/* TODO: write this out by hand. it's used often enough. */
-static uint64_t *find_id_in_model(struct update_model *model, uint64_t id)
+/* the rows that show one user's userpic. these are kept as status ids rather
+ * than positions, which move on insert.
+ */
+struct user_rows
 {
-	return bsearch(&id, model->current_ids, model->count,
-		sizeof(*model->current_ids), &uint64_desc_cmp);
+	uint64_t user_id;
+	GArray *status_ids;			/* of uint64_t */
+	struct update_model *model;	/* not a ref */
+	PtUserInfo *watched;		/* ref, or NULL */
+	gulong notify_id;
+};
+
+
+static void user_rows_free(gpointer dataptr)
+{
+	struct user_rows *ur = dataptr;
+	if(ur->watched != NULL) {
+		g_signal_handler_disconnect(ur->watched, ur->notify_id);
+		g_object_unref(ur->watched);
+	}
+	g_array_free(ur->status_ids, TRUE);
+	g_slice_free(struct user_rows, ur);
 }
 
 
-static size_t add_to_current_ids(
-	uint64_t **dst_p,
-	struct update_model *model,
-	PtUpdate **src,
+static void index_row(struct update_model *m, uint64_t status_id)
+{
+	uint64_t uid = update_store_get_author(m->updates, status_id);
+	if(uid == 0) return;
+
+	struct user_rows *ur = g_hash_table_lookup(m->user_rows, &uid);
+	if(ur == NULL) {
+		ur = g_slice_new(struct user_rows);
+		ur->user_id = uid;
+		ur->status_ids = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+		ur->model = m;
+		ur->watched = NULL;
+		ur->notify_id = 0;
+		g_hash_table_insert(m->user_rows, &ur->user_id, ur);
+	}
+	g_array_append_val(ur->status_ids, status_id);
+}
+
+
+static void unindex_row(struct update_model *m, uint64_t status_id)
+{
+	uint64_t uid = update_store_get_author(m->updates, status_id);
+	struct user_rows *ur = g_hash_table_lookup(m->user_rows, &uid);
+	if(ur == NULL) return;
+
+	for(guint i=0; i < ur->status_ids->len; i++) {
+		if(g_array_index(ur->status_ids, uint64_t, i) == status_id) {
+			g_array_remove_index_fast(ur->status_ids, i);
+			break;
+		}
+	}
+	if(ur->status_ids->len == 0) g_hash_table_remove(m->user_rows, &uid);
+}
+
+
+/* inserts rows for ids that've been pinned in the store, and indexes them
+ * by author. the pin stays with each new row; duplicates give theirs back.
+ */
+static void insert_rows(struct update_model *m, const uint64_t *ids, size_t n)
+{
+	for(size_t i=0; i < n; i++) {
+		if((i == 0 || ids[i - 1] != ids[i])
+			&& pt_timeline_model_find(m->store, ids[i]) < 0)
+		{
+			index_row(m, ids[i]);
+		} else {
+			update_store_unpin(m->updates, ids[i]);
+		}
+	}
+	pt_timeline_model_insert(m->store, ids, n);
+}
+
+
+/* muted updates stay out of every view. */
+static inline bool accept_update(struct update_model *m, uint64_t id)
+{
+	if(update_store_is_muted(m->updates, id)) return false;
+	return m->filter_fn == NULL || (*m->filter_fn)(m->updates, id,
+		m->filter_data);
+}
+
+
+static void on_userpic_notify(GObject *obj, GParamSpec *pspec, gpointer dataptr)
+{
+	struct user_rows *ur = dataptr;
+	for(guint i=0; i < ur->status_ids->len; i++) {
+		int pos = pt_timeline_model_find(ur->model->store,
+			g_array_index(ur->status_ids, uint64_t, i));
+		if(pos >= 0) pt_timeline_model_row_changed(ur->model->store, pos);
+	}
+}
+
+
+/* have the rows showing `ui' repainted once its userpic arrives. facades may
+ * hold different instances for the same user over time, so this follows the
+ * one that was last asked.
+ */
+static void watch_userpic(struct update_model *m, PtUserInfo *ui)
+{
+	struct user_rows *ur = g_hash_table_lookup(m->user_rows, &ui->id);
+	if(ur == NULL || ur->watched == ui) return;
+
+	if(ur->watched != NULL) {
+		g_signal_handler_disconnect(ur->watched, ur->notify_id);
+		g_object_unref(ur->watched);
+	}
+	ur->watched = g_object_ref(ui);
+	ur->notify_id = g_signal_connect(ui, "notify::userpic",
+		G_CALLBACK(&on_userpic_notify), ur);
+}
+
+
+static inline bool in_window(struct update_model *m, uint64_t id) {
+	return id != 0 && id <= m->window_hi && id >= m->window_lo;
+}
+
+
+/* one batch of markup being formatted for a model. `m' is cleared when the
+ * model goes away first.
+ */
+struct markup_req
+{
+	struct update_model *m;
+};
+
+
+/* fills the rows in as their markup arrives. */
+static void on_markup_rendered(
+	PtUpdate **updates,
 	size_t count,
-	bool do_sort)
+	void *dataptr)
 {
-	size_t out_count = model->count + count;
-	uint64_t *dst = g_new(uint64_t, out_count);
-	/* j-j-jam it in */
-	for(size_t i=0; i < count; i++) dst[i] = src[(count - 1) - i]->id;
-	for(size_t i=0; i < model->count; i++) {
-		dst[count + i] = model->current_ids[i];
+	struct markup_req *req = dataptr;
+	struct update_model *m = req->m;
+	if(m != NULL) {
+		m->markup_reqs = g_list_remove(m->markup_reqs, req);
+		for(size_t i=0; i < count; i++) {
+			g_hash_table_remove(m->rendering, &updates[i]->id);
+			int pos = pt_timeline_model_find(m->store, updates[i]->id);
+			if(pos >= 0 && in_window(m, updates[i]->id)) {
+				pt_timeline_model_row_changed(m->store, pos);
+			}
+		}
 	}
-	if(do_sort) qsort(dst, out_count, sizeof(uint64_t), &uint64_desc_cmp);
+	g_free(req);
+}
+
+
+/* has markup formatted off the main thread for those of `updates' that
+ * lack it and aren't being formatted already.
+ */
+static void render_markup(
+	struct update_model *m,
+	PtUpdate **updates,
+	size_t count)
+{
+	GPtrArray *todo = g_ptr_array_sized_new(count);
+	for(size_t i=0; i < count; i++) {
+		PtUpdate *u = updates[i];
+		if(u->markup_cache != NULL || u->timestamp == NULL
+			|| g_hash_table_lookup(m->rendering, &u->id) != NULL)
+		{
+			continue;
+		}
+		uint64_t *key = g_memdup(&u->id, sizeof(u->id));
+		g_hash_table_insert(m->rendering, key, key);
+		g_ptr_array_add(todo, u);
+	}
+
+	if(todo->len > 0) {
+		struct markup_req *req = g_new(struct markup_req, 1);
+		req->m = m;
+		m->markup_reqs = g_list_prepend(m->markup_reqs, req);
+		size_t n = pt_update_prerender_markup((PtUpdate **)todo->pdata,
+			todo->len, &on_markup_rendered, req);
+		assert(n == todo->len);
+	}
+	g_ptr_array_free(todo, TRUE);
+}
+
+
+/* moves the window of prepared rows to cover what's visible, plus
+ * prefetch_rows either way. rows that come in get their userpics asked
+ * for, and those that lack markup have it formatted off the main thread.
+ * each is re-measured once its markup is there; until then it's laid out
+ * as a placeholder. rows that leave keep whatever
+ * height they had, and their facades fall out of the store's cache in due
+ * course.
+ */
+static void update_viewport(struct update_model *m)
+{
+	size_t rows = pt_timeline_model_get_count(m->store);
+	if(rows == 0) {
+		m->window_hi = m->window_lo = 0;
+		return;
+	}
+
+	size_t first = 0, last = 0;
+	GtkTreePath *start, *end;
+	if(gtk_tree_view_get_visible_range(m->view, &start, &end)) {
+		first = gtk_tree_path_get_indices(start)[0];
+		last = gtk_tree_path_get_indices(end)[0];
+		gtk_tree_path_free(start);
+		gtk_tree_path_free(end);
+	}
+	size_t vis_first = first, vis_last = last;
+	first = first > m->prefetch_rows ? first - m->prefetch_rows : 0;
+	last = MIN(rows - 1, last + m->prefetch_rows);
+
+	uint64_t old_hi = m->window_hi, old_lo = m->window_lo;
+	m->window_hi = pt_timeline_model_get_id(m->store, first);
+	m->window_lo = pt_timeline_model_get_id(m->store, last);
+	if(m->window_hi == old_hi && m->window_lo == old_lo) return;
+
+	GPtrArray *fresh = g_ptr_array_new_with_free_func(&g_object_unref);
+	GArray *positions = g_array_new(FALSE, FALSE, sizeof(int));
+	for(size_t i = first; i <= last; i++) {
+		uint64_t id = pt_timeline_model_get_id(m->store, i);
+		if(id <= old_hi && id >= old_lo) continue;
+		PtUpdate *u = update_store_get(m->updates, id);
+		if(u == NULL) continue;
+		g_ptr_array_add(fresh, u);
+		int pos = i;
+		g_array_append_val(positions, pos);
+	}
+
+	render_markup(m, (PtUpdate **)fresh->pdata, fresh->len);
+	for(guint i=0; i < fresh->len; i++) {
+		PtUpdate *u = g_ptr_array_index(fresh, i);
+		if((u->user == NULL || u->user->screenname == NULL)
+			&& m->users != NULL)
+		{
+			user_lookup_want(m->users,
+				update_store_get_author(m->updates, u->id));
+		}
+		if(u->user != NULL && u->user->screenname != NULL) {
+			int pos = g_array_index(positions, int, i);
+			GdkPixbuf *pic = pt_user_info_get_userpic(u->user, m->reqs,
+				pos >= vis_first && pos <= vis_last
+					? REQ_USERPIC : REQ_USERPIC_PREFETCH);
+			if(pic != NULL) g_object_unref(pic);
+			else watch_userpic(m, u->user);
+		}
+		if(u->markup_cache != NULL) {
+			pt_timeline_model_row_changed(m->store,
+				g_array_index(positions, int, i));
+		}
+	}
+
+	g_array_free(positions, TRUE);
+	g_ptr_array_free(fresh, TRUE);
+}
+
+
+static gboolean on_viewport_idle(gpointer dataptr)
+{
+	struct update_model *m = dataptr;
+	m->viewport_idle_id = 0;
+	update_viewport(m);
+	return FALSE;
+}
+
+
+/* coalesces the viewport updates of a frame, and runs them before the
+ * redraw.
+ */
+static void queue_viewport_update(struct update_model *m)
+{
+	if(m->viewport_idle_id != 0) return;
+	m->viewport_idle_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
+		&on_viewport_idle, m, NULL);
+}
+
+
+static bool view_at_top(struct update_model *m)
+{
+	if(m->vadj == NULL) return true;
+	return gtk_adjustment_get_value(m->vadj)
+		<= gtk_adjustment_get_lower(m->vadj)
+			+ gtk_adjustment_get_page_size(m->vadj) / 2;
+}
+
+
+/* trims the view and the store down to their limits. there's some slack
+ * over max_rows and max_stored so that this doesn't happen on every batch.
+ */
+static void enforce_limits(struct update_model *m)
+{
+	size_t rows = pt_timeline_model_get_count(m->store);
+	if(rows > m->max_rows + m->max_rows / 8 && view_at_top(m)) {
+		for(size_t i = m->max_rows; i < rows; i++) {
+			uint64_t id = pt_timeline_model_get_id(m->store, i);
+			unindex_row(m, id);
+			update_store_unpin(m->updates, id);
+		}
+		pt_timeline_model_truncate(m->store, m->max_rows);
+	}
+
+	/* rows of this and other views are pinned, and stay. */
+	size_t stored = update_store_count(m->updates);
+	if(stored > m->max_stored + m->max_stored / 8) {
+		size_t n = update_store_trim(m->updates, m->max_stored);
+		g_debug("%s: dropped %zu stored updates", __func__, n);
+	}
+}
+
+
+static void page_back(struct update_model *m)
+{
+	size_t rows = pt_timeline_model_get_count(m->store);
+	if(rows == 0 || m->paging_back) return;
+	m->paging_back = true;
+
+	/* look through the store for older updates that pass the filter. */
+	uint64_t oldest = pt_timeline_model_get_id(m->store, rows - 1),
+		below = oldest;
+	GArray *ids = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	size_t got, kept = 0;
+	do {
+		g_array_set_size(ids, 0);
+		got = update_store_older(m->updates, below, PAGE_ROWS, ids);
+		kept = 0;
+		for(size_t i=0; i < got; i++) {
+			uint64_t id = g_array_index(ids, uint64_t, i);
+			if(!accept_update(m, id)) continue;
+			update_store_pin(m->updates, id);
+			g_array_index(ids, uint64_t, kept++) = id;
+		}
+		if(got > 0) below = g_array_index(ids, uint64_t, got - 1);
+	} while(kept == 0 && got == PAGE_ROWS);
+
+	if(kept > 0) {
+		insert_rows(m, (const uint64_t *)ids->data, kept);
+	} else if(m->fetch_older_fn != NULL && m->fetching_below == 0
+		&& m->fetch_exhausted_id != oldest)
+	{
+		m->fetching_below = oldest;
+		(*m->fetch_older_fn)(m, oldest, m->fetch_older_data);
+	}
+	g_array_free(ids, TRUE);
+
+	m->paging_back = false;
+}
+
+
+static void on_vadj_value_changed(GtkAdjustment *adj, gpointer dataptr)
+{
+	struct update_model *m = dataptr;
+	double value = gtk_adjustment_get_value(adj),
+		page = gtk_adjustment_get_page_size(adj),
+		upper = gtk_adjustment_get_upper(adj);
+	if(value + page >= upper - page / 2) page_back(m);
+	else if(view_at_top(m)) enforce_limits(m);
+	queue_viewport_update(m);
+}
+
+
+/* the page size changed, or rows came or went. */
+static void on_vadj_changed(GtkAdjustment *adj, gpointer dataptr) {
+	queue_viewport_update(dataptr);
+}
+
+
+static int cmp_id_desc(const void *ap, const void *bp)
+{
+	uint64_t a = *(const uint64_t *)ap, b = *(const uint64_t *)bp;
+	return a > b ? -1 : (a < b ? 1 : 0);
+}
+
+
+/* inserts the whole queue with the view looking elsewhere, so that it
+ * rebuilds once instead of handling every row-inserted.
+ */
+static void insert_detached(struct update_model *m)
+{
+	double pos = m->vadj != NULL ? gtk_adjustment_get_value(m->vadj) : 0;
+	gtk_tree_view_set_model(m->view, NULL);
+	insert_rows(m, (const uint64_t *)m->pending->data, m->pending->len);
+	g_array_set_size(m->pending, 0);
+	gtk_tree_view_set_model(m->view, GTK_TREE_MODEL(m->store));
+	if(m->vadj != NULL) gtk_adjustment_set_value(m->vadj, pos);
+}
+
+
+static gboolean on_insert_tick(
+	GtkWidget *widget,
+	GdkFrameClock *clock,
+	gpointer dataptr)
+{
+	struct update_model *m = dataptr;
+
+	if(m->pending->len >= DETACH_ROWS) insert_detached(m);
+	else {
+		gint64 start = g_get_monotonic_time();
+		size_t done = 0;
+		do {
+			size_t n = MIN(INSERT_CHUNK, m->pending->len - done);
+			insert_rows(m, &g_array_index(m->pending, uint64_t, done), n);
+			done += n;
+		} while(done < m->pending->len
+			&& g_get_monotonic_time() - start < FRAME_BUDGET_USEC);
+		g_array_remove_range(m->pending, 0, done);
+	}
+	queue_viewport_update(m);
+
+	if(m->pending->len > 0) return TRUE;
 	else {
-#ifndef NDEBUG
-		for(size_t i=1; i < out_count; i++) assert(dst[i-1] >= dst[i]);
-#endif
+		m->insert_tick_id = 0;
+		enforce_limits(m);
+		return FALSE;
 	}
-	g_free(*dst_p);
-	*dst_p = dst;
-	return out_count;
 }
 
 
-static int sort_updates_by_id(const void *ap, const void *bp)
+/* queues ids that pass the model's filter. they're pinned while they
+ * wait.
+ */
+static void offer_ids(struct update_model *m, const uint64_t *ids, size_t n)
 {
-	struct update *a = *(struct update *const *)ap,
-		*b = *(struct update *const *)bp;
-	if(a->id > b->id) return 1;
-	else if(a->id < b->id) return -1;
-	else return 0;
+	size_t queued = m->pending->len;
+	for(size_t i=0; i < n; i++) {
+		if(!accept_update(m, ids[i])) continue;
+		update_store_pin(m->updates, ids[i]);
+		g_array_append_val(m->pending, ids[i]);
+	}
+	if(m->pending->len == queued) return;
+
+	/* the queue is consumed newest first. */
+	g_array_sort(m->pending, &cmp_id_desc);
+	if(m->insert_tick_id == 0) {
+		m->insert_tick_id = gtk_widget_add_tick_callback(
+			GTK_WIDGET(m->view), &on_insert_tick, m, NULL);
+	}
 }
 
 
@@ -77,71 +499,115 @@ void add_updates_to_model(
 {
 	if(num_updates == 0) return;
 
-	qsort(updates, num_updates, sizeof(struct update *), &sort_updates_by_id);
+	qsort(updates, num_updates, sizeof(struct update *),
+		&sort_updates_by_id_desc);
 
-	/* determine insert positions for these updates. */
-	int row_pos[num_updates];
-	struct update *dedup[num_updates];
-	size_t row_count = 0;
-
-	/* ignore updates whose IDs already exist in the model. */
+	uint64_t ids[num_updates];
 	for(size_t i=0; i < num_updates; i++) {
-		if(model->count == 0 || !id_in_model(model, updates[i]->id)) {
-			dedup[row_count++] = updates[i];
-		}
+		update_store_add(model->updates, updates[i]);
+		ids[i] = updates[i]->id;
 	}
 
-	if(model->count == 0 || updates[0]->id > model->current_ids[0]) {
-		/* optimized majority case. prepend all elements. */
-		for(size_t i=0; i < num_updates; i++) row_pos[i] = 0;
-		model->count = add_to_current_ids(&model->current_ids, model,
-			updates, num_updates, false);
-	} else {
-		/* the complex (interleaving) case. */
-		const int p = row_count;
-
-		/* recompute current_ids */
-		uint64_t old_head = model->current_ids[0];
-		model->count = add_to_current_ids(&model->current_ids, model,
-			dedup, p, true);
-
-		/* from largest to smallest, record new positions of each. */
-		int k = 0;
-		while(k < p && dedup[k]->id > old_head) {
-			row_pos[k] = k;
-			k++;
+	/* every view on the same store gets a look. */
+	for(GList *cur = g_list_first(live_models);
+		cur != NULL;
+		cur = g_list_next(cur))
+	{
+		struct update_model *m = cur->data;
+		if(m->updates == model->updates) offer_ids(m, ids, num_updates);
+	}
+}
+
+
+void update_model_add_ids(
+	struct update_model *model,
+	const uint64_t *ids,
+	size_t num_ids)
+{
+	if(num_ids == 0) return;
+	uint64_t sorted[num_ids];
+	memcpy(sorted, ids, sizeof(uint64_t) * num_ids);
+	qsort(sorted, num_ids, sizeof(uint64_t), &cmp_id_desc);
+	offer_ids(model, sorted, num_ids);
+}
+
+
+/* takes newly muted updates out of a view, and offers newly unmuted ones
+ * that fall within what it has loaded.
+ */
+static void apply_mutes(
+	struct update_model *m,
+	const GArray *muted,
+	const GArray *unmuted)
+{
+	for(guint i=0; i < muted->len; i++) {
+		uint64_t id = g_array_index(muted, uint64_t, i);
+		if(pt_timeline_model_remove(m->store, id)) {
+			unindex_row(m, id);
+			update_store_unpin(m->updates, id);
 		}
-		while(k < p) {
-			uint64_t *in_current = find_id_in_model(model, dedup[k]->id);
-			assert(in_current != NULL);
-			row_pos[k++] = in_current - model->current_ids;
+	}
+	for(guint i=0; i < m->pending->len; ) {
+		uint64_t id = g_array_index(m->pending, uint64_t, i);
+		if(!update_store_is_muted(m->updates, id)) i++;
+		else {
+			update_store_unpin(m->updates, id);
+			g_array_remove_index(m->pending, i);
 		}
 	}
 
-	for(size_t i=0; i < row_count; i++) {
-		gtk_list_store_insert_with_values(model->store, NULL, row_pos[i],
-			0, g_object_ref(dedup[i]),
-			-1);
+	size_t rows = pt_timeline_model_get_count(m->store);
+	uint64_t oldest = rows == 0 ? 0
+		: pt_timeline_model_get_id(m->store, rows - 1);
+	GArray *offer = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	for(guint i=0; i < unmuted->len; i++) {
+		uint64_t id = g_array_index(unmuted, uint64_t, i);
+		if(id > oldest) g_array_append_val(offer, id);
+	}
+	g_array_sort(offer, &cmp_id_desc);
+	offer_ids(m, (const uint64_t *)offer->data, offer->len);
+	g_array_free(offer, TRUE);
+}
+
+
+void update_models_apply_mutes(
+	struct update_store *updates,
+	struct mute_filter *filter)
+{
+	unsigned changes = mute_filter_take_changes(filter);
+	if(changes == 0) return;
+
+	GArray *muted = g_array_new(FALSE, FALSE, sizeof(uint64_t)),
+		*unmuted = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	update_store_refilter(updates, filter, changes, muted, unmuted);
+	if(muted->len > 0 || unmuted->len > 0) {
+		for(GList *cur = g_list_first(live_models);
+			cur != NULL;
+			cur = g_list_next(cur))
+		{
+			struct update_model *m = cur->data;
+			if(m->updates == updates) apply_mutes(m, muted, unmuted);
+		}
 	}
+	g_array_free(muted, TRUE);
+	g_array_free(unmuted, TRUE);
 }
 
 
-/* returns a borrowed reference. */
-static GObject *get_object_from_model(
+/* returns a new reference to the update facade for the row, or NULL. */
+static PtUpdate *get_update_from_model(
 	GtkTreeModel *model,
-	GtkTreeIter *iter,
-	int col_ix)
+	GtkTreeIter *iter)
 {
-	GObject *ret;
 	GValue val = { 0 };
 	gtk_tree_model_get_value(model, iter, 0, &val);
-	if(!G_VALUE_HOLDS(&val, G_TYPE_OBJECT)) {
+	if(!G_VALUE_HOLDS(&val, PT_UPDATE_TYPE)) {
 		g_warning("%s: called for type `%s', not `%s'",
-			__func__, G_VALUE_TYPE_NAME(&val), g_type_name(G_TYPE_OBJECT));
-		ret = NULL;
-	} else {
-		ret = g_value_get_object(&val);
+			__func__, G_VALUE_TYPE_NAME(&val), g_type_name(PT_UPDATE_TYPE));
+		g_value_unset(&val);
+		return NULL;
 	}
+	PtUpdate *ret = g_value_dup_object(&val);
 	g_value_unset(&val);
 	return ret;
 }
@@ -154,15 +620,34 @@ static void set_markup_column_from_pt_update(
 	GtkTreeIter *iter,
 	gpointer dataptr)
 {
-//	struct update_model *m = dataptr;
+	struct update_model *m = dataptr;
 
-	PtUpdate *update = PT_UPDATE(get_object_from_model(model, iter, 0));
+	/* rows away from the viewport are measured as if empty, which is one
+	 * userpic high, without touching anything but the id.
+	 */
+	if(!in_window(m, pt_timeline_model_get_iter_id(m->store, iter))) {
+		g_object_set(cell, "markup", NULL, NULL);
+		return;
+	}
+
+	PtUpdate *update = get_update_from_model(model, iter);
 	g_return_if_fail(update != NULL);
 
+	/* a facade that was made over since the window last moved. it's
+	 * filled in when its markup arrives.
+	 */
+	if(update->markup_cache == NULL && update->timestamp != NULL) {
+		render_markup(m, &update, 1);
+		g_object_set(cell, "markup", NULL, NULL);
+		g_object_unref(update);
+		return;
+	}
+
 	char *markup = NULL;
 	g_object_get(update, "markup", &markup, NULL);
 	g_object_set(cell, "markup", markup, NULL);
 	g_free(markup);
+	g_object_unref(update);
 }
 
 
@@ -175,23 +660,30 @@ static void set_display_pic_column_from_pt_update(
 {
 	struct update_model *m = dataptr;
 
-	PtUpdate *update = PT_UPDATE(get_object_from_model(model, iter, 0));
+	if(!in_window(m, pt_timeline_model_get_iter_id(m->store, iter))) {
+		g_object_set(cell, "pixbuf", m->default_userpic, NULL);
+		return;
+	}
+
+	PtUpdate *update = get_update_from_model(model, iter);
 	g_return_if_fail(update != NULL);
 
 	GdkPixbuf *upd_pic = NULL;
 	if(update->user != NULL && update->user->screenname != NULL) {
-		/* FIXME: differentiate between forwarder and originator */
-		upd_pic = pt_user_info_get_userpic(update->user, m->http_session);
-		if(upd_pic == NULL) {
-			/* FIXME: connect to notify::userpic on `update', recheck the
-			 * property
-			 */
-		}
+		/* FIXME: differentiate between forwarder and originator.
+		 *
+		 * the row is being drawn, so it's on screen. this promotes a
+		 * prefetch of its userpic that's still waiting.
+		 */
+		upd_pic = pt_user_info_get_userpic(update->user, m->reqs,
+			REQ_USERPIC);
+		if(upd_pic == NULL) watch_userpic(m, update->user);
 	}
 	if(upd_pic == NULL) upd_pic = g_object_ref(m->default_userpic);
 
 	g_object_set(cell, "pixbuf", upd_pic, NULL);
 	g_object_unref(upd_pic);
+	g_object_unref(update);
 }
 
 
@@ -214,15 +706,44 @@ static GtkCellRenderer *set_col_func(
 
 struct update_model *update_model_new(
 	GtkTreeView *view,
-	GtkListStore *store,
-	SoupSession *session)
+	struct update_store *updates,
+	struct request_sched *reqs)
 {
 	struct update_model *m = g_new(struct update_model, 1);
-	m->count = 0;
-	m->current_ids = NULL;
-	m->store = g_object_ref(store);
+	m->updates = updates;
+	m->store = pt_timeline_model_new(updates);
 	m->view = g_object_ref(view);
-	m->http_session = g_object_ref(session);
+	gtk_tree_view_set_model(view, GTK_TREE_MODEL(m->store));
+	m->reqs = reqs;
+
+	m->max_rows = DEFAULT_MAX_ROWS;
+	m->max_stored = DEFAULT_MAX_STORED;
+	m->filter_fn = NULL;
+	m->filter_data = NULL;
+	m->pending = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	m->insert_tick_id = 0;
+	m->user_rows = g_hash_table_new_full(&g_int64_hash, &g_int64_equal,
+		NULL, &user_rows_free);
+	m->paging_back = false;
+	m->fetch_exhausted_id = 0;
+	m->fetching_below = 0;
+	m->fetch_older_fn = NULL;
+	m->fetch_older_data = NULL;
+	m->users = NULL;
+	m->prefetch_rows = DEFAULT_PREFETCH_ROWS;
+	m->window_hi = m->window_lo = 0;
+	m->viewport_idle_id = 0;
+	m->rendering = g_hash_table_new_full(&g_int64_hash, &g_int64_equal,
+		&g_free, NULL);
+	m->markup_reqs = NULL;
+	m->vadj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(view));
+	if(m->vadj != NULL) {
+		g_object_ref(m->vadj);
+		g_signal_connect(m->vadj, "value-changed",
+			G_CALLBACK(&on_vadj_value_changed), m);
+		g_signal_connect(m->vadj, "changed",
+			G_CALLBACK(&on_vadj_changed), m);
+	}
 
 	m->pic_col_r = set_col_func(view, 0,
 		&set_display_pic_column_from_pt_update, m, NULL);
@@ -248,18 +769,149 @@ struct update_model *update_model_new(
 		g_assert_not_reached();
 	}
 
+	live_models = g_list_prepend(live_models, m);
+
 	return m;
 }
 
 
+void update_model_set_filter(
+	struct update_model *model,
+	update_filter_fn fn,
+	void *dataptr)
+{
+	g_return_if_fail(pt_timeline_model_get_count(model->store) == 0);
+	model->filter_fn = fn;
+	model->filter_data = dataptr;
+}
+
+
+void update_model_set_prefetch_rows(struct update_model *model, size_t rows)
+{
+	model->prefetch_rows = rows;
+	/* prepare the whole window over. */
+	model->window_hi = model->window_lo = 0;
+	queue_viewport_update(model);
+}
+
+
+void update_model_set_limits(
+	struct update_model *model,
+	size_t max_rows,
+	size_t max_stored)
+{
+	if(max_rows > 0) model->max_rows = max_rows;
+	if(max_stored > 0) model->max_stored = max_stored;
+	enforce_limits(model);
+}
+
+
+void update_model_set_user_lookup(
+	struct update_model *model,
+	struct user_lookup *users)
+{
+	model->users = users;
+	/* prepare the whole window over, so that its bare users are wanted. */
+	model->window_hi = model->window_lo = 0;
+	queue_viewport_update(model);
+}
+
+
+/* the facades still have the user as it was, and markup made with that,
+ * whether they're shown or just cached.
+ */
+void update_models_users_changed(
+	struct update_store *updates,
+	const uint64_t *user_ids,
+	size_t num_ids)
+{
+	GArray *ids = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	for(size_t i=0; i < num_ids; i++) {
+		update_store_find_author(updates, user_ids[i], ids);
+	}
+	for(guint i=0; i < ids->len; i++) {
+		update_store_drop_facade(updates, g_array_index(ids, uint64_t, i));
+	}
+	g_array_free(ids, TRUE);
+
+	for(GList *cur = g_list_first(live_models);
+		cur != NULL;
+		cur = g_list_next(cur))
+	{
+		struct update_model *m = cur->data;
+		if(m->updates != updates) continue;
+		for(size_t i=0; i < num_ids; i++) {
+			struct user_rows *ur = g_hash_table_lookup(m->user_rows,
+				&user_ids[i]);
+			for(guint j=0; ur != NULL && j < ur->status_ids->len; j++) {
+				uint64_t id = g_array_index(ur->status_ids, uint64_t, j);
+				int pos = pt_timeline_model_find(m->store, id);
+				if(pos >= 0) pt_timeline_model_row_changed(m->store, pos);
+			}
+		}
+	}
+}
+
+
+void update_model_set_fetch_older_fn(
+	struct update_model *model,
+	update_model_fetch_fn fn,
+	void *dataptr)
+{
+	model->fetch_older_fn = fn;
+	model->fetch_older_data = dataptr;
+	model->fetch_exhausted_id = 0;
+}
+
+
+void update_model_older_fetched(
+	struct update_model *model,
+	uint64_t below_id,
+	ssize_t num_fetched)
+{
+	if(model->fetching_below != below_id) return;
+	model->fetching_below = 0;
+	/* don't ask again on every scroll event. */
+	if(num_fetched == 0) model->fetch_exhausted_id = below_id;
+}
+
+
 void update_model_free(struct update_model *model)
 {
+	if(model->vadj != NULL) {
+		g_signal_handlers_disconnect_by_func(model->vadj,
+			&on_vadj_value_changed, model);
+		g_signal_handlers_disconnect_by_func(model->vadj,
+			&on_vadj_changed, model);
+		g_object_unref(model->vadj);
+	}
+	if(model->viewport_idle_id != 0) g_source_remove(model->viewport_idle_id);
+	if(model->insert_tick_id != 0) {
+		gtk_widget_remove_tick_callback(GTK_WIDGET(model->view),
+			model->insert_tick_id);
+	}
+	live_models = g_list_remove(live_models, model);
+	for(GList *cur = model->markup_reqs; cur != NULL; cur = g_list_next(cur)) {
+		struct markup_req *req = cur->data;
+		req->m = NULL;
+	}
+	g_list_free(model->markup_reqs);
+	g_hash_table_destroy(model->rendering);
+	for(size_t i=0; i < pt_timeline_model_get_count(model->store); i++) {
+		update_store_unpin(model->updates,
+			pt_timeline_model_get_id(model->store, i));
+	}
+	for(guint i=0; i < model->pending->len; i++) {
+		update_store_unpin(model->updates,
+			g_array_index(model->pending, uint64_t, i));
+	}
+	g_array_free(model->pending, TRUE);
+	g_hash_table_destroy(model->user_rows);
+	gtk_tree_view_set_model(model->view, NULL);
 	g_object_unref(model->store);
 	g_object_unref(model->view);
 	g_object_unref(model->update_col_r);
 	g_object_unref(model->pic_col_r);
-	g_object_unref(model->http_session);
 	g_object_unref(model->default_userpic);
-	g_free(model->current_ids);
 	g_free(model);
 }
@@ -0,0 +1,355 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <glib.h>
+
+#include "defs.h"
+
+
+/* mute rules: words, users and clients. users and clients are hash sets.
+ * words are compiled into an Aho-Corasick automaton over a compressed
+ * alphabet: every byte that appears in some word gets a class of its own,
+ * and the rest share class 0. the automaton is a full transition table, so
+ * matching costs one lookup per byte of text regardless of how many words
+ * there are.
+ *
+ * words match whole: "cat" mutes "a cat!" but not "concatenate". a word
+ * found by the automaton is checked for word boundaries at either end, on
+ * the sides where the word itself starts or ends with a word character.
+ *
+ * removing a word only unmarks the state where it ends, and re-derives the
+ * output links in one pass over the states. so does adding a word whose
+ * path is already in the trie, such as one that was removed. other
+ * additions mark the automaton stale, and it's rebuilt on the next match,
+ * so a burst of them costs one rebuild. user and client edits don't touch
+ * it.
+ */
+struct mute_filter
+{
+	GHashTable *words;		/* folded word -> itself */
+	GHashTable *users;		/* &uint64_t -> same */
+	GHashTable *sources;	/* source text -> itself */
+	unsigned changes;		/* MUTE_RULES_* since the last take */
+
+	/* the automaton. */
+	bool stale;
+	uint8_t classes[256];
+	int n_classes, n_states;
+	int32_t *delta;			/* [state * n_classes + class] -> state */
+	bool *terminal;			/* a word ends here */
+	bool *accept;			/* a word ends here or down the failure chain */
+	int *depth;				/* length of the state's path from the root */
+	int *fail;
+	int *out;				/* nearest terminal down the failure chain, or 0 */
+	int *order;				/* states but the root, breadth first */
+};
+
+
+static inline uint8_t fold_byte(uint8_t c) {
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+
+static char *fold_word(const char *word)
+{
+	char *out = g_strdup(word);
+	for(char *p = out; *p != '\0'; p++) *p = fold_byte(*p);
+	return out;
+}
+
+
+struct mute_filter *mute_filter_new(void)
+{
+	struct mute_filter *f = g_new0(struct mute_filter, 1);
+	f->words = g_hash_table_new_full(&g_str_hash, &g_str_equal,
+		&g_free, NULL);
+	f->users = g_hash_table_new_full(&g_int64_hash, &g_int64_equal,
+		&g_free, NULL);
+	f->sources = g_hash_table_new_full(&g_str_hash, &g_str_equal,
+		&g_free, NULL);
+	f->stale = true;
+	return f;
+}
+
+
+void mute_filter_free(struct mute_filter *f)
+{
+	g_hash_table_destroy(f->words);
+	g_hash_table_destroy(f->users);
+	g_hash_table_destroy(f->sources);
+	g_free(f->delta);
+	g_free(f->terminal);
+	g_free(f->accept);
+	g_free(f->depth);
+	g_free(f->fail);
+	g_free(f->out);
+	g_free(f->order);
+	g_free(f);
+}
+
+
+/* common bits of the add and remove functions. `key' is consumed. */
+static bool set_add(struct mute_filter *f, GHashTable *set, gpointer key)
+{
+	if(g_hash_table_lookup(set, key) != NULL) {
+		g_free(key);
+		return false;
+	}
+	g_hash_table_insert(set, key, key);
+	f->changes |= MUTE_RULES_ADDED;
+	return true;
+}
+
+
+static bool set_remove(struct mute_filter *f, GHashTable *set, gpointer key)
+{
+	bool found = g_hash_table_remove(set, key);
+	g_free(key);
+	if(found) f->changes |= MUTE_RULES_REMOVED;
+	return found;
+}
+
+
+/* re-derives `out' and `accept' from `terminal' and the failure links.
+ * a state's failure target is shallower, so it's done by the time it's
+ * looked at.
+ */
+static void refresh_outputs(struct mute_filter *f)
+{
+	f->out[0] = 0;
+	f->accept[0] = f->terminal[0];
+	for(int i=0; i < f->n_states - 1; i++) {
+		int s = f->order[i], t = f->fail[s];
+		f->out[s] = f->terminal[t] ? t : f->out[t];
+		f->accept[s] = f->terminal[s] || f->out[s] != 0;
+	}
+}
+
+
+/* the state where the folded word `w' ends in the compiled trie, or -1 when
+ * its path isn't all there. trie edges are the ones that go one deeper;
+ * the rest of the table is failure transitions.
+ */
+static int trie_state(struct mute_filter *f, const uint8_t *w)
+{
+	int s = 0;
+	for(size_t i=0; w[i] != '\0'; i++) {
+		uint8_t c = f->classes[w[i]];
+		if(c == 0) return -1;
+		int next = f->delta[s * f->n_classes + c];
+		if(f->depth[next] != f->depth[s] + 1) return -1;
+		s = next;
+	}
+	return s;
+}
+
+
+bool mute_filter_add_word(struct mute_filter *f, const char *word)
+{
+	if(word == NULL || word[0] == '\0') return false;
+	char *folded = fold_word(word);
+	int s = f->stale || f->delta == NULL ? -1
+		: trie_state(f, (const uint8_t *)folded);
+	bool added = set_add(f, f->words, folded);
+	if(added && s > 0) {
+		f->terminal[s] = true;
+		refresh_outputs(f);
+	} else if(added) {
+		f->stale = true;
+	}
+	return added;
+}
+
+
+bool mute_filter_remove_word(struct mute_filter *f, const char *word)
+{
+	if(word == NULL) return false;
+	char *folded = fold_word(word);
+	int s = -1;
+	if(!f->stale && f->delta != NULL
+		&& g_hash_table_lookup(f->words, folded) != NULL)
+	{
+		s = trie_state(f, (const uint8_t *)folded);
+		assert(s > 0);
+	}
+	bool found = set_remove(f, f->words, folded);
+	if(found && s > 0) {
+		f->terminal[s] = false;
+		refresh_outputs(f);
+	}
+	return found;
+}
+
+
+bool mute_filter_add_user(struct mute_filter *f, uint64_t user_id) {
+	return set_add(f, f->users, g_memdup(&user_id, sizeof(user_id)));
+}
+
+
+bool mute_filter_remove_user(struct mute_filter *f, uint64_t user_id) {
+	return set_remove(f, f->users, g_memdup(&user_id, sizeof(user_id)));
+}
+
+
+bool mute_filter_add_source(struct mute_filter *f, const char *source)
+{
+	if(source == NULL) return false;
+	return set_add(f, f->sources, g_strdup(source));
+}
+
+
+bool mute_filter_remove_source(struct mute_filter *f, const char *source)
+{
+	if(source == NULL) return false;
+	return set_remove(f, f->sources, g_strdup(source));
+}
+
+
+unsigned mute_filter_take_changes(struct mute_filter *f)
+{
+	unsigned c = f->changes;
+	f->changes = 0;
+	return c;
+}
+
+
+static void compile(struct mute_filter *f)
+{
+	g_free(f->delta);
+	g_free(f->terminal);
+	g_free(f->accept);
+	g_free(f->depth);
+	g_free(f->fail);
+	g_free(f->out);
+	g_free(f->order);
+
+	/* the alphabet, and an upper bound for the number of states. */
+	memset(f->classes, 0, sizeof(f->classes));
+	f->n_classes = 1;
+	size_t max_states = 1;
+	GHashTableIter iter;
+	gpointer key;
+	g_hash_table_iter_init(&iter, f->words);
+	while(g_hash_table_iter_next(&iter, &key, NULL)) {
+		const uint8_t *w = key;
+		for(size_t i=0; w[i] != '\0'; i++) {
+			if(f->classes[w[i]] == 0) f->classes[w[i]] = f->n_classes++;
+			max_states++;
+		}
+	}
+
+	/* the trie. -1 is "no edge". */
+	const int nc = f->n_classes;
+	f->delta = g_new(int32_t, max_states * nc);
+	f->terminal = g_new0(bool, max_states);
+	f->accept = g_new0(bool, max_states);
+	f->depth = g_new0(int, max_states);
+	f->out = g_new0(int, max_states);
+	for(size_t i=0; i < max_states * nc; i++) f->delta[i] = -1;
+	f->n_states = 1;
+	g_hash_table_iter_init(&iter, f->words);
+	while(g_hash_table_iter_next(&iter, &key, NULL)) {
+		const uint8_t *w = key;
+		int s = 0;
+		for(size_t i=0; w[i] != '\0'; i++) {
+			int32_t *t = &f->delta[s * nc + f->classes[w[i]]];
+			if(*t < 0) {
+				*t = f->n_states++;
+				f->depth[*t] = i + 1;
+			}
+			s = *t;
+		}
+		f->terminal[s] = true;
+	}
+
+	/* failure links in breadth-first order, folded directly into the
+	 * transition table.
+	 */
+	int *fail = g_new0(int, f->n_states), *queue = g_new(int, f->n_states);
+	int head = 0, tail = 0;
+	for(int c=0; c < nc; c++) {
+		int32_t *t = &f->delta[c];
+		if(*t < 0) *t = 0;
+		else {
+			fail[*t] = 0;
+			queue[tail++] = *t;
+		}
+	}
+	while(head < tail) {
+		int s = queue[head++];
+		for(int c=0; c < nc; c++) {
+			int32_t *t = &f->delta[s * nc + c];
+			if(*t < 0) *t = f->delta[fail[s] * nc + c];
+			else {
+				fail[*t] = f->delta[fail[s] * nc + c];
+				queue[tail++] = *t;
+			}
+		}
+	}
+	assert(tail == f->n_states - 1);
+	f->fail = fail;
+	f->order = queue;
+	refresh_outputs(f);
+
+	f->stale = false;
+}
+
+
+/* ASCII letters, digits and '_', and all of UTF-8's multibyte sequences. */
+static inline bool is_word_byte(uint8_t c) {
+	return g_ascii_isalnum(c) || c == '_' || c >= 0x80;
+}
+
+
+/* whether the match from `first' to `last' (inclusive) stands apart from
+ * its neighbours in `text'.
+ */
+static inline bool whole_word(
+	const uint8_t *text,
+	const uint8_t *first,
+	const uint8_t *last)
+{
+	if(first > text && is_word_byte(first[-1]) && is_word_byte(first[0])) {
+		return false;
+	}
+	return !is_word_byte(last[1]) || !is_word_byte(last[0]);
+}
+
+
+bool mute_filter_match_text(struct mute_filter *f, const char *text)
+{
+	if(text == NULL || g_hash_table_size(f->words) == 0) return false;
+	if(f->stale) compile(f);
+
+	const int nc = f->n_classes;
+	const uint8_t *start = (const uint8_t *)text;
+	int s = 0;
+	for(const uint8_t *p = start; *p != '\0'; p++) {
+		s = f->delta[s * nc + f->classes[fold_byte(*p)]];
+		if(!f->accept[s]) continue;
+		/* each word that ends here, longest first. */
+		for(int t = f->terminal[s] ? s : f->out[s]; t != 0; t = f->out[t]) {
+			if(whole_word(start, p - f->depth[t] + 1, p)) return true;
+		}
+	}
+	return false;
+}
+
+
+bool mute_filter_match(
+	struct mute_filter *f,
+	const char *text,
+	uint64_t user_id,
+	const char *source)
+{
+	if(user_id != 0 && g_hash_table_lookup(f->users, &user_id) != NULL) {
+		return true;
+	}
+	if(source != NULL && g_hash_table_lookup(f->sources, source) != NULL) {
+		return true;
+	}
+	return mute_filter_match_text(f, text);
+}
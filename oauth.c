@@ -75,6 +75,15 @@ void oa_set_token(
 }
 
 
+/* `signer' must have been made from the request's secrets, and outlive
+ * the signing.
+ */
+void oa_set_signer(struct oauth_request *req, struct oauth_signer *signer)
+{
+	req->signer = signer;
+}
+
+
 void oa_set_verifier(struct oauth_request *req, const char *verifier)
 {
 	req->verifier = copy(req, verifier);
@@ -240,6 +249,21 @@ static char *oa_sig_base(
 }
 
 
+/* writes the signature base into `md', and closes it. */
+static char *finish_sha1(gcry_md_hd_t md, const void *sig_base, size_t sb_len)
+{
+	gcry_md_write(md, sig_base, sb_len > 0 ? sb_len : strlen(sig_base));
+	const void *value = gcry_md_read(md, GCRY_MD_SHA1);
+	assert(value != NULL);
+	unsigned int val_len = gcry_md_get_algo_dlen(GCRY_MD_SHA1);
+	char *ret = oauth_encode_base64(val_len, value);
+
+	gcry_md_close(md);
+
+	return ret;
+}
+
+
 /* uses HMAC-SHA1 when "key" is given. when not, plain SHA1. */
 static char *oa_sign_sha1(
 	const void *sig_base,
@@ -254,15 +278,7 @@ static char *oa_sign_sha1(
 		err = gcry_md_setkey(md, key, strlen(key));
 		if(err != 0) goto fail;
 	}
-	gcry_md_write(md, sig_base, sb_len > 0 ? sb_len : strlen(sig_base));
-	const void *value = gcry_md_read(md, GCRY_MD_SHA1);
-	assert(value != NULL);
-	unsigned int val_len = gcry_md_get_algo_dlen(GCRY_MD_SHA1);
-	char *ret = oauth_encode_base64(val_len, value);
-
-	gcry_md_close(md);
-
-	return ret;
+	return finish_sha1(md, sig_base, sb_len);
 
 fail:
 	fprintf(stderr, "%s: gcrypt error: %s\n", __func__,
@@ -272,6 +288,71 @@ fail:
 }
 
 
+/* the HMAC key as OAuth has it: both secrets escaped, joined by '&'. */
+static char *hmac_key(const char *consumer_secret, const char *token_secret)
+{
+	char *con_sec = oauth_url_escape(consumer_secret),
+		*tok_sec = oauth_url_escape(token_secret),
+		*key = g_strdup_printf("%s&%s", con_sec, tok_sec);
+	g_free(con_sec);
+	g_free(tok_sec);
+	return key;
+}
+
+
+/* a HMAC-SHA1 handle that's been keyed once and is never written to. each
+ * signature copies it, so that escaping the secrets and hashing the padded
+ * key happen once per credential rather than once per request.
+ */
+struct oauth_signer
+{
+	gcry_md_hd_t keyed;
+};
+
+
+struct oauth_signer *oa_signer_new(
+	const char *consumer_secret,
+	const char *token_secret)
+{
+	char *key = hmac_key(consumer_secret, token_secret);
+	gcry_md_hd_t md = NULL;
+	gcry_error_t err = gcry_md_open(&md, GCRY_MD_SHA1, GCRY_MD_FLAG_HMAC);
+	if(err == 0) err = gcry_md_setkey(md, key, strlen(key));
+	g_free(key);
+	if(err != 0) {
+		fprintf(stderr, "%s: gcrypt error: %s\n", __func__,
+			gcry_strerror(err));
+		if(md != NULL) gcry_md_close(md);
+		return NULL;
+	}
+
+	struct oauth_signer *s = g_new(struct oauth_signer, 1);
+	s->keyed = md;
+	return s;
+}
+
+
+void oa_signer_free(struct oauth_signer *s)
+{
+	if(s == NULL) return;
+	gcry_md_close(s->keyed);
+	g_free(s);
+}
+
+
+static char *signer_sign(struct oauth_signer *s, const char *sig_base)
+{
+	gcry_md_hd_t md = NULL;
+	gcry_error_t err = gcry_md_copy(&md, s->keyed);
+	if(err != 0) {
+		fprintf(stderr, "%s: gcrypt error: %s\n", __func__,
+			gcry_strerror(err));
+		return NULL;
+	}
+	return finish_sha1(md, sig_base, 0);
+}
+
+
 static char *oa_gen_nonce(void)
 {
 	int fd = open("/dev/urandom", O_RDONLY);
@@ -364,20 +445,21 @@ bool oa_sign_request(struct oauth_request *req, int kind)
 
 	char *signature;
 	switch(req->sig_method) {
-	case SIG_HMAC_SHA1: {
-		char *con_sec = oauth_url_escape(req->consumer_secret),
-			*tok_sec = oauth_url_escape(req->token_secret),
-			*hmac_key = g_strdup_printf("%s&%s", con_sec, tok_sec);
-		signature = oa_sign_sha1(sb, 0, hmac_key);
+	case SIG_HMAC_SHA1:
+		if(req->signer != NULL) signature = signer_sign(req->signer, sb);
+		else {
+			char *key = hmac_key(req->consumer_secret, req->token_secret);
+			signature = oa_sign_sha1(sb, 0, key);
+#if DEBUG_PRINT
+			printf("hmac key: `%s'\n", key);
+#endif
+			g_free(key);
+		}
 #if DEBUG_PRINT
-		printf("hmac key: `%s'\n", hmac_key);
 		printf("signature: `%s'\n", signature);
 #endif
-		g_free(con_sec);
-		g_free(tok_sec);
-		g_free(hmac_key);
 		break;
-		}
+
 	default:
 		g_free(sb);
 		g_hash_table_destroy(params);
@@ -1,6 +1,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <limits.h>
 #include <string.h>
 #include <assert.h>
@@ -22,6 +23,7 @@ struct cache_item
 	size_t key_size;
 	PtCache *parent;	/* not a ref */
 	uint32_t age;
+	bool active;		/* on active_list */
 };
 
 
@@ -89,6 +91,7 @@ static void toggle_last_ref_cb(
 	if(!is_last) {
 		list_add_tail(&cache->active_list, &item->link);
 		cache->active_count++;
+		item->active = true;
 	} else if(item->age == 0) {
 		/* a last reference on an old object. remove it immediately. */
 		if(cache->flush_fn != NULL) {
@@ -104,6 +107,7 @@ static void toggle_last_ref_cb(
 	} else {
 		list_add_tail(&item->parent->inactive_list, &item->link);
 		cache->active_count--;
+		item->active = false;
 	}
 
 	assert(list_length(&cache->active_list) == cache->active_count);
@@ -245,6 +249,7 @@ void pt_cache_put(
 	/* starts out strong. */
 	list_add_tail(&self->active_list, &item->link);
 	self->active_count++;
+	item->active = true;
 	g_object_add_toggle_ref(item->ref, &toggle_last_ref_cb, item);
 	g_object_unref(item->ref);	/* might go passive if sunk. */
 
@@ -253,6 +258,30 @@ void pt_cache_put(
 }
 
 
+bool pt_cache_remove(PtCache *self, gconstpointer key)
+{
+	if(self->keys == NULL) return false;
+
+	struct cache_item *item = g_hash_table_lookup(self->keys, key);
+	if(item == NULL) return false;
+
+	if(self->flush_fn != NULL) {
+		(*self->flush_fn)(&item->ref, 1, self->flush_data);
+	}
+	delist_item(item);
+	if(item->active) self->active_count--;
+	/* the key may point into the object, so it goes first. */
+	g_hash_table_remove(self->keys, item->key);
+	if(item->key_size > 0) g_free(item->key);
+	self->count--;
+	g_object_remove_toggle_ref(item->ref, &toggle_last_ref_cb, item);
+	g_slice_free(struct cache_item, item);
+
+	assert(list_length(&self->active_list) == self->active_count);
+	return true;
+}
+
+
 static void pt_cache_get_property(
 	GObject *object,
 	guint prop_id,
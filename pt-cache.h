@@ -101,4 +101,10 @@ extern void pt_cache_put(
 	size_t key_size,
 	GObject *value);
 
+/* drop the entry for `key' and the cache's reference to its object, whether
+ * or not the object is referenced elsewhere. the flush function is called as
+ * for replacement. returns false when the key wasn't present.
+ */
+extern bool pt_cache_remove(PtCache *cache, gconstpointer key);
+
 #endif
@@ -0,0 +1,299 @@
+
+#include <stdlib.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+
+#include "defs.h"
+#include "pt-timeline-model.h"
+#include "pt-update.h"
+
+
+PtTimelineModel *pt_timeline_model_new(struct update_store *updates)
+{
+	PtTimelineModel *m = g_object_new(PT_TIMELINE_MODEL_TYPE, NULL);
+	m->updates = updates;
+	return m;
+}
+
+
+int pt_timeline_model_find(PtTimelineModel *self, uint64_t id) {
+	return id_index_position(self->index, id);
+}
+
+
+static inline void set_iter(PtTimelineModel *self, GtkTreeIter *iter, int pos)
+{
+	iter->stamp = self->stamp;
+	iter->user_data = GINT_TO_POINTER(pos);
+	iter->user_data2 = NULL;
+	iter->user_data3 = NULL;
+}
+
+
+static inline int iter_pos(PtTimelineModel *self, GtkTreeIter *iter)
+{
+	g_return_val_if_fail(iter->stamp == self->stamp, -1);
+	return GPOINTER_TO_INT(iter->user_data);
+}
+
+
+static void emit_inserted(PtTimelineModel *self, int pos)
+{
+	GtkTreePath *path = gtk_tree_path_new_from_indices(pos, -1);
+	GtkTreeIter iter;
+	set_iter(self, &iter, pos);
+	gtk_tree_model_row_inserted(GTK_TREE_MODEL(self), path, &iter);
+	gtk_tree_path_free(path);
+}
+
+
+size_t pt_timeline_model_insert(
+	PtTimelineModel *self,
+	const uint64_t *ids,
+	size_t num_ids)
+{
+	/* GtkTreeModel wants each row's "row-inserted" before the next row goes
+	 * in, so that handlers see a model that agrees with the signal.
+	 */
+	size_t n = 0;
+	for(size_t i=0; i < num_ids; i++) {
+		if(!id_index_insert(self->index, ids[i])) continue;
+		self->stamp++;
+		emit_inserted(self, pt_timeline_model_find(self, ids[i]));
+		n++;
+	}
+	return n;
+}
+
+
+size_t pt_timeline_model_truncate(PtTimelineModel *self, size_t count)
+{
+	size_t old_count = pt_timeline_model_get_count(self);
+	if(count >= old_count) return 0;
+
+	/* last row first, and each gone from the index before its signal, so
+	 * that the model agrees with every row-deleted as it goes out.
+	 */
+	GtkTreeModel *tm = GTK_TREE_MODEL(self);
+	for(size_t pos = old_count; pos > count; pos--) {
+		id_index_truncate(self->index, pos - 1);
+		self->stamp++;
+		GtkTreePath *path = gtk_tree_path_new_from_indices(pos - 1, -1);
+		gtk_tree_model_row_deleted(tm, path);
+		gtk_tree_path_free(path);
+	}
+
+	return old_count - count;
+}
+
+
+bool pt_timeline_model_remove(PtTimelineModel *self, uint64_t id)
+{
+	int pos = pt_timeline_model_find(self, id);
+	if(pos < 0) return false;
+
+	id_index_remove(self->index, id);
+	self->stamp++;
+	GtkTreePath *path = gtk_tree_path_new_from_indices(pos, -1);
+	gtk_tree_model_row_deleted(GTK_TREE_MODEL(self), path);
+	gtk_tree_path_free(path);
+	return true;
+}
+
+
+uint64_t pt_timeline_model_get_iter_id(
+	PtTimelineModel *self,
+	GtkTreeIter *iter)
+{
+	int pos = iter_pos(self, iter);
+	if(pos < 0 || pos >= pt_timeline_model_get_count(self)) return 0;
+	return pt_timeline_model_get_id(self, pos);
+}
+
+
+void pt_timeline_model_row_changed(PtTimelineModel *self, int pos)
+{
+	g_return_if_fail(pos >= 0 && pos < pt_timeline_model_get_count(self));
+
+	GtkTreePath *path = gtk_tree_path_new_from_indices(pos, -1);
+	GtkTreeIter iter;
+	set_iter(self, &iter, pos);
+	gtk_tree_model_row_changed(GTK_TREE_MODEL(self), path, &iter);
+	gtk_tree_path_free(path);
+}
+
+
+/* GtkTreeModel implementation. */
+
+static GtkTreeModelFlags pt_timeline_model_get_flags(GtkTreeModel *model) {
+	return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+
+static gint pt_timeline_model_get_n_columns(GtkTreeModel *model) {
+	return 1;
+}
+
+
+static GType pt_timeline_model_get_column_type(GtkTreeModel *model, gint ix)
+{
+	g_return_val_if_fail(ix == 0, G_TYPE_INVALID);
+	return PT_UPDATE_TYPE;
+}
+
+
+static gboolean pt_timeline_model_get_iter(
+	GtkTreeModel *model,
+	GtkTreeIter *iter,
+	GtkTreePath *path)
+{
+	PtTimelineModel *self = PT_TIMELINE_MODEL(model);
+	if(gtk_tree_path_get_depth(path) != 1) return FALSE;
+	int pos = gtk_tree_path_get_indices(path)[0];
+	if(pos < 0 || pos >= pt_timeline_model_get_count(self)) return FALSE;
+	set_iter(self, iter, pos);
+	return TRUE;
+}
+
+
+static GtkTreePath *pt_timeline_model_get_path(
+	GtkTreeModel *model,
+	GtkTreeIter *iter)
+{
+	PtTimelineModel *self = PT_TIMELINE_MODEL(model);
+	int pos = iter_pos(self, iter);
+	g_return_val_if_fail(pos >= 0, NULL);
+	return gtk_tree_path_new_from_indices(pos, -1);
+}
+
+
+static void pt_timeline_model_get_value(
+	GtkTreeModel *model,
+	GtkTreeIter *iter,
+	gint column,
+	GValue *value)
+{
+	PtTimelineModel *self = PT_TIMELINE_MODEL(model);
+	g_return_if_fail(column == 0);
+	int pos = iter_pos(self, iter);
+	g_return_if_fail(pos >= 0 && pos < pt_timeline_model_get_count(self));
+
+	g_value_init(value, PT_UPDATE_TYPE);
+	g_value_take_object(value, update_store_get(self->updates,
+		pt_timeline_model_get_id(self, pos)));
+}
+
+
+static gboolean pt_timeline_model_iter_next(
+	GtkTreeModel *model,
+	GtkTreeIter *iter)
+{
+	PtTimelineModel *self = PT_TIMELINE_MODEL(model);
+	int pos = iter_pos(self, iter);
+	if(pos < 0 || pos + 1 >= pt_timeline_model_get_count(self)) return FALSE;
+	set_iter(self, iter, pos + 1);
+	return TRUE;
+}
+
+
+static gboolean pt_timeline_model_iter_nth_child(
+	GtkTreeModel *model,
+	GtkTreeIter *iter,
+	GtkTreeIter *parent,
+	gint n)
+{
+	PtTimelineModel *self = PT_TIMELINE_MODEL(model);
+	if(parent != NULL || n < 0 || n >= pt_timeline_model_get_count(self)) {
+		return FALSE;
+	}
+	set_iter(self, iter, n);
+	return TRUE;
+}
+
+
+static gboolean pt_timeline_model_iter_children(
+	GtkTreeModel *model,
+	GtkTreeIter *iter,
+	GtkTreeIter *parent)
+{
+	return pt_timeline_model_iter_nth_child(model, iter, parent, 0);
+}
+
+
+static gboolean pt_timeline_model_iter_has_child(
+	GtkTreeModel *model,
+	GtkTreeIter *iter)
+{
+	return FALSE;
+}
+
+
+static gint pt_timeline_model_iter_n_children(
+	GtkTreeModel *model,
+	GtkTreeIter *iter)
+{
+	PtTimelineModel *self = PT_TIMELINE_MODEL(model);
+	return iter == NULL ? pt_timeline_model_get_count(self) : 0;
+}
+
+
+static gboolean pt_timeline_model_iter_parent(
+	GtkTreeModel *model,
+	GtkTreeIter *iter,
+	GtkTreeIter *child)
+{
+	return FALSE;
+}
+
+
+static void pt_timeline_model_tree_model_init(GtkTreeModelIface *iface)
+{
+	iface->get_flags = &pt_timeline_model_get_flags;
+	iface->get_n_columns = &pt_timeline_model_get_n_columns;
+	iface->get_column_type = &pt_timeline_model_get_column_type;
+	iface->get_iter = &pt_timeline_model_get_iter;
+	iface->get_path = &pt_timeline_model_get_path;
+	iface->get_value = &pt_timeline_model_get_value;
+	iface->iter_next = &pt_timeline_model_iter_next;
+	iface->iter_children = &pt_timeline_model_iter_children;
+	iface->iter_has_child = &pt_timeline_model_iter_has_child;
+	iface->iter_n_children = &pt_timeline_model_iter_n_children;
+	iface->iter_nth_child = &pt_timeline_model_iter_nth_child;
+	iface->iter_parent = &pt_timeline_model_iter_parent;
+}
+
+
+/* GObject stuff. */
+
+static void pt_timeline_model_init(PtTimelineModel *self)
+{
+	self->stamp = g_random_int();
+	self->index = id_index_new();
+	self->updates = NULL;
+}
+
+
+static void pt_timeline_model_finalize(GObject *object)
+{
+	PtTimelineModel *self = PT_TIMELINE_MODEL(object);
+
+	id_index_free(self->index);
+	self->index = NULL;
+
+	GObjectClass *parent_class = g_type_class_peek_parent(
+		PT_TIMELINE_MODEL_GET_CLASS(self));
+	parent_class->finalize(object);
+}
+
+
+static void pt_timeline_model_class_init(PtTimelineModelClass *klass)
+{
+	GObjectClass *obj_class = G_OBJECT_CLASS(klass);
+	obj_class->finalize = &pt_timeline_model_finalize;
+}
+
+
+G_DEFINE_TYPE_WITH_CODE(PtTimelineModel, pt_timeline_model, G_TYPE_OBJECT,
+	G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL,
+		&pt_timeline_model_tree_model_init));
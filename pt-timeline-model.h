@@ -0,0 +1,100 @@
+/* GObject for PtTimelineModel, a GtkTreeModel over sorted status ids. */
+
+#ifndef SEEN_PT_TIMELINE_MODEL_H
+#define SEEN_PT_TIMELINE_MODEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+
+#include "defs.h"
+
+
+#define PT_TIMELINE_MODEL_TYPE (pt_timeline_model_get_type())
+#define PT_TIMELINE_MODEL(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), PT_TIMELINE_MODEL_TYPE, PtTimelineModel))
+#define PT_IS_TIMELINE_MODEL(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), PT_TIMELINE_MODEL_TYPE))
+#define PT_TIMELINE_MODEL_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass), PT_TIMELINE_MODEL_TYPE, PtTimelineModelClass))
+#define PT_IS_TIMELINE_MODEL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), PT_TIMELINE_MODEL_TYPE))
+#define PT_TIMELINE_MODEL_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), PT_TIMELINE_MODEL_TYPE, PtTimelineModelClass))
+
+
+typedef struct _pt_timeline_model PtTimelineModel;
+typedef struct _pt_timeline_model_class PtTimelineModelClass;
+
+
+/* a flat GtkTreeModel with one column, PT_UPDATE_TYPE, whose rows are status
+ * ids in descending order. values are facades from the update store, so the
+ * model itself only holds the ids.
+ *
+ * iterators are invalidated by any change to the model.
+ */
+struct _pt_timeline_model
+{
+	GObject parent_instance;
+
+	int stamp;
+	struct id_index *index;
+	struct update_store *updates;	/* not owned */
+};
+
+
+struct _pt_timeline_model_class
+{
+	GObjectClass parent_class;
+};
+
+
+extern GType pt_timeline_model_get_type(void);
+
+extern PtTimelineModel *pt_timeline_model_new(struct update_store *updates);
+
+/* inserts `num_ids' status ids, which must be sorted largest first. ids
+ * already in the model are skipped. "row-inserted" goes out for each new row
+ * as soon as it's in, before the next one is added; with the ids sorted,
+ * that's in ascending order of position. costs O(k log n) for k ids.
+ *
+ * returns the number of rows inserted.
+ */
+extern size_t pt_timeline_model_insert(
+	PtTimelineModel *model,
+	const uint64_t *ids,
+	size_t num_ids);
+
+/* drops rows from the bottom until `count' remain, emitting "row-deleted"
+ * for each. returns the number of rows dropped.
+ */
+extern size_t pt_timeline_model_truncate(PtTimelineModel *model, size_t count);
+
+/* removes the row for `id', emitting "row-deleted". returns false when it
+ * wasn't there.
+ */
+extern bool pt_timeline_model_remove(PtTimelineModel *model, uint64_t id);
+
+/* returns the row of `id', or -1 when not present. */
+extern int pt_timeline_model_find(PtTimelineModel *model, uint64_t id);
+
+static inline size_t pt_timeline_model_get_count(PtTimelineModel *model) {
+	return id_index_count(model->index);
+}
+
+/* `pos' must be a valid row. */
+static inline uint64_t pt_timeline_model_get_id(
+	PtTimelineModel *model,
+	size_t pos)
+{
+	return id_index_nth(model->index, pos);
+}
+
+/* returns the status id of the row at `iter', or 0 for a stale iterator.
+ * doesn't build a facade.
+ */
+extern uint64_t pt_timeline_model_get_iter_id(
+	PtTimelineModel *model,
+	GtkTreeIter *iter);
+
+/* emit "row-changed" for row `pos'. */
+extern void pt_timeline_model_row_changed(PtTimelineModel *model, int pos);
+
+#endif
@@ -3,6 +3,7 @@
 #include <string.h>
 #include <strings.h>
 #include <assert.h>
+#include <unistd.h>
 #include <glib.h>
 #include <gtk/gtk.h>
 #include <json-glib/json-glib.h>
@@ -14,6 +15,9 @@
 #include "pt-user-info.h"
 
 
+#define MAX_MARKUP_THREADS 4
+
+
 enum prop_names {
 	PROP_MARKUP = 1,
 };
@@ -35,6 +39,12 @@ static const struct field_desc update_fields[] = {
 };
 
 
+struct source_info {
+	const char *text;
+	const char *uri;		/* NULL when not given */
+};
+
+
 struct source_uri_ctx {
 	char **uri;
 	GString *text;
@@ -99,12 +109,57 @@ static bool separate_source_uri(
 		*source_text = g_string_free(dat.text, FALSE);
 		return true;
 	} else {
+		g_set_error(err_p, 0, n, "xmlSAXUserParseMemory() failed (code %d)",
+			n);
 		g_string_free(dat.text, TRUE);
 		return false;
 	}
 }
 
 
+/* the same few dozen client strings show up over and over, so their parsed
+ * forms are remembered for the process' lifetime. updates are decoded on
+ * worker threads, so the memo has a lock.
+ */
+static GStaticMutex source_lock = G_STATIC_MUTEX_INIT;
+
+static const struct source_info *lookup_source(
+	PtUpdateClass *klass,
+	const char *source)
+{
+	g_static_mutex_lock(&source_lock);
+	struct source_info *info = g_hash_table_lookup(klass->source_memo,
+		source);
+	if(info != NULL) {
+		g_static_mutex_unlock(&source_lock);
+		return info;
+	}
+
+	char *text = NULL, *uri = NULL;
+	if(strchr(source, '<') != NULL) {
+		/* the "source" string may be in XML. separate the URI and content. */
+		GError *err = NULL;
+		if(!separate_source_uri(&uri, &text, source, &err)) {
+			g_debug("failed to parse source `%s': %s", source, err->message);
+			g_error_free(err);
+		}
+	}
+
+	info = g_slice_new(struct source_info);
+	info->text = g_string_chunk_insert_const(klass->source_chunk,
+		text != NULL ? text : source);
+	info->uri = uri == NULL ? NULL
+		: g_string_chunk_insert_const(klass->source_chunk, uri);
+	g_hash_table_insert(klass->source_memo,
+		g_string_chunk_insert_const(klass->source_chunk, source), info);
+	g_free(text);
+	g_free(uri);
+	g_static_mutex_unlock(&source_lock);
+
+	return info;
+}
+
+
 PtUpdate *pt_update_new(void) {
 	return PT_UPDATE(g_object_new(PT_UPDATE_TYPE, NULL));
 }
@@ -117,69 +172,206 @@ PtUpdate *pt_update_new_from_json(
 {
 	PtUpdate *u = pt_update_new();
 	if(!format_from_json(u, obj,
-		update_fields, G_N_ELEMENTS(update_fields), err_p))
+		update_fields, G_N_ELEMENTS(update_fields), NULL, err_p))
 	{
 		g_object_unref(u);
-		u = NULL;
+		assert(err_p == NULL || *err_p != NULL);
+		return NULL;
 	} else if(user_cache != NULL
 		&& !json_object_get_null_member(obj, "user"))
 	{
 		JsonObject *user = json_object_get_object_member(obj, "user");
 		if(user != NULL) {
-			u->user = get_user_info_from_json(user_cache, user);
+			u->user = get_user_info_from_json(user_cache, user, NULL);
 			if(u->user != NULL) g_object_ref(u->user);
 		}
 	}
 
-	char *new_src = NULL;
-	if(strchr(u->source, '<') != NULL) {
-		/* the "source" string may be in XML. separate the URI and content. */
-		char *source_uri = NULL;
-		GError *err = NULL;
-		if(separate_source_uri(&source_uri, &new_src, u->source, &err)) {
-			g_free(source_uri);		/* not kept. */
-		} else {
-			g_debug("failed to parse source `%s': %s", u->source,
-				err->message);
-			g_error_free(err);
-		}
-	}
-	if(new_src == NULL) new_src = g_strdup(u->source);
+	const struct source_info *src = lookup_source(PT_UPDATE_GET_CLASS(u),
+		u->source != NULL ? u->source : "");
 	/* special: format_from_json() insists on duplicating strings into the
 	 * structure, but u->source is declared pointer to const. this is the sane
 	 * thing to do.
 	 */
 	g_free((void *)u->source);
-	PtUpdateClass *klass = PT_UPDATE_GET_CLASS(u);
-	u->source = g_string_chunk_insert_const(klass->source_chunk, new_src);
-	g_free(new_src);
+	u->source = src->text;
+	u->source_uri = src->uri;
 
-	assert(u != NULL || err_p == NULL || *err_p != NULL);
 	return u;
 }
 
 
-static char *pt_update_generate_markup(PtUpdate *self)
+static const char *display_username(PtUpdate *self)
 {
-	const char *username;
 	if(self->user == NULL || self->user->screenname == NULL) {
-		username = "[tanasinn]";
+		return "[tanasinn]";
 	} else {
-		username = self->user->screenname;
+		return self->user->screenname;
 	}
+}
 
-	GDateTime *local = g_date_time_to_local(self->timestamp);
+
+/* touches nothing but its parameters, so it's safe to call from the markup
+ * worker threads.
+ */
+static char *format_markup(
+	const char *username,
+	const char *text,
+	GDateTime *timestamp,
+	const char *source)
+{
+	GDateTime *local = g_date_time_to_local(timestamp);
 	char *time_sent = g_date_time_format(local, "%F %H:%M");
 	char *ret = g_markup_printf_escaped(
 		"<b>%s</b> %s\n"
 		"<span size=\"smaller\" fgcolor=\"grey\">%s from %s</span>",
-		username, self->text, time_sent, self->source);
+		username, text, time_sent, source);
 	g_free(time_sent);
 	g_date_time_unref(local);
 	return ret;
 }
 
 
+static char *pt_update_generate_markup(PtUpdate *self)
+{
+	return format_markup(display_username(self), self->text,
+		self->timestamp, self->source);
+}
+
+
+void pt_update_render_markup(PtUpdate *self, const char *username)
+{
+	g_free(self->markup_cache);
+	self->markup_cache = self->timestamp == NULL ? NULL
+		: format_markup(username, self->text, self->timestamp,
+			self->source);
+}
+
+
+/* worker side of pt_update_prerender_markup(). jobs carry a copy of the
+ * inputs, so the main thread is free to modify the PtUpdate and its user
+ * info while they're being formatted. the last job of a batch to finish
+ * hands the batch back to the main loop.
+ */
+struct markup_batch {
+	volatile gint pending;
+	size_t n_jobs;
+	struct markup_job *jobs;
+	pt_markup_done_fn done_fn;
+	void *dataptr;
+};
+
+struct markup_job {
+	struct markup_batch *batch;
+	PtUpdate *update;			/* ref; not touched by the worker */
+	char *username;
+	const char *text, *source;	/* text is never changed after parse. */
+	GDateTime *timestamp;
+	char *markup;
+};
+
+
+static gboolean on_markup_batch_done(gpointer dataptr)
+{
+	struct markup_batch *b = dataptr;
+	PtUpdate **updates = g_new(PtUpdate *, b->n_jobs);
+	for(size_t i=0; i < b->n_jobs; i++) {
+		struct markup_job *job = &b->jobs[i];
+		PtUpdate *u = job->update;
+		/* the user may have been looked up in the meantime. */
+		if(u->markup_cache == NULL
+			&& strcmp(job->username, display_username(u)) == 0)
+		{
+			u->markup_cache = job->markup;
+		} else {
+			g_free(job->markup);
+		}
+		g_free(job->username);
+		g_date_time_unref(job->timestamp);
+		updates[i] = u;
+	}
+
+	if(b->done_fn != NULL) (*b->done_fn)(updates, b->n_jobs, b->dataptr);
+
+	for(size_t i=0; i < b->n_jobs; i++) g_object_unref(updates[i]);
+	g_free(updates);
+	g_free(b->jobs);
+	g_free(b);
+	return FALSE;
+}
+
+
+static void markup_job_fn(gpointer dataptr, gpointer userdata)
+{
+	struct markup_job *job = dataptr;
+	job->markup = format_markup(job->username, job->text, job->timestamp,
+		job->source);
+
+	struct markup_batch *b = job->batch;
+	if(g_atomic_int_dec_and_test(&b->pending)) {
+		g_idle_add(&on_markup_batch_done, b);
+	}
+}
+
+
+static GThreadPool *markup_pool(void)
+{
+	static GThreadPool *pool = NULL;
+	if(pool == NULL) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		GError *err = NULL;
+		pool = g_thread_pool_new(&markup_job_fn, NULL,
+			CLAMP(ncpu, 1, MAX_MARKUP_THREADS), FALSE, &err);
+		if(pool == NULL) {
+			g_error("%s: can't start markup threads: %s", __func__,
+				err->message);
+		}
+	}
+	return pool;
+}
+
+
+size_t pt_update_prerender_markup(
+	PtUpdate **updates,
+	size_t count,
+	pt_markup_done_fn done_fn,
+	void *dataptr)
+{
+	struct markup_batch *b = g_new(struct markup_batch, 1);
+	b->jobs = g_new(struct markup_job, count);
+	b->n_jobs = 0;
+	b->done_fn = done_fn;
+	b->dataptr = dataptr;
+	for(size_t i=0; i < count; i++) {
+		PtUpdate *u = updates[i];
+		if(u->markup_cache != NULL || u->timestamp == NULL) continue;
+		b->jobs[b->n_jobs++] = (struct markup_job){
+			.batch = b,
+			.update = g_object_ref(u),
+			.username = g_strdup(display_username(u)),
+			.text = u->text, .source = u->source,
+			.timestamp = g_date_time_ref(u->timestamp),
+			.markup = NULL,
+		};
+	}
+
+	size_t n_jobs = b->n_jobs;
+	if(n_jobs == 0) {
+		g_free(b->jobs);
+		g_free(b);
+		return 0;
+	}
+
+	/* set before the first push, as any job may be the last to finish. */
+	b->pending = n_jobs;
+	GThreadPool *pool = markup_pool();
+	for(size_t i=0; i < n_jobs; i++) {
+		g_thread_pool_push(pool, &b->jobs[i], NULL);
+	}
+	return n_jobs;
+}
+
+
 static void pt_update_get_property(
 	GObject *object,
 	guint prop_id,
@@ -206,8 +398,11 @@ static void pt_update_init(PtUpdate *self)
 	self->id = 0;
 	self->in_rep_to_screen_name = NULL;
 	self->source = NULL;
+	self->source_uri = NULL;
 	self->text = NULL;
 	self->user = NULL;
+	self->timestamp = NULL;
+	self->muted = false;
 	self->markup_cache = NULL;
 }
 
@@ -221,7 +416,10 @@ static void pt_update_dispose(GObject *object)
 		g_object_unref(u->user);
 		u->user = NULL;
 	}
-	g_date_time_unref(u->timestamp);
+	if(u->timestamp != NULL) {
+		g_date_time_unref(u->timestamp);
+		u->timestamp = NULL;
+	}
 
 	GObjectClass *parent_class = g_type_class_peek_parent(
 		PT_UPDATE_GET_CLASS(u));
@@ -248,6 +446,7 @@ static void pt_update_finalize(GObject *object)
 static void pt_update_class_init(PtUpdateClass *klass)
 {
 	klass->source_chunk = g_string_chunk_new(512);
+	klass->source_memo = g_hash_table_new(&g_str_hash, &g_str_equal);
 
 	GObjectClass *obj_class = G_OBJECT_CLASS(klass);
 
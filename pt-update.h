@@ -43,6 +43,7 @@ struct update
 	uint64_t in_rep_to_sid;	/* status id, or -''- */
 	char *in_rep_to_screen_name;
 	const char *source;		/* "web", "piiptyyt", etc */
+	const char *source_uri;	/* client's link from "source", or NULL */
 	char *text;				/* UTF-8 */
 	GDateTime *timestamp;
 
@@ -53,6 +54,7 @@ struct update
 	 */
 	struct user_info *user;
 
+	bool muted;				/* mute filter verdict, set at ingest */
 	char *markup_cache;
 };
 
@@ -62,6 +64,10 @@ struct _pt_update_class
 	GObjectClass parent_class;
 	/* with g_string_chunk_insert_const(): values for PtUpdate->source. */
 	GStringChunk *source_chunk;
+	/* raw "source" string to its parsed text and URI. keys and values are
+	 * in source_chunk.
+	 */
+	GHashTable *source_memo;
 };
 
 
@@ -73,6 +79,34 @@ extern PtUpdate *pt_update_new_from_json(
 	struct _pt_cache *user_cache,
 	GError **err_p);
 
+/* called on the main loop with every update of a prerender batch. those
+ * whose markup_cache is still NULL lost theirs to a change of user while
+ * they were being formatted.
+ */
+typedef void (*pt_markup_done_fn)(
+	PtUpdate **updates,
+	size_t count,
+	void *dataptr);
+
+/* hands the formatting of markup_cache, for each update that doesn't have
+ * it yet, to a pool of worker threads and returns at once with how many
+ * went out. the results are filled in from an idle callback, which then
+ * calls `done_fn' (if not NULL); the updates are held until then. this is
+ * meant for rows about to come into view, so that the GTK thread doesn't
+ * format strings while drawing.
+ */
+extern size_t pt_update_prerender_markup(
+	PtUpdate **updates,
+	size_t count,
+	pt_markup_done_fn done_fn,
+	void *dataptr);
+
+/* formats markup_cache as though the update's user's screen name were
+ * `username'. touches nothing but `self', so a decode worker may call it
+ * before the update is handed over to the main thread.
+ */
+extern void pt_update_render_markup(PtUpdate *self, const char *username);
+
 /* get the GdkPixbuf representing the avatar picture to be displayed next to
  * this update. for forwarded updates ("retweets"), returns the originator's
  * userpic and not the re-sender's.
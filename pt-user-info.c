@@ -29,12 +29,42 @@ PtUserInfo *pt_user_info_new(void) {
 }
 
 
-bool pt_user_info_from_json(PtUserInfo *ui, JsonObject *obj, GError **err_p)
+bool pt_user_info_from_json(
+	PtUserInfo *ui,
+	JsonObject *obj,
+	uint64_t *changed_p,
+	GError **err_p)
 {
 	int num_fields = 0;
 	const struct field_desc *fields = pt_user_info_get_field_desc(
 		&num_fields);
-	return format_from_json(ui, obj, fields, num_fields, err_p);
+	uint64_t changed = 0;
+	if(!format_from_json(ui, obj, fields, num_fields, &changed, err_p)) {
+		return false;
+	}
+
+	if((changed & PT_USER_INFO_PROFILE_IMAGE_URL) != 0
+		&& ui->img_fetch_msg != NULL)
+	{
+		/* it'd bring the old picture back. */
+		SoupMessage *msg = ui->img_fetch_msg;
+		ui->img_fetch_msg = NULL;
+		request_sched_cancel(ui->img_fetch_reqs, msg);
+	}
+	if((changed & PT_USER_INFO_PROFILE_IMAGE_URL) != 0
+		&& ui->cached_img_name != NULL)
+	{
+		/* the old picture is stale, and so is its pixbuf under the same
+		 * name.
+		 */
+		pt_cache_remove(ui->userpic_cache, ui->cached_img_name);
+		g_free(ui->cached_img_name);
+		ui->cached_img_name = NULL;
+		g_object_notify_by_pspec(G_OBJECT(ui), properties[PROP_USERPIC]);
+	}
+
+	if(changed_p != NULL) *changed_p = changed;
+	return true;
 }
 
 
@@ -60,7 +90,8 @@ static void img_fetch_callback(
 	gpointer dataptr)
 {
 	PtUserInfo *self = PT_USER_INFO(dataptr);
-	g_return_if_fail(msg == self->img_fetch_msg);
+	/* cancelled for a new profile_image_url. */
+	if(msg != self->img_fetch_msg) return;
 
 	if(msg->status_code == SOUP_STATUS_OK) {
 		/* store response data associated with the user id. */
@@ -112,23 +143,31 @@ static void img_fetch_callback(
 }
 
 
-static void start_userpic_fetch(PtUserInfo *self, SoupSession *session)
+static void start_userpic_fetch(
+	PtUserInfo *self,
+	struct request_sched *reqs,
+	enum request_class cls)
 {
 	if(self->img_fetch_msg != NULL) {
-		/* TODO: check for timeout? or something. */
+		/* wanted sooner, perhaps. TODO: check for timeout? or something. */
+		request_sched_promote(reqs, self->img_fetch_msg, cls);
 		return;
 	}
 
 	self->img_fetch_msg = soup_message_new("GET", self->profile_image_url);
-	soup_session_queue_message(session, self->img_fetch_msg,
+	self->img_fetch_reqs = reqs;
+	request_sched_queue(reqs, cls, self->img_fetch_msg,
 		&img_fetch_callback, self);
 }
 
 
-GdkPixbuf *pt_user_info_get_userpic(PtUserInfo *self, SoupSession *session)
+GdkPixbuf *pt_user_info_get_userpic(
+	PtUserInfo *self,
+	struct request_sched *reqs,
+	enum request_class cls)
 {
 	if(self->cached_img_name == NULL) {
-		if(session != NULL) start_userpic_fetch(self, session);
+		if(reqs != NULL) start_userpic_fetch(self, reqs, cls);
 		return NULL;
 	} else {
 		GdkPixbuf *ret;
@@ -160,7 +199,7 @@ GdkPixbuf *pt_user_info_get_userpic(PtUserInfo *self, SoupSession *session)
 					g_free(self->cached_img_name);
 					self->cached_img_name = NULL;
 					self->dirty = true;
-					ret = pt_user_info_get_userpic(self, session);
+					ret = pt_user_info_get_userpic(self, reqs, cls);
 				} else {
 					g_warning("can't read userpic `%s': %s", filename,
 						err->message);
@@ -204,7 +243,8 @@ static void pt_user_info_get_property(
 	PtUserInfo *self = PT_USER_INFO(object);
 	switch(prop_id) {
 	case PROP_USERPIC:
-		g_value_take_object(value, pt_user_info_get_userpic(self, NULL));
+		g_value_take_object(value, pt_user_info_get_userpic(self, NULL,
+			REQ_USERPIC));
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, spec);
@@ -223,6 +263,7 @@ static void pt_user_info_init(PtUserInfo *self)
 
 	self->dirty = false;
 	self->img_fetch_msg = NULL;
+	self->img_fetch_reqs = NULL;
 
 	PtUserInfoClass *klass = PT_USER_INFO_GET_CLASS(self);
 	if(klass->userpic_cache != NULL) {
@@ -32,7 +32,7 @@ typedef struct _pt_user_info_class PtUserInfoClass;
  *
  * properties:
  * - "userpic" (GdkPixbuf *, ro). reading is equivalent to
- *   pt_user_info_get_userpic(obj, NULL) .
+ *   pt_user_info_get_userpic(obj, NULL, 0) .
  */
 struct user_info
 {
@@ -50,6 +50,7 @@ struct user_info
 	/* non-database, non-json fields */
 	bool dirty;		/* sync to database on destroy? */
 	SoupMessage *img_fetch_msg;
+	struct request_sched *img_fetch_reqs;	/* where img_fetch_msg went */
 	PtCache *userpic_cache;		/* ref */
 };
 
@@ -63,25 +64,50 @@ struct _pt_user_info_class
 
 /* returns a GdkPixbuf reference, or NULL when the image isn't available.
  *
- * if `session' is not NULL, and the image is not cached locally, starts a
- * HTTP transaction with a server using the given session. the transaction's
+ * if `reqs' is not NULL, and the image is not cached locally, queues a HTTP
+ * transaction under `cls' (REQ_USERPIC or REQ_USERPIC_PREFETCH), or
+ * promotes the one that's waiting already. the transaction's
  * completion will be notified to "notify::userpic". it's likely good practice
  * to double-check the result after connecting that signal after a "in
  * progress" outcome.
  */
 extern GdkPixbuf *pt_user_info_get_userpic(
 	PtUserInfo *info,
-	SoupSession *session);
+	struct request_sched *reqs,
+	enum request_class cls);
 
 extern const struct field_desc *pt_user_info_get_field_desc(int *count_p);
 
+/* bits of the changed-field mask from pt_user_info_from_json(), in the order
+ * of pt_user_info_get_field_desc().
+ */
+#define PT_USER_INFO_LONGNAME (1 << 0)
+#define PT_USER_INFO_SCREENNAME (1 << 1)
+#define PT_USER_INFO_PROFILE_IMAGE_URL (1 << 2)
+#define PT_USER_INFO_PROTECTED (1 << 3)
+#define PT_USER_INFO_VERIFIED (1 << 4)
+#define PT_USER_INFO_FOLLOWING (1 << 5)
+#define PT_USER_INFO_ID (1 << 6)
+
+/* the fields that show in a view's rows. the userpic goes by "userpic". */
+#define PT_USER_INFO_DISPLAY_FIELDS \
+	(PT_USER_INFO_LONGNAME | PT_USER_INFO_SCREENNAME \
+	| PT_USER_INFO_PROTECTED | PT_USER_INFO_VERIFIED)
+
 /* for usercache.c, and for dummy objects possibly */
 extern PtUserInfo *pt_user_info_new(void);
 
-/* returns `false', errors on failure. */
+/* returns `false', errors on failure, in which case `ui' is unchanged.
+ * otherwise *changed_p (if not NULL) is set to a mask of PT_USER_INFO_*
+ * bits for fields whose values changed.
+ *
+ * a changed profile_image_url drops the cached userpic, cancels a fetch of
+ * the old one, and notifies "userpic".
+ */
 extern bool pt_user_info_from_json(
 	PtUserInfo *ui,
 	JsonObject *obj,
+	uint64_t *changed_p,
 	GError **err_p);
 
 
@@ -0,0 +1,649 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <libsoup/soup.h>
+
+#include "defs.h"
+
+
+/* default connection limits per class. they add up to libsoup's default
+ * max-conns, so that avatars can't crowd the API calls out of the
+ * session's own queue.
+ */
+static const int default_max_conns[REQ__NUM_CLASSES] = {
+	[REQ_TIMELINE] = 2,
+	[REQ_LOOKUP] = 2,
+	[REQ_BACKGROUND] = 1,
+	[REQ_USERPIC] = 3,
+	[REQ_USERPIC_PREFETCH] = 2,
+};
+
+/* of each endpoint's rate limit window, 1 / RESERVE_DIVISOR of the limit is
+ * kept for classes other than REQ_BACKGROUND. background requests get the
+ * rest spread evenly over what's left of the window.
+ */
+#define RESERVE_DIVISOR 4
+
+/* wait this long after a 420 or 429 that didn't say when to come back. */
+#define LOCKOUT_SEC 60
+
+/* object data of a SoupMessage, from request_sched_set_account(). */
+#define ACCOUNT_KEY "pt-request-account"
+
+/* responses with an ETag or a Last-Modified are kept for revalidation, the
+ * MAX_VALIDATED most recently used of them, up to MAX_VALIDATED_BODY bytes
+ * each.
+ */
+#define MAX_VALIDATED 64
+#define MAX_VALIDATED_BODY (512 * 1024)
+
+
+struct sched_req
+{
+	struct request_sched *sched;
+	SoupMessage *msg;
+	SoupSessionCallback callback;
+	gpointer dataptr;
+	enum request_class cls;
+	char *budget;			/* key of its endpoint's budget */
+	char *cache_key;		/* for revalidation, or NULL */
+	struct validated *validated;	/* ref; what it asked to revalidate */
+	GList *link;			/* in its class' waiting queue; NULL once sent */
+	bool counted;			/* in its budget's `inflight' */
+};
+
+
+/* a response that can be revalidated, and its body for when it's still
+ * good. conditional requests hold a reference, so that their 304 can be
+ * answered even when the entry was evicted or replaced in the meantime.
+ */
+struct validated
+{
+	char *etag, *last_modified;	/* either may be NULL */
+	SoupBuffer *body;
+	gint64 used;				/* monotonic */
+	int refs;
+};
+
+
+struct req_class
+{
+	GQueue waiting;			/* of struct sched_req *, next from the head */
+	int max_conns, running;
+	bool newest_first;
+};
+
+
+/* what's known of one endpoint's rate limit for one account. endpoints
+ * that've never sent the headers (e.g. userpic servers) have none, and
+ * aren't held back.
+ */
+struct budget
+{
+	struct rate_limit rl;	/* as of the latest response */
+	int inflight;			/* sent since, and not yet answered */
+	gint64 last_sent;		/* monotonic */
+};
+
+
+/* requests wait in per-class queues until their class has a connection
+ * free and their endpoint has budget for them, and are then handed to the
+ * session. classes are served in the order of enum request_class.
+ */
+struct request_sched
+{
+	SoupSession *session;
+	struct req_class classes[REQ__NUM_CLASSES];
+	GHashTable *waiting;	/* SoupMessage * -> struct sched_req * */
+	GHashTable *budgets;	/* budget_key() -> struct budget */
+	GHashTable *validated;	/* cache_key() -> struct validated */
+	GHashTable *traffic;	/* URI path -> struct traffic_stats */
+	int running;
+	bool closing;
+	guint retry_id;			/* re-dispatch once a budget allows */
+};
+
+
+static void dispatch(struct request_sched *s);
+
+
+static char *budget_key(uint64_t account, const char *endpoint)
+{
+	if(account == 0) return g_strdup(endpoint);
+	else {
+		return g_strdup_printf("%llu %s", (unsigned long long)account,
+			endpoint);
+	}
+}
+
+
+/* requests for the same thing under the same account share validators,
+ * whatever their OAuth nonces and signatures.
+ */
+static char *cache_key(uint64_t account, SoupURI *uri)
+{
+	GString *path = g_string_new(soup_uri_get_path(uri));
+	const char *query = soup_uri_get_query(uri);
+	if(query != NULL) {
+		GHashTable *form = soup_form_decode(query);
+		GList *names = g_list_sort(g_hash_table_get_keys(form),
+			(GCompareFunc)&strcmp);
+		for(GList *cur = names; cur != NULL; cur = g_list_next(cur)) {
+			const char *name = cur->data;
+			if(g_str_has_prefix(name, "oauth_")) continue;
+			g_string_append_printf(path, "%c%s=%s",
+				strchr(path->str, '?') == NULL ? '?' : '&', name,
+				(const char *)g_hash_table_lookup(form, name));
+		}
+		g_list_free(names);
+		g_hash_table_destroy(form);
+	}
+	char *key = budget_key(account, path->str);
+	g_string_free(path, TRUE);
+	return key;
+}
+
+
+static void validated_unref(gpointer dataptr)
+{
+	struct validated *v = dataptr;
+	if(--v->refs > 0) return;
+	g_free(v->etag);
+	g_free(v->last_modified);
+	soup_buffer_free(v->body);
+	g_free(v);
+}
+
+
+static void sched_req_free(struct sched_req *req)
+{
+	if(req->validated != NULL) validated_unref(req->validated);
+	g_free(req->cache_key);
+	g_free(req->budget);
+	g_slice_free(struct sched_req, req);
+}
+
+
+static void sched_destroy(struct request_sched *s)
+{
+	g_hash_table_destroy(s->traffic);
+	g_hash_table_destroy(s->validated);
+	g_hash_table_destroy(s->budgets);
+	g_hash_table_destroy(s->waiting);
+	g_object_unref(s->session);
+	g_free(s);
+}
+
+
+/* returns true if `req' may go out now. otherwise sets *wait_ms to how long
+ * until it might.
+ */
+static bool within_budget(
+	struct request_sched *s,
+	const struct sched_req *req,
+	gint64 *wait_ms)
+{
+	struct budget *b = g_hash_table_lookup(s->budgets, req->budget);
+	if(b == NULL) return true;
+
+	int64_t left = b->rl.reset - (int64_t)time(NULL);
+	if(left <= 0) {
+		/* the window's been refilled; the next response tells by how much. */
+		return true;
+	}
+
+	int avail = b->rl.remaining - b->inflight;
+	if(req->cls == REQ_BACKGROUND) {
+		avail -= MAX(1, b->rl.limit / RESERVE_DIVISOR);
+	}
+	if(avail <= 0) {
+		*wait_ms = left * 1000 + 1000;
+		return false;
+	}
+	if(req->cls != REQ_BACKGROUND) return true;
+
+	gint64 spacing = left * G_USEC_PER_SEC / avail,
+		since = g_get_monotonic_time() - b->last_sent;
+	if(since < spacing) {
+		*wait_ms = (spacing - since) / 1000 + 1;
+		return false;
+	}
+	return true;
+}
+
+
+static void note_budget(struct request_sched *s, struct sched_req *req)
+{
+	struct budget *b = g_hash_table_lookup(s->budgets, req->budget);
+	if(b != NULL && req->counted) b->inflight--;
+
+	SoupMessageHeaders *hdrs = req->msg->response_headers;
+	const char *limit = soup_message_headers_get_one(hdrs,
+			"X-RateLimit-Limit"),
+		*remaining = soup_message_headers_get_one(hdrs,
+			"X-RateLimit-Remaining"),
+		*reset = soup_message_headers_get_one(hdrs, "X-RateLimit-Reset");
+	guint status = req->msg->status_code;
+	bool locked_out = status == 420 || status == 429;
+	if(!locked_out && (remaining == NULL || reset == NULL)) return;
+
+	if(b == NULL) {
+		b = g_new0(struct budget, 1);
+		b->rl.limit = -1;
+		g_hash_table_insert(s->budgets, g_strdup(req->budget), b);
+	}
+	if(limit != NULL) b->rl.limit = atoi(limit);
+	if(remaining != NULL) b->rl.remaining = atoi(remaining);
+	if(reset != NULL) b->rl.reset = g_ascii_strtoll(reset, NULL, 10);
+	if(locked_out) {
+		b->rl.remaining = 0;
+		if(reset == NULL) b->rl.reset = (int64_t)time(NULL) + LOCKOUT_SEC;
+	}
+}
+
+
+/* a 304 is answered from the body that was revalidated, so that callers
+ * only ever see a 200.
+ */
+static void note_validators(struct request_sched *s, struct sched_req *req)
+{
+	SoupMessage *msg = req->msg;
+	if(msg->status_code == SOUP_STATUS_NOT_MODIFIED && req->validated != NULL) {
+		soup_message_set_status(msg, SOUP_STATUS_OK);
+		soup_message_body_append_buffer(msg->response_body,
+			req->validated->body);
+		req->validated->used = g_get_monotonic_time();
+		return;
+	}
+	if(msg->status_code != SOUP_STATUS_OK) return;
+
+	const char *etag = soup_message_headers_get_one(msg->response_headers,
+			"ETag"),
+		*modified = soup_message_headers_get_one(msg->response_headers,
+			"Last-Modified");
+	SoupBuffer *body = NULL;
+	if(etag != NULL || modified != NULL) {
+		body = soup_message_body_flatten(msg->response_body);
+		if(body->length > MAX_VALIDATED_BODY) {
+			soup_buffer_free(body);
+			body = NULL;
+		}
+	}
+	if(body == NULL) {
+		g_hash_table_remove(s->validated, req->cache_key);
+		return;
+	}
+
+	struct validated *v = g_hash_table_lookup(s->validated, req->cache_key);
+	if(v == NULL && g_hash_table_size(s->validated) >= MAX_VALIDATED) {
+		/* out goes the least recently used. */
+		GHashTableIter iter;
+		gpointer key, value, oldest = NULL;
+		gint64 oldest_used = G_MAXINT64;
+		g_hash_table_iter_init(&iter, s->validated);
+		while(g_hash_table_iter_next(&iter, &key, &value)) {
+			const struct validated *o = value;
+			if(o->used < oldest_used) {
+				oldest = key;
+				oldest_used = o->used;
+			}
+		}
+		g_hash_table_remove(s->validated, oldest);
+	}
+	v = g_new(struct validated, 1);
+	v->etag = g_strdup(etag);
+	v->last_modified = g_strdup(modified);
+	v->body = body;
+	v->used = g_get_monotonic_time();
+	v->refs = 1;
+	g_hash_table_replace(s->validated, g_strdup(req->cache_key), v);
+}
+
+
+/* with SoupContentDecoder on the session, the headers are as they came and
+ * the body is decoded. Content-Length is what went over the wire. without
+ * it, an uncompressed body is its own size, but a compressed one can't be
+ * told from here; that's `wire_bytes' < 0, and counted apart.
+ */
+static goffset wire_size(SoupMessage *msg)
+{
+	SoupMessageHeaders *h = msg->response_headers;
+	if(msg->status_code == SOUP_STATUS_NOT_MODIFIED) return 0;
+	if(soup_message_headers_get_encoding(h) == SOUP_ENCODING_CONTENT_LENGTH) {
+		return soup_message_headers_get_content_length(h);
+	}
+	const char *coding = soup_message_headers_get_one(h, "Content-Encoding");
+	if(coding == NULL || g_ascii_strcasecmp(coding, "identity") == 0) {
+		return msg->response_body->length;
+	}
+	return -1;
+}
+
+
+static void note_traffic(
+	struct request_sched *s,
+	struct sched_req *req,
+	goffset wire_bytes,
+	bool not_modified)
+{
+	const char *path = soup_uri_get_path(soup_message_get_uri(req->msg));
+	struct traffic_stats *t = g_hash_table_lookup(s->traffic, path);
+	if(t == NULL) {
+		t = g_new0(struct traffic_stats, 1);
+		g_hash_table_insert(s->traffic, g_strdup(path), t);
+	}
+	t->requests++;
+	if(not_modified) t->not_modified++;
+	if(wire_bytes >= 0) t->wire_bytes += wire_bytes;
+	else t->wire_unknown++;
+	t->decoded_bytes += req->msg->response_body->length;
+}
+
+
+static void on_request_done(
+	SoupSession *session,
+	SoupMessage *msg,
+	gpointer dataptr)
+{
+	struct sched_req *req = dataptr;
+	struct request_sched *s = req->sched;
+	s->classes[req->cls].running--;
+	s->running--;
+	note_budget(s, req);
+	if(!SOUP_STATUS_IS_TRANSPORT_ERROR(msg->status_code)) {
+		goffset wire = wire_size(msg);
+		bool not_modified = msg->status_code == SOUP_STATUS_NOT_MODIFIED;
+		if(req->cache_key != NULL) note_validators(s, req);
+		note_traffic(s, req, wire, not_modified);
+	}
+	/* the session unrefs `msg' once we return. */
+	(*req->callback)(session, msg, req->dataptr);
+	sched_req_free(req);
+
+	if(!s->closing) dispatch(s);
+	else if(s->running == 0) sched_destroy(s);
+}
+
+
+static void send_req(struct request_sched *s, struct sched_req *req)
+{
+	struct req_class *rc = &s->classes[req->cls];
+	g_queue_delete_link(&rc->waiting, req->link);
+	req->link = NULL;
+	g_hash_table_remove(s->waiting, req->msg);
+	rc->running++;
+	s->running++;
+
+	struct budget *b = g_hash_table_lookup(s->budgets, req->budget);
+	if(b != NULL) {
+		b->inflight++;
+		b->last_sent = g_get_monotonic_time();
+		req->counted = true;
+	}
+	soup_session_queue_message(s->session, req->msg, &on_request_done, req);
+}
+
+
+static gboolean on_retry(gpointer dataptr)
+{
+	struct request_sched *s = dataptr;
+	s->retry_id = 0;
+	dispatch(s);
+	return FALSE;
+}
+
+
+/* requests held back by their budget are passed over, so that one spent
+ * endpoint doesn't hold up the rest of its class.
+ */
+static void dispatch(struct request_sched *s)
+{
+	gint64 retry_ms = -1;
+	for(int c=0; c < REQ__NUM_CLASSES; c++) {
+		struct req_class *rc = &s->classes[c];
+		GList *next;
+		for(GList *cur = rc->waiting.head;
+			cur != NULL && rc->running < rc->max_conns;
+			cur = next)
+		{
+			next = g_list_next(cur);
+			struct sched_req *req = cur->data;
+			gint64 wait_ms = 0;
+			if(within_budget(s, req, &wait_ms)) send_req(s, req);
+			else if(retry_ms < 0 || wait_ms < retry_ms) retry_ms = wait_ms;
+		}
+	}
+
+	if(s->retry_id != 0) {
+		g_source_remove(s->retry_id);
+		s->retry_id = 0;
+	}
+	if(retry_ms >= 0) s->retry_id = g_timeout_add(retry_ms, &on_retry, s);
+}
+
+
+static void enqueue(struct request_sched *s, struct sched_req *req)
+{
+	struct req_class *rc = &s->classes[req->cls];
+	if(rc->newest_first) {
+		g_queue_push_head(&rc->waiting, req);
+		req->link = rc->waiting.head;
+	} else {
+		g_queue_push_tail(&rc->waiting, req);
+		req->link = rc->waiting.tail;
+	}
+}
+
+
+struct request_sched *request_sched_new(SoupSession *session)
+{
+	struct request_sched *s = g_new0(struct request_sched, 1);
+	s->session = g_object_ref(session);
+	for(int c=0; c < REQ__NUM_CLASSES; c++) {
+		g_queue_init(&s->classes[c].waiting);
+		s->classes[c].max_conns = default_max_conns[c];
+	}
+	/* userpics are wanted for what's on screen now, not for what was. */
+	s->classes[REQ_USERPIC].newest_first = true;
+	s->classes[REQ_USERPIC_PREFETCH].newest_first = true;
+	s->waiting = g_hash_table_new(&g_direct_hash, &g_direct_equal);
+	s->budgets = g_hash_table_new_full(&g_str_hash, &g_str_equal,
+		&g_free, &g_free);
+	s->validated = g_hash_table_new_full(&g_str_hash, &g_str_equal,
+		&g_free, &validated_unref);
+	s->traffic = g_hash_table_new_full(&g_str_hash, &g_str_equal,
+		&g_free, &g_free);
+	return s;
+}
+
+
+/* requests that haven't been sent get their callbacks with
+ * SOUP_STATUS_CANCELLED. those that have are left to finish.
+ */
+void request_sched_free(struct request_sched *s)
+{
+	if(s == NULL) return;
+	s->closing = true;
+
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, s->traffic);
+	while(g_hash_table_iter_next(&iter, &key, &value)) {
+		const struct traffic_stats *t = value;
+		g_debug("%s: %llu requests (%llu not modified), %llu bytes "
+			"received (%llu responses of unknown size), %llu decoded",
+			(const char *)key,
+			(unsigned long long)t->requests,
+			(unsigned long long)t->not_modified,
+			(unsigned long long)t->wire_bytes,
+			(unsigned long long)t->wire_unknown,
+			(unsigned long long)t->decoded_bytes);
+	}
+
+	if(s->retry_id != 0) g_source_remove(s->retry_id);
+	s->retry_id = 0;
+	for(int c=0; c < REQ__NUM_CLASSES; c++) {
+		struct sched_req *req;
+		while((req = g_queue_pop_head(&s->classes[c].waiting)) != NULL) {
+			g_hash_table_remove(s->waiting, req->msg);
+			soup_message_set_status(req->msg, SOUP_STATUS_CANCELLED);
+			(*req->callback)(s->session, req->msg, req->dataptr);
+			g_object_unref(req->msg);
+			sched_req_free(req);
+		}
+	}
+	if(s->running == 0) sched_destroy(s);
+}
+
+
+SoupSession *request_sched_get_session(struct request_sched *s) {
+	return s->session;
+}
+
+
+void request_sched_set_limit(
+	struct request_sched *s,
+	enum request_class cls,
+	int max_conns)
+{
+	g_return_if_fail(cls < REQ__NUM_CLASSES && max_conns > 0);
+	s->classes[cls].max_conns = max_conns;
+	dispatch(s);
+}
+
+
+void request_sched_queue(
+	struct request_sched *s,
+	enum request_class cls,
+	SoupMessage *msg,
+	SoupSessionCallback callback,
+	gpointer dataptr)
+{
+	assert(cls < REQ__NUM_CLASSES);
+	assert(!s->closing);
+	struct sched_req *req = g_slice_new(struct sched_req);
+	req->sched = s;
+	req->msg = msg;
+	req->callback = callback;
+	req->dataptr = dataptr;
+	req->cls = cls;
+	const uint64_t *acct_p = g_object_get_data(G_OBJECT(msg), ACCOUNT_KEY);
+	uint64_t account = acct_p != NULL ? *acct_p : 0;
+	SoupURI *uri = soup_message_get_uri(msg);
+	req->budget = budget_key(account, soup_uri_get_path(uri));
+	req->counted = false;
+
+	/* userpics are kept on disk, and not asked for twice. */
+	req->cache_key = NULL;
+	req->validated = NULL;
+	if(cls != REQ_USERPIC && cls != REQ_USERPIC_PREFETCH
+		&& msg->method == SOUP_METHOD_GET)
+	{
+		req->cache_key = cache_key(account, uri);
+		struct validated *v = g_hash_table_lookup(s->validated,
+			req->cache_key);
+		if(v != NULL) {
+			req->validated = v;
+			v->refs++;
+		}
+		if(v != NULL && v->etag != NULL) {
+			soup_message_headers_replace(msg->request_headers,
+				"If-None-Match", v->etag);
+		}
+		if(v != NULL && v->last_modified != NULL) {
+			soup_message_headers_replace(msg->request_headers,
+				"If-Modified-Since", v->last_modified);
+		}
+	}
+	enqueue(s, req);
+	g_hash_table_insert(s->waiting, msg, req);
+	dispatch(s);
+}
+
+
+bool request_sched_promote(
+	struct request_sched *s,
+	SoupMessage *msg,
+	enum request_class cls)
+{
+	struct sched_req *req = g_hash_table_lookup(s->waiting, msg);
+	if(req == NULL) return false;
+	struct req_class *old = &s->classes[req->cls];
+	if(cls > req->cls) return true;		/* never demoted */
+	if(cls == req->cls
+		&& (!old->newest_first || req->link == old->waiting.head))
+	{
+		return true;
+	}
+
+	g_queue_delete_link(&old->waiting, req->link);
+	req->cls = cls;
+	enqueue(s, req);
+	dispatch(s);
+	return true;
+}
+
+
+void request_sched_cancel(struct request_sched *s, SoupMessage *msg)
+{
+	struct sched_req *req = g_hash_table_lookup(s->waiting, msg);
+	if(req == NULL) {
+		soup_session_cancel_message(s->session, msg, SOUP_STATUS_CANCELLED);
+		return;
+	}
+
+	g_queue_delete_link(&s->classes[req->cls].waiting, req->link);
+	g_hash_table_remove(s->waiting, msg);
+	soup_message_set_status(msg, SOUP_STATUS_CANCELLED);
+	(*req->callback)(s->session, msg, req->dataptr);
+	g_object_unref(msg);
+	sched_req_free(req);
+}
+
+
+void request_sched_set_account(SoupMessage *msg, uint64_t account)
+{
+	g_object_set_data_full(G_OBJECT(msg), ACCOUNT_KEY,
+		g_memdup(&account, sizeof(account)), &g_free);
+}
+
+
+bool request_sched_get_rate_limit(
+	struct request_sched *s,
+	uint64_t account,
+	const char *endpoint,
+	struct rate_limit *out)
+{
+	char *key = budget_key(account, endpoint);
+	const struct budget *b = g_hash_table_lookup(s->budgets, key);
+	g_free(key);
+	if(b != NULL) *out = b->rl;
+	return b != NULL;
+}
+
+
+bool request_sched_get_traffic(
+	struct request_sched *s,
+	const char *endpoint,
+	struct traffic_stats *out)
+{
+	const struct traffic_stats *t = g_hash_table_lookup(s->traffic, endpoint);
+	if(t != NULL) *out = *t;
+	return t != NULL;
+}
+
+
+int request_sched_waiting(struct request_sched *s, enum request_class cls) {
+	return g_queue_get_length(&s->classes[cls].waiting);
+}
+
+
+int request_sched_running(struct request_sched *s, enum request_class cls) {
+	return s->classes[cls].running;
+}
@@ -44,6 +44,7 @@ struct piiptyyt_state *state_empty(void)
 	state->auth_secret = NULL;
 	state->username = NULL;
 	state->userid = 0;
+	state->signer = NULL;
 	return state;
 }
 
@@ -53,11 +54,50 @@ void state_free(struct piiptyyt_state *st)
 	g_free(st->username);
 	g_free(st->auth_token);
 	g_free(st->auth_secret);
+	oa_signer_free(st->signer);
 	g_free(st);
 }
 
 
-bool state_write(const struct piiptyyt_state *st, GError **err_p)
+/* the first account lives in "auth", as it did before there were several;
+ * the n'th after it in "auth n".
+ */
+static char *account_group(guint n) {
+	return n == 0 ? g_strdup("auth") : g_strdup_printf("auth %u", n);
+}
+
+
+static void write_account(
+	GKeyFile *kf,
+	const char *group,
+	const struct piiptyyt_state *st)
+{
+	if(st->username != NULL) {
+		g_key_file_set_string(kf, group, "username", st->username);
+	}
+	if(st->auth_token != NULL) {
+		g_key_file_set_string(kf, group, "auth_token", st->auth_token);
+	}
+	if(st->auth_secret != NULL) {
+		g_key_file_set_string(kf, group, "auth_secret", st->auth_secret);
+	}
+	g_key_file_set_uint64(kf, group, "userid", st->userid);
+}
+
+
+static struct piiptyyt_state *read_account(GKeyFile *kf, const char *group)
+{
+	struct piiptyyt_state *st = g_new(struct piiptyyt_state, 1);
+	st->username = g_key_file_get_string(kf, group, "username", NULL);
+	st->auth_token = g_key_file_get_string(kf, group, "auth_token", NULL);
+	st->auth_secret = g_key_file_get_string(kf, group, "auth_secret", NULL);
+	st->userid = g_key_file_get_uint64(kf, group, "userid", NULL);
+	st->signer = NULL;
+	return st;
+}
+
+
+bool state_write_accounts(GPtrArray *accounts, GError **err_p)
 {
 	const char *path = state_path();
 	int fd = open(path, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
@@ -75,10 +115,11 @@ bool state_write(const struct piiptyyt_state *st, GError **err_p)
 	}
 
 	GKeyFile *kf = g_key_file_new();
-	g_key_file_set_string(kf, "auth", "username", st->username);
-	g_key_file_set_string(kf, "auth", "auth_token", st->auth_token);
-	g_key_file_set_string(kf, "auth", "auth_secret", st->auth_secret);
-	g_key_file_set_uint64(kf, "auth", "userid", st->userid);
+	for(guint i=0; i < accounts->len; i++) {
+		char *group = account_group(i);
+		write_account(kf, group, g_ptr_array_index(accounts, i));
+		g_free(group);
+	}
 
 	gsize length = 0;
 	gchar *contents = g_key_file_to_data(kf, &length, err_p);
@@ -116,7 +157,7 @@ bool state_write(const struct piiptyyt_state *st, GError **err_p)
 }
 
 
-struct piiptyyt_state *state_read(GError **err_p)
+GPtrArray *state_read_accounts(GError **err_p)
 {
 	gchar *contents = NULL;
 	gsize length = 0;
@@ -131,18 +172,22 @@ struct piiptyyt_state *state_read(GError **err_p)
 		}
 	}
 
-	struct piiptyyt_state *st = NULL;
+	GPtrArray *accounts = NULL;
 	GKeyFile *kf = g_key_file_new();
 	gboolean ok = g_key_file_load_from_data(kf, contents, length, 0, err_p);
 	if(ok) {
-		st = g_new(struct piiptyyt_state, 1);
-		st->username = g_key_file_get_string(kf, "auth", "username", NULL);
-		st->auth_token = g_key_file_get_string(kf, "auth", "auth_token", NULL);
-		st->auth_secret = g_key_file_get_string(kf, "auth", "auth_secret", NULL);
-		st->userid = g_key_file_get_uint64(kf, "auth", "userid", NULL);
+		accounts = g_ptr_array_new_with_free_func(
+			(GDestroyNotify)&state_free);
+		for(guint i=0; ; i++) {
+			char *group = account_group(i);
+			bool found = g_key_file_has_group(kf, group);
+			if(found) g_ptr_array_add(accounts, read_account(kf, group));
+			g_free(group);
+			if(!found) break;
+		}
 	}
 	g_key_file_free(kf);
 	g_free(contents);
 
-	return st;
+	return accounts;
 }
@@ -0,0 +1,222 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <libsoup/soup.h>
+
+#include "defs.h"
+
+
+/* the server sends a blank line every 30 seconds or so when there's nothing
+ * else to send. a connection that's been silent for STALL_SEC is taken to be
+ * dead.
+ */
+#define STALL_SEC 90
+
+/* reconnection delays, after the streaming API guidelines: network errors
+ * and clean disconnects back off linearly, HTTP errors exponentially, and
+ * rate limiting exponentially from a minute.
+ */
+#define NET_BACKOFF_STEP_MS 250
+#define NET_BACKOFF_MAX_MS (16 * 1000)
+#define HTTP_BACKOFF_MIN_MS (5 * 1000)
+#define HTTP_BACKOFF_MAX_MS (320 * 1000)
+#define RATE_BACKOFF_MIN_MS (60 * 1000)
+
+
+/* a long-lived request whose response body is newline-delimited messages.
+ * chunks are framed into lines as they arrive and handed over in batches,
+ * one per chunk that completed at least one line.
+ */
+struct stream
+{
+	SoupSession *session;
+	stream_request_fn request_fn;
+	stream_lines_fn lines_fn;
+	void *dataptr;
+
+	SoupMessage *msg;		/* the connection, or NULL between them */
+	GString *partial;		/* bytes after the last line break */
+	bool live;				/* current connection got a 200 */
+	unsigned connection;	/* bumped as each one goes live */
+	bool closing;
+	unsigned backoff_ms;
+	gint64 last_data;		/* monotonic */
+	guint reconnect_id, stall_id;
+};
+
+
+static void stream_connect(struct stream *s);
+
+
+static void stream_destroy(struct stream *s)
+{
+	g_string_free(s->partial, TRUE);
+	g_object_unref(s->session);
+	g_free(s);
+}
+
+
+/* splits what's arrived into lines and passes along those that aren't
+ * keep-alives. only the tail after the last line break is kept.
+ */
+static void on_got_chunk(SoupMessage *msg, SoupBuffer *chunk, gpointer dataptr)
+{
+	struct stream *s = dataptr;
+	s->last_data = g_get_monotonic_time();
+	if(!SOUP_STATUS_IS_SUCCESSFUL(msg->status_code)) return;
+	if(!s->live) {
+		s->live = true;
+		s->connection++;
+		s->backoff_ms = 0;
+	}
+
+	size_t head = chunk->length;
+	while(head > 0 && chunk->data[head - 1] != '\n') head--;
+	if(head == 0) {
+		g_string_append_len(s->partial, chunk->data, chunk->length);
+		return;
+	}
+	g_string_append_len(s->partial, chunk->data, head);
+
+	GPtrArray *lines = g_ptr_array_new();
+	char *text = s->partial->str;
+	for(char *line = text, *end; line < text + s->partial->len; line = end + 1) {
+		end = strchr(line, '\n');
+		*end = '\0';
+		if(end > line && end[-1] == '\r') end[-1] = '\0';
+		if(line[0] != '\0') g_ptr_array_add(lines, line);
+	}
+	if(lines->len > 0) {
+		g_ptr_array_add(lines, NULL);
+		(*s->lines_fn)((const char *const *)lines->pdata, lines->len - 1,
+			s->dataptr);
+	}
+	g_ptr_array_free(lines, TRUE);
+
+	g_string_truncate(s->partial, 0);
+	g_string_append_len(s->partial, chunk->data + head, chunk->length - head);
+}
+
+
+static gboolean on_reconnect(gpointer dataptr)
+{
+	struct stream *s = dataptr;
+	s->reconnect_id = 0;
+	stream_connect(s);
+	return FALSE;
+}
+
+
+static void on_stream_finished(
+	SoupSession *session,
+	SoupMessage *msg,
+	gpointer dataptr)
+{
+	struct stream *s = dataptr;
+	g_signal_handlers_disconnect_by_func(msg, &on_got_chunk, s);
+	g_object_unref(s->msg);
+	s->msg = NULL;
+	s->live = false;
+	g_string_truncate(s->partial, 0);
+	if(s->closing) {
+		/* stream_free() left it to us. */
+		stream_destroy(s);
+		return;
+	}
+
+	guint status = msg->status_code;
+	if(status == 420 || status == 429) {
+		s->backoff_ms = MAX(s->backoff_ms * 2, RATE_BACKOFF_MIN_MS);
+	} else if(!SOUP_STATUS_IS_TRANSPORT_ERROR(status)
+		&& !SOUP_STATUS_IS_SUCCESSFUL(status))
+	{
+		s->backoff_ms = CLAMP(s->backoff_ms * 2, HTTP_BACKOFF_MIN_MS,
+			HTTP_BACKOFF_MAX_MS);
+	} else {
+		s->backoff_ms = MIN(s->backoff_ms + NET_BACKOFF_STEP_MS,
+			NET_BACKOFF_MAX_MS);
+	}
+	g_debug("%s: stream ended with %u %s; reconnecting in %u ms", __func__,
+		status, soup_status_get_phrase(status), s->backoff_ms);
+	s->reconnect_id = g_timeout_add(s->backoff_ms, &on_reconnect, s);
+}
+
+
+static gboolean on_stall_check(gpointer dataptr)
+{
+	struct stream *s = dataptr;
+	if(s->msg != NULL
+		&& g_get_monotonic_time() - s->last_data > STALL_SEC * G_USEC_PER_SEC)
+	{
+		g_debug("%s: no data in %d seconds", __func__, STALL_SEC);
+		soup_session_cancel_message(s->session, s->msg, SOUP_STATUS_IO_ERROR);
+	}
+	return TRUE;
+}
+
+
+static void stream_connect(struct stream *s)
+{
+	assert(s->msg == NULL);
+	s->msg = (*s->request_fn)(s->dataptr);
+	if(s->msg == NULL) {
+		/* try again later, as for an HTTP error. */
+		s->backoff_ms = CLAMP(s->backoff_ms * 2, HTTP_BACKOFF_MIN_MS,
+			HTTP_BACKOFF_MAX_MS);
+		s->reconnect_id = g_timeout_add(s->backoff_ms, &on_reconnect, s);
+		return;
+	}
+
+	soup_message_body_set_accumulate(s->msg->response_body, FALSE);
+	g_signal_connect(s->msg, "got-chunk", G_CALLBACK(&on_got_chunk), s);
+	s->last_data = g_get_monotonic_time();
+	/* the session's reference is dropped when it's done; this one is ours. */
+	soup_session_queue_message(s->session, g_object_ref(s->msg),
+		&on_stream_finished, s);
+}
+
+
+struct stream *stream_new(
+	SoupSession *session,
+	stream_request_fn request_fn,
+	stream_lines_fn lines_fn,
+	void *dataptr)
+{
+	struct stream *s = g_new0(struct stream, 1);
+	s->session = g_object_ref(session);
+	s->request_fn = request_fn;
+	s->lines_fn = lines_fn;
+	s->dataptr = dataptr;
+	s->partial = g_string_sized_new(4096);
+	s->stall_id = g_timeout_add_seconds(STALL_SEC / 3, &on_stall_check, s);
+	stream_connect(s);
+	return s;
+}
+
+
+bool stream_is_live(struct stream *s) {
+	return s->live;
+}
+
+
+unsigned stream_connection(struct stream *s) {
+	return s->connection;
+}
+
+
+void stream_free(struct stream *s)
+{
+	if(s->reconnect_id != 0) g_source_remove(s->reconnect_id);
+	g_source_remove(s->stall_id);
+	if(s->msg == NULL) stream_destroy(s);
+	else {
+		/* the finished callback has the last word, whenever it runs. */
+		s->closing = true;
+		soup_session_cancel_message(s->session, s->msg, SOUP_STATUS_CANCELLED);
+	}
+}
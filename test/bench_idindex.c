@@ -0,0 +1,138 @@
+/* times the timeline id index at 10k, 100k and 1M ids against the
+ * copy-and-qsort scheme it replaced.
+ *
+ * each run feeds the ids in as batches of 20: mostly new ids on top, with
+ * every fourth batch a backfill that lands somewhere in the middle. each id
+ * goes in the way PtTimelineModel takes it, an insert and then a position
+ * lookup for its row-inserted. then it does a round of nth() and position()
+ * lookups, as rows are drawn.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+
+#include "defs.h"
+
+
+#define BATCH 20
+
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static int cmp_id_desc(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x > y ? -1 : (x < y ? 1 : 0);
+}
+
+
+/* generates `n' distinct ids in batches of BATCH, each sorted largest first.
+ * ids go up by 8 per status; backfills take from the gaps in between.
+ */
+static uint64_t *make_batches(size_t n, GRand *rnd)
+{
+	uint64_t *out = g_new(uint64_t, n), top = 1000000;
+	for(size_t b=0; b < n; b += BATCH) {
+		size_t k = MIN(BATCH, n - b);
+		bool backfill = b > 0 && (b / BATCH) % 4 == 3;
+		for(size_t i=0; i < k; i++) {
+			if(backfill) {
+				uint64_t base = 1000000 + 8 * g_rand_int_range(rnd,
+					0, (top - 1000000) / 8);
+				out[b + i] = base + 1 + (b / BATCH) % 7;
+			} else {
+				top += 8;
+				out[b + i] = top;
+			}
+		}
+		qsort(&out[b], k, sizeof(uint64_t), &cmp_id_desc);
+	}
+	return out;
+}
+
+
+static void bench_index(const uint64_t *ids, size_t n, GRand *rnd)
+{
+	struct id_index *ix = id_index_new();
+
+	double t0 = now();
+	uint64_t pos_sum = 0;
+	for(size_t i=0; i < n; i++) {
+		if(id_index_insert(ix, ids[i])) {
+			pos_sum += id_index_position(ix, ids[i]);
+		}
+	}
+	double t1 = now();
+
+	size_t count = id_index_count(ix);
+	uint64_t sum = 0;
+	for(int i=0; i < 100000; i++) {
+		uint64_t id = id_index_nth(ix, g_rand_int_range(rnd, 0, count));
+		sum += id_index_position(ix, id);
+	}
+	double t2 = now();
+
+	printf("  index: %zu ids, insert+position %.3f s, 100k lookups %.3f s"
+		" (%llu)\n", count, t1 - t0, t2 - t1,
+		(unsigned long long)(sum + pos_sum));
+	id_index_free(ix);
+}
+
+
+/* the old scheme: copy into a new array, then qsort when the batch doesn't
+ * go on top.
+ */
+static void bench_qsort(const uint64_t *ids, size_t n)
+{
+	uint64_t *cur = NULL;
+	size_t count = 0;
+
+	double t0 = now();
+	for(size_t b=0; b < n; b += BATCH) {
+		size_t k = MIN(BATCH, n - b);
+		uint64_t *next = g_new(uint64_t, count + k);
+		if(count == 0 || ids[b + k - 1] > cur[0]) {
+			memcpy(next, &ids[b], sizeof(uint64_t) * k);
+			memcpy(&next[k], cur, sizeof(uint64_t) * count);
+			count += k;
+		} else {
+			memcpy(next, cur, sizeof(uint64_t) * count);
+			memcpy(&next[count], &ids[b], sizeof(uint64_t) * k);
+			count += k;
+			qsort(next, count, sizeof(uint64_t), &cmp_id_desc);
+		}
+		g_free(cur);
+		cur = next;
+	}
+	double t1 = now();
+
+	printf("  qsort: %zu ids, insert %.3f s\n", count, t1 - t0);
+	g_free(cur);
+}
+
+
+int main(void)
+{
+	static const size_t sizes[] = { 10000, 100000, 1000000 };
+	GRand *rnd = g_rand_new_with_seed(0xb7ee);
+	for(int i=0; i < G_N_ELEMENTS(sizes); i++) {
+		uint64_t *ids = make_batches(sizes[i], rnd);
+		printf("%zu ids:\n", sizes[i]);
+		bench_index(ids, sizes[i], rnd);
+		/* a million takes the old way several minutes. */
+		if(sizes[i] <= 100000) bench_qsort(ids, sizes[i]);
+		g_free(ids);
+	}
+	g_rand_free(rnd);
+	return EXIT_SUCCESS;
+}
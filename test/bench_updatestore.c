@@ -0,0 +1,134 @@
+/* measures the heap taken per update at 10k and 100k updates, kept as
+ * PtUpdate objects with their markup (as the list store used to hold them)
+ * against the same updates in an update_store.
+ *
+ * the figures come from glibc's mallinfo2(), so this is glibc only. the
+ * store's count includes the facades it keeps around for drawing.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <malloc.h>
+#include <glib.h>
+#include <glib-object.h>
+
+#include "defs.h"
+#include "pt-update.h"
+#include "pt-user-info.h"
+#include "pt-cache.h"
+
+
+#define N_USERS 200
+
+
+static const char *const words[] = {
+	"the", "a", "lunch", "train", "late", "again", "http://t.co/x1y2z3",
+	"#news", "@someone", "really", "today", "weather", "code", "review",
+	"coffee", "meeting", "shipped", "bug", "tonight", "weekend",
+};
+
+
+static size_t heap_now(void)
+{
+	struct mallinfo2 mi = mallinfo2();
+	return mi.uordblks + mi.hblkhd;
+}
+
+
+/* an update of 8 to 24 words by one of N_USERS authors, sourced from one of
+ * a few clients, shaped like what a home timeline brings.
+ */
+static PtUpdate *make_update(GRand *rnd, PtUserInfo **users, uint64_t id)
+{
+	static const char *const sources[] = { "web", "Tweetdeck", "piiptyyt" };
+	GString *text = g_string_sized_new(160);
+	int n_words = g_rand_int_range(rnd, 8, 25);
+	for(int i=0; i < n_words; i++) {
+		if(i > 0) g_string_append_c(text, ' ');
+		g_string_append(text,
+			words[g_rand_int_range(rnd, 0, G_N_ELEMENTS(words))]);
+	}
+
+	PtUpdate *u = pt_update_new();
+	u->id = id;
+	u->text = g_string_free(text, FALSE);
+	u->source = sources[id % G_N_ELEMENTS(sources)];
+	u->timestamp = g_date_time_new_from_unix_utc(1300000000 + id / 4);
+	u->user = g_object_ref(users[g_rand_int_range(rnd, 0, N_USERS)]);
+	if(id % 5 == 0) u->in_rep_to_sid = id - 100;
+	return u;
+}
+
+
+static void bench_objects(size_t n, PtUserInfo **users)
+{
+	GRand *rnd = g_rand_new_with_seed(0x57023);
+	size_t before = heap_now();
+	GPtrArray *all = g_ptr_array_new_with_free_func(&g_object_unref);
+	for(size_t i=0; i < n; i++) {
+		PtUpdate *u = make_update(rnd, users, 1000000 + i * 8);
+		pt_update_render_markup(u, u->user->screenname);
+		g_ptr_array_add(all, u);
+	}
+	size_t used = heap_now() - before;
+	printf("  objects: %zu bytes, %.1f per update\n", used,
+		(double)used / n);
+	g_ptr_array_free(all, TRUE);
+	g_rand_free(rnd);
+}
+
+
+static void bench_store(size_t n, PtUserInfo **users, PtCache *uc)
+{
+	GRand *rnd = g_rand_new_with_seed(0x57023);
+	size_t before = heap_now();
+	struct update_store *s = update_store_new(uc);
+	for(size_t i=0; i < n; i++) {
+		PtUpdate *u = make_update(rnd, users, 1000000 + i * 8);
+		pt_update_render_markup(u, u->user->screenname);
+		update_store_add(s, u);
+		g_object_unref(u);
+	}
+	size_t used = heap_now() - before;
+	printf("  store:   %zu bytes, %.1f per update\n", used,
+		(double)used / n);
+	update_store_free(s);
+	g_rand_free(rnd);
+}
+
+
+int main(void)
+{
+	g_type_init();
+
+	/* users are shared by both sides, so they're left out of the count. */
+	PtCache *uc = PT_CACHE(g_object_new(PT_CACHE_TYPE,
+		"hash-fn", &g_int64_hash, "equal-fn", &g_int64_equal,
+		"high-watermark", 2 * N_USERS, "low-watermark", N_USERS + 1,
+		NULL));
+	PtUserInfo *users[N_USERS];
+	for(int i=0; i < N_USERS; i++) {
+		users[i] = pt_user_info_new();
+		users[i]->id = 5000 + i;
+		users[i]->screenname = g_strdup_printf("user%d", i);
+		users[i]->longname = g_strdup_printf("User Number %d", i);
+		pt_cache_put(uc, &users[i]->id, 0, G_OBJECT(users[i]));
+	}
+
+	/* a round to warm up the type system and the thread-local caches. */
+	printf("1000 updates, warming up:\n");
+	bench_objects(1000, users);
+
+	static const size_t sizes[] = { 10000, 100000 };
+	for(int i=0; i < G_N_ELEMENTS(sizes); i++) {
+		printf("%zu updates:\n", sizes[i]);
+		bench_objects(sizes[i], users);
+		bench_store(sizes[i], users, uc);
+	}
+
+	for(int i=0; i < N_USERS; i++) g_object_unref(users[i]);
+	g_object_unref(uc);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,238 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include <check.h>
+
+#include "defs.h"
+
+
+/* ids are kept largest first, so that's the order positions come in. */
+static int cmp_id_desc(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x > y ? -1 : (x < y ? 1 : 0);
+}
+
+
+static void check_against(struct id_index *ix, const uint64_t *ref, size_t n)
+{
+	fail_unless(id_index_count(ix) == n);
+	for(size_t i=0; i < n; i++) {
+		fail_unless(id_index_nth(ix, i) == ref[i]);
+		fail_unless(id_index_position(ix, ref[i]) == (ssize_t)i);
+	}
+}
+
+
+static void insert_all(struct id_index *ix, const uint64_t *ids, size_t n)
+{
+	for(size_t i=0; i < n; i++) fail_unless(id_index_insert(ix, ids[i]));
+}
+
+
+START_TEST(empty_index)
+{
+	struct id_index *ix = id_index_new();
+	fail_unless(id_index_count(ix) == 0);
+	fail_unless(id_index_position(ix, 1234) == -1);
+	id_index_free(ix);
+}
+END_TEST
+
+
+START_TEST(prepend_batches)
+{
+	struct id_index *ix = id_index_new();
+	uint64_t next = 1000;
+	for(int b=0; b < 100; b++) {
+		uint64_t batch[20];
+		for(int i=0; i < 20; i++) batch[i] = next + 19 - i;
+		next += 20;
+		/* each goes in below the one before it, as the model inserts them. */
+		for(int i=0; i < 20; i++) {
+			fail_unless(id_index_insert(ix, batch[i]));
+			fail_unless(id_index_position(ix, batch[i]) == i);
+		}
+	}
+
+	fail_unless(id_index_count(ix) == 2000);
+	for(size_t i=0; i < 2000; i++) {
+		fail_unless(id_index_nth(ix, i) == next - 1 - i);
+	}
+	fail_unless(id_index_position(ix, 999) == -1);
+	fail_unless(id_index_position(ix, next) == -1);
+
+	id_index_free(ix);
+}
+END_TEST
+
+
+START_TEST(skip_duplicates)
+{
+	struct id_index *ix = id_index_new();
+	uint64_t first[] = { 50, 40, 30, 20, 10 },
+		second[] = { 45, 40, 40, 25, 10, 5 };
+	insert_all(ix, first, 5);
+
+	ssize_t pos[6];
+	size_t added = 0;
+	for(int i=0; i < 6; i++) {
+		if(id_index_insert(ix, second[i])) {
+			pos[added++] = id_index_position(ix, second[i]);
+		}
+	}
+	fail_unless(added == 3);
+	/* 50 45 40 30 25 20 10 5 */
+	fail_unless(pos[0] == 1);
+	fail_unless(pos[1] == 4);
+	fail_unless(pos[2] == 7);
+
+	fail_unless(!id_index_insert(ix, 30));
+	fail_unless(id_index_count(ix) == 8);
+	id_index_free(ix);
+}
+END_TEST
+
+
+/* interleaved batches against a sorted array. enough of them to get a few
+ * levels of interior nodes.
+ */
+START_TEST(random_interleave)
+{
+	GRand *rnd = g_rand_new_with_seed(0xb7ee);
+	struct id_index *ix = id_index_new();
+	GArray *ref = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+
+	for(int b=0; b < 200; b++) {
+		int n = g_rand_int_range(rnd, 1, 300);
+		uint64_t batch[300];
+		for(int i=0; i < n; i++) {
+			batch[i] = g_rand_int_range(rnd, 1, 100000);
+		}
+		qsort(batch, n, sizeof(uint64_t), &cmp_id_desc);
+
+		for(int i=0; i < n; i++) {
+			if(!id_index_insert(ix, batch[i])) continue;
+			/* where the model emits row-inserted. */
+			ssize_t pos = id_index_position(ix, batch[i]);
+			fail_unless(pos >= 0 && (size_t)pos < id_index_count(ix));
+			fail_unless(id_index_nth(ix, pos) == batch[i]);
+			bool found = false;
+			for(guint j=0; j < ref->len && !found; j++) {
+				found = g_array_index(ref, uint64_t, j) == batch[i];
+			}
+			fail_if(found);
+			g_array_append_val(ref, batch[i]);
+		}
+		g_array_sort(ref, &cmp_id_desc);
+		fail_unless(id_index_count(ix) == ref->len);
+	}
+	check_against(ix, (const uint64_t *)ref->data, ref->len);
+
+	g_array_free(ref, TRUE);
+	id_index_free(ix);
+	g_rand_free(rnd);
+}
+END_TEST
+
+
+START_TEST(truncate_and_regrow)
+{
+	struct id_index *ix = id_index_new();
+	uint64_t ids[5000];
+	for(int i=0; i < 5000; i++) ids[i] = 100000 - i * 10;
+	insert_all(ix, ids, 5000);
+
+	id_index_truncate(ix, 6000);
+	fail_unless(id_index_count(ix) == 5000);
+	id_index_truncate(ix, 1234);
+	check_against(ix, ids, 1234);
+	fail_unless(id_index_position(ix, ids[1234]) == -1);
+
+	/* refill the tail through the sparse right edge. */
+	insert_all(ix, &ids[1234], 5000 - 1234);
+	check_against(ix, ids, 5000);
+
+	id_index_truncate(ix, 1);
+	check_against(ix, ids, 1);
+	id_index_truncate(ix, 0);
+	fail_unless(id_index_count(ix) == 0);
+	fail_unless(id_index_insert(ix, 5));
+	fail_unless(id_index_nth(ix, 0) == 5);
+
+	id_index_free(ix);
+}
+END_TEST
+
+
+START_TEST(remove_ids)
+{
+	GRand *rnd = g_rand_new_with_seed(0x3117);
+	struct id_index *ix = id_index_new();
+	uint64_t ids[3000];
+	for(int i=0; i < 3000; i++) ids[i] = 50000 - i * 7;
+	insert_all(ix, ids, 3000);
+
+	fail_if(id_index_remove(ix, 50001));
+	size_t n = 3000;
+	while(n > 0) {
+		int victim = g_rand_int_range(rnd, 0, n);
+		fail_unless(id_index_remove(ix, ids[victim]));
+		fail_if(id_index_remove(ix, ids[victim]));
+		memmove(&ids[victim], &ids[victim + 1],
+			sizeof(uint64_t) * (n - victim - 1));
+		n--;
+		if(n % 250 == 0) check_against(ix, ids, n);
+	}
+	fail_unless(id_index_count(ix) == 0);
+	fail_unless(id_index_insert(ix, 77));
+	fail_unless(id_index_position(ix, 77) == 0);
+
+	id_index_free(ix);
+	g_rand_free(rnd);
+}
+END_TEST
+
+
+/* ranks of ids that are present, between them, and past either end. */
+START_TEST(rank_ids)
+{
+	struct id_index *ix = id_index_new();
+	fail_unless(id_index_rank(ix, 10) == 0);
+	/* 10000, 9990, ... 10, over several leaves. */
+	for(int i=1; i <= 1000; i++) fail_unless(id_index_insert(ix, i * 10));
+
+	fail_unless(id_index_rank(ix, 20000) == 0);
+	fail_unless(id_index_rank(ix, 10000) == 0);
+	fail_unless(id_index_rank(ix, 9999) == 1);
+	fail_unless(id_index_rank(ix, 5) == 1000);
+	for(int i=1; i <= 1000; i++) {
+		size_t above = 1000 - i;
+		fail_unless(id_index_rank(ix, i * 10) == above);
+		fail_unless(id_index_rank(ix, i * 10 + 1) == above);
+		fail_unless(id_index_rank(ix, i * 10 - 1) == above + 1);
+	}
+
+	id_index_free(ix);
+}
+END_TEST
+
+
+Suite *id_index_suite(void)
+{
+	Suite *s = suite_create("id_index");
+
+	TCase *tc_iface = tcase_create("interface");
+	suite_add_tcase(s, tc_iface);
+	tcase_add_test(tc_iface, empty_index);
+	tcase_add_test(tc_iface, prepend_batches);
+	tcase_add_test(tc_iface, skip_duplicates);
+	tcase_add_test(tc_iface, random_interleave);
+	tcase_add_test(tc_iface, truncate_and_regrow);
+	tcase_add_test(tc_iface, remove_ids);
+	tcase_add_test(tc_iface, rank_ids);
+
+	return s;
+}
@@ -0,0 +1,139 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <glib.h>
+#include <check.h>
+
+#include "defs.h"
+
+
+static void check_ranges(
+	const struct id_ranges *r,
+	const struct id_range *expect,
+	size_t n)
+{
+	fail_unless(id_ranges_count(r) == n, "count %zu, expected %zu",
+		id_ranges_count(r), n);
+	for(size_t i=0; i < n; i++) {
+		const struct id_range *x = id_ranges_nth(r, i);
+		fail_unless(x->lo == expect[i].lo && x->hi == expect[i].hi,
+			"range %zu is [%llu, %llu], expected [%llu, %llu]", i,
+			(unsigned long long)x->lo, (unsigned long long)x->hi,
+			(unsigned long long)expect[i].lo,
+			(unsigned long long)expect[i].hi);
+	}
+}
+
+
+START_TEST(merge_and_gaps)
+{
+	struct id_ranges *r = id_ranges_new();
+	GArray *gaps = g_array_new(FALSE, FALSE, sizeof(struct id_range));
+	fail_unless(id_ranges_gaps(r, gaps) == 0);
+
+	id_ranges_add(r, 100, 200);
+	id_ranges_add(r, 10, 20);
+	id_ranges_add(r, 500, 600);
+	check_ranges(r, (struct id_range[]){
+		{ 10, 20 }, { 100, 200 }, { 500, 600 } }, 3);
+
+	/* newest first. */
+	fail_unless(id_ranges_gaps(r, gaps) == 2);
+	fail_unless(g_array_index(gaps, struct id_range, 0).lo == 201);
+	fail_unless(g_array_index(gaps, struct id_range, 0).hi == 499);
+	fail_unless(g_array_index(gaps, struct id_range, 1).lo == 21);
+	fail_unless(g_array_index(gaps, struct id_range, 1).hi == 99);
+
+	/* adjoining ranges merge; so does one that spans several. */
+	id_ranges_add(r, 201, 250);
+	id_ranges_add(r, 21, 21);
+	check_ranges(r, (struct id_range[]){
+		{ 10, 21 }, { 100, 250 }, { 500, 600 } }, 3);
+	id_ranges_add(r, 15, 550);
+	check_ranges(r, (struct id_range[]){ { 10, 600 } }, 1);
+
+	fail_unless(id_ranges_contains(r, 10));
+	fail_unless(id_ranges_contains(r, 600));
+	fail_if(id_ranges_contains(r, 9));
+	fail_if(id_ranges_contains(r, 601));
+
+	g_array_free(gaps, TRUE);
+	id_ranges_free(r);
+}
+END_TEST
+
+
+START_TEST(limit_drops_oldest)
+{
+	struct id_ranges *r = id_ranges_new();
+	for(int i=0; i < 10; i++) id_ranges_add(r, i * 10, i * 10 + 5);
+	id_ranges_limit(r, 3);
+	check_ranges(r, (struct id_range[]){
+		{ 70, 75 }, { 80, 85 }, { 90, 95 } }, 3);
+
+	struct id_ranges *c = id_ranges_copy(r);
+	id_ranges_add(c, 76, 79);
+	check_ranges(c, (struct id_range[]){ { 70, 85 }, { 90, 95 } }, 2);
+	fail_unless(id_ranges_count(r) == 3);
+
+	id_ranges_free(c);
+	id_ranges_free(r);
+}
+END_TEST
+
+
+/* against a bitmap over a small universe. */
+START_TEST(compare_naive)
+{
+	enum { UNIVERSE = 300 };
+	GRand *rng = g_rand_new_with_seed(0xd00d1e);
+	for(int round=0; round < 50; round++) {
+		struct id_ranges *r = id_ranges_new();
+		bool set[UNIVERSE] = { false };
+		for(int i=0; i < 20; i++) {
+			int lo = g_rand_int_range(rng, 1, UNIVERSE),
+				len = g_rand_int_range(rng, 0, 15),
+				hi = MIN(UNIVERSE - 1, lo + len);
+			id_ranges_add(r, lo, hi);
+			for(int j=lo; j <= hi; j++) set[j] = true;
+		}
+
+		size_t runs = 0;
+		for(int j=0; j < UNIVERSE; j++) {
+			fail_unless(id_ranges_contains(r, j) == set[j], "id %d", j);
+			if(set[j] && (j == 0 || !set[j - 1])) runs++;
+		}
+		fail_unless(id_ranges_count(r) == runs);
+		for(size_t i=0; i + 1 < id_ranges_count(r); i++) {
+			/* disjoint, and not adjoining. */
+			fail_unless(id_ranges_nth(r, i)->hi + 1 < id_ranges_nth(r, i + 1)->lo);
+		}
+
+		GArray *gaps = g_array_new(FALSE, FALSE, sizeof(struct id_range));
+		fail_unless(id_ranges_gaps(r, gaps) == runs - 1);
+		for(guint i=0; i < gaps->len; i++) {
+			const struct id_range *g = &g_array_index(gaps, struct id_range, i);
+			for(uint64_t j = g->lo; j <= g->hi; j++) fail_if(set[j]);
+			fail_unless(set[g->lo - 1] && set[g->hi + 1]);
+		}
+		g_array_free(gaps, TRUE);
+		id_ranges_free(r);
+	}
+	g_rand_free(rng);
+}
+END_TEST
+
+
+Suite *id_ranges_suite(void)
+{
+	Suite *s = suite_create("id_ranges");
+
+	TCase *tc_iface = tcase_create("interface");
+	suite_add_tcase(s, tc_iface);
+	tcase_add_test(tc_iface, merge_and_gaps);
+	tcase_add_test(tc_iface, limit_drops_oldest);
+	tcase_add_test(tc_iface, compare_naive);
+
+	return s;
+}
@@ -0,0 +1,192 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include <check.h>
+
+#include "defs.h"
+
+
+START_TEST(empty_filter)
+{
+	struct mute_filter *f = mute_filter_new();
+	fail_if(mute_filter_match_text(f, "anything at all"));
+	fail_if(mute_filter_match(f, "text", 1234, "web"));
+	fail_unless(mute_filter_take_changes(f) == 0);
+	mute_filter_free(f);
+}
+END_TEST
+
+
+/* the textbook example: overlapping words, and words inside others. */
+START_TEST(overlapping_words)
+{
+	struct mute_filter *f = mute_filter_new();
+	static const char *const words[] = { "he", "she", "his", "hers" };
+	for(int i=0; i < G_N_ELEMENTS(words); i++) {
+		fail_unless(mute_filter_add_word(f, words[i]));
+	}
+	fail_if(mute_filter_add_word(f, "his"));
+	fail_if(mute_filter_add_word(f, ""));
+
+	fail_unless(mute_filter_match_text(f, "she sells"));
+	fail_unless(mute_filter_match_text(f, "it's HERS!"));
+	fail_unless(mute_filter_match_text(f, "sHe"));
+	fail_unless(mute_filter_match_text(f, "ushers, he's"));
+	fail_if(mute_filter_match_text(f, "ushers"));
+	fail_if(mute_filter_match_text(f, "a this"));
+	fail_if(mute_filter_match_text(f, "hi sis"));
+	fail_if(mute_filter_match_text(f, "h e"));
+	fail_if(mute_filter_match_text(f, ""));
+
+	fail_unless(mute_filter_remove_word(f, "HE"));
+	fail_unless(mute_filter_match_text(f, "so she said"));
+	fail_if(mute_filter_match_text(f, "so he said"));
+	fail_if(mute_filter_remove_word(f, "he"));
+
+	/* back in, along the path that's still in the trie. */
+	fail_unless(mute_filter_add_word(f, "he"));
+	fail_unless(mute_filter_match_text(f, "so he said"));
+
+	mute_filter_free(f);
+}
+END_TEST
+
+
+START_TEST(word_boundaries)
+{
+	struct mute_filter *f = mute_filter_new();
+	fail_unless(mute_filter_add_word(f, "cat"));
+	fail_unless(mute_filter_add_word(f, "#tag"));
+	fail_unless(mute_filter_add_word(f, "ends."));
+
+	fail_unless(mute_filter_match_text(f, "cat"));
+	fail_unless(mute_filter_match_text(f, "a CAT!"));
+	fail_unless(mute_filter_match_text(f, "(cat)"));
+	fail_if(mute_filter_match_text(f, "concatenate"));
+	fail_if(mute_filter_match_text(f, "cats"));
+	fail_if(mute_filter_match_text(f, "bobcat"));
+	fail_if(mute_filter_match_text(f, "cat_"));
+	fail_if(mute_filter_match_text(f, "cat\xc3\xa9"));
+
+	/* punctuation at the word's own edge needs no boundary there. */
+	fail_unless(mute_filter_match_text(f, "x#tag"));
+	fail_if(mute_filter_match_text(f, "#tags"));
+	fail_unless(mute_filter_match_text(f, "it ends.here"));
+	fail_if(mute_filter_match_text(f, "it bends."));
+
+	mute_filter_free(f);
+}
+END_TEST
+
+
+static bool is_word_char(char c) {
+	return g_ascii_isalnum(c) || c == '_' || (c & 0x80) != 0;
+}
+
+
+/* whether `word' occurs in `text' clear of word characters on either side,
+ * unless the word's own edge isn't one.
+ */
+static bool naive_match(const char *text, const char *word)
+{
+	size_t len = strlen(word);
+	for(const char *p = strstr(text, word); p != NULL; p = strstr(p + 1, word)) {
+		if(p > text && is_word_char(p[-1]) && is_word_char(word[0])) continue;
+		if(is_word_char(p[len]) && is_word_char(word[len - 1])) continue;
+		return true;
+	}
+	return false;
+}
+
+
+/* random texts against naive_match(), with words removed and put back
+ * halfway through.
+ */
+START_TEST(compare_naive)
+{
+	static const char *const words[] = {
+		"abcab", "bca", "caa", "aaab", "c b", "bbbbb", "a", "b.", "cc",
+	};
+	bool active[G_N_ELEMENTS(words)];
+	GRand *rnd = g_rand_new_with_seed(0xaced);
+	struct mute_filter *f = mute_filter_new();
+	for(int i=0; i < G_N_ELEMENTS(words); i++) {
+		active[i] = i != 8;
+		if(active[i]) mute_filter_add_word(f, words[i]);
+	}
+
+	for(int n=0; n < 30000; n++) {
+		if(n == 10000) {
+			/* removals, and a word inside another. */
+			fail_unless(mute_filter_remove_word(f, "bca"));
+			fail_unless(mute_filter_remove_word(f, "A"));
+			active[1] = active[6] = false;
+		} else if(n == 20000) {
+			/* one back along its old path, one that's new. */
+			fail_unless(mute_filter_add_word(f, "bca"));
+			fail_unless(mute_filter_add_word(f, "cc"));
+			active[1] = active[8] = true;
+		}
+
+		char text[40];
+		int len = g_rand_int_range(rnd, 0, sizeof(text));
+		for(int i=0; i < len; i++) {
+			text[i] = "abcABC x."[g_rand_int_range(rnd, 0, 9)];
+		}
+		text[len] = '\0';
+
+		char *folded = g_ascii_strdown(text, -1);
+		bool expect = false;
+		for(int i=0; i < G_N_ELEMENTS(words) && !expect; i++) {
+			expect = active[i] && naive_match(folded, words[i]);
+		}
+		g_free(folded);
+		fail_unless(mute_filter_match_text(f, text) == expect,
+			"mismatch on `%s' at %d", text, n);
+	}
+
+	mute_filter_free(f);
+	g_rand_free(rnd);
+}
+END_TEST
+
+
+START_TEST(users_and_sources)
+{
+	struct mute_filter *f = mute_filter_new();
+	fail_unless(mute_filter_add_user(f, 42));
+	fail_unless(mute_filter_add_source(f, "spambot"));
+	fail_unless(mute_filter_take_changes(f) == MUTE_RULES_ADDED);
+
+	fail_unless(mute_filter_match(f, "hello", 42, "web"));
+	fail_unless(mute_filter_match(f, "hello", 7, "spambot"));
+	fail_if(mute_filter_match(f, "hello", 7, "web"));
+	fail_if(mute_filter_match(f, NULL, 0, NULL));
+
+	fail_unless(mute_filter_remove_user(f, 42));
+	fail_if(mute_filter_remove_user(f, 42));
+	fail_if(mute_filter_match(f, "hello", 42, "web"));
+	fail_unless(mute_filter_take_changes(f) == MUTE_RULES_REMOVED);
+	fail_unless(mute_filter_take_changes(f) == 0);
+
+	mute_filter_free(f);
+}
+END_TEST
+
+
+Suite *mute_filter_suite(void)
+{
+	Suite *s = suite_create("mute_filter");
+
+	TCase *tc_iface = tcase_create("interface");
+	suite_add_tcase(s, tc_iface);
+	tcase_add_test(tc_iface, empty_filter);
+	tcase_add_test(tc_iface, overlapping_words);
+	tcase_add_test(tc_iface, word_boundaries);
+	tcase_add_test(tc_iface, compare_naive);
+	tcase_add_test(tc_iface, users_and_sources);
+
+	return s;
+}
@@ -0,0 +1,106 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <glib.h>
+#include <gcrypt.h>
+#include <check.h>
+
+#include "defs.h"
+
+
+/* signs a resource request with a fixed timestamp and nonce. */
+static char *sign_with(
+	const char *con_sec,
+	const char *tok_sec,
+	struct oauth_signer *signer,
+	const char *status)
+{
+	struct oauth_request *oa = oa_req_new_with_params("ckey", con_sec,
+		"https://api.example.com/1/statuses/home_timeline.json", "GET",
+		SIG_HMAC_SHA1, NULL);
+	oa_set_token(oa, "tkey", tok_sec);
+	oa_set_extra_param(oa, "count", "20");
+	oa_set_extra_param(oa, "status", status);
+	oa->timestamp = "1318622958";
+	oa->nonce = "kYjzVBB8Y0ZFabxSWbWovY3uYSQ2pTgmZeNu2VS4cg";
+	if(signer != NULL) oa_set_signer(oa, signer);
+	fail_unless(oa_sign_request(oa, OA_REQ_RESOURCE));
+	fail_if(oa->signature == NULL);
+	char *ret = g_strdup(oa->signature);
+	oa_req_free(oa);
+	return ret;
+}
+
+
+/* a signer gives the same signatures as keying each request, and isn't
+ * worn out by use.
+ */
+START_TEST(signer_matches_key)
+{
+	gcry_check_version(NULL);
+
+	static const char *const secrets[][2] = {
+		{ "kAcSOqF21Fu85e7zjz7ZN2U4ZRhfV3WpwPAoE3Z7kBw",
+		  "LswwdoUaIvS8ltyTt5jkRh4J50vUPVVHtR2YPi5kE" },
+		{ "needs escaping: &=+/", "and~so does%this" },
+		{ "no token secret yet", NULL },
+	};
+	static const char *const statuses[] = {
+		"Hello Ladies + Gentlemen, a signed OAuth request!",
+		"",
+		"another one",
+	};
+	for(size_t i=0; i < G_N_ELEMENTS(secrets); i++) {
+		struct oauth_signer *s = oa_signer_new(secrets[i][0],
+			secrets[i][1]);
+		fail_if(s == NULL);
+		for(size_t j=0; j < G_N_ELEMENTS(statuses); j++) {
+			char *want = sign_with(secrets[i][0], secrets[i][1], NULL,
+					statuses[j]),
+				*got = sign_with(secrets[i][0], secrets[i][1], s,
+					statuses[j]);
+			fail_unless(strcmp(want, got) == 0,
+				"secrets %zu, status %zu: `%s' != `%s'", i, j, got, want);
+			g_free(want);
+			g_free(got);
+		}
+		oa_signer_free(s);
+	}
+}
+END_TEST
+
+
+/* different statuses under one signer sign differently. */
+START_TEST(signer_distinguishes)
+{
+	gcry_check_version(NULL);
+
+	struct oauth_signer *s = oa_signer_new("csec", "tsec");
+	fail_if(s == NULL);
+	char *a = sign_with("csec", "tsec", s, "one"),
+		*b = sign_with("csec", "tsec", s, "two"),
+		*c = sign_with("csec", "other", NULL, "one");
+	fail_if(strcmp(a, b) == 0);
+	fail_if(strcmp(a, c) == 0);
+	g_free(a);
+	g_free(b);
+	g_free(c);
+	oa_signer_free(s);
+}
+END_TEST
+
+
+Suite *oauth_suite(void)
+{
+	Suite *s = suite_create("oauth");
+
+	TCase *tc_iface = tcase_create("interface");
+	suite_add_tcase(s, tc_iface);
+	tcase_add_test(tc_iface, signer_matches_key);
+	tcase_add_test(tc_iface, signer_distinguishes);
+
+	return s;
+}
@@ -213,6 +213,40 @@ START_TEST(flush_on_overwrite)
 END_TEST
 
 
+START_TEST(remove_items)
+{
+	GObject *obj = g_object_new(PT_CACHE_TYPE, NULL);
+	PtCache *cache = PT_CACHE(obj);
+
+	GObject *o = g_object_new(G_TYPE_OBJECT, NULL),
+		*o2 = g_object_new(G_TYPE_OBJECT, NULL);
+	pt_cache_put(cache, GINT_TO_POINTER(1), 0, o);
+	pt_cache_put(cache, GINT_TO_POINTER(2), 0, o2);
+	gpointer o_ptr = o, o2_ptr = o2;
+	g_object_add_weak_pointer(o, &o_ptr);
+	g_object_add_weak_pointer(o2, &o2_ptr);
+	/* `o' goes inactive, `o2' stays referenced. */
+	g_object_unref(o);
+
+	fail_unless(pt_cache_remove(cache, GINT_TO_POINTER(1)));
+	fail_unless(o_ptr == NULL);
+	fail_unless(pt_cache_get(cache, GINT_TO_POINTER(1)) == NULL);
+	fail_if(pt_cache_remove(cache, GINT_TO_POINTER(1)));
+
+	fail_unless(pt_cache_remove(cache, GINT_TO_POINTER(2)));
+	fail_unless(o2_ptr != NULL);
+	guint count = 1;
+	g_object_get(cache, "count", &count, NULL);
+	fail_unless(count == 0);
+
+	g_object_unref(cache);
+	fail_unless(o2_ptr != NULL);
+	g_object_unref(o2);
+	fail_unless(o2_ptr == NULL);
+}
+END_TEST
+
+
 /* check that the cache does reasonable reference counting.
  *
  * missing: overwrite case.
@@ -262,6 +296,7 @@ Suite *pt_cache_suite(void)
 	tcase_add_test(tc_iface, provoke_replacement);
 	tcase_add_test(tc_iface, replace_with_linger);
 	tcase_add_test(tc_iface, flush_on_overwrite);
+	tcase_add_test(tc_iface, remove_items);
 	tcase_add_test(tc_iface, item_destruction);
 
 	return s;
@@ -0,0 +1,428 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <libsoup/soup.h>
+#include <check.h>
+
+#include "defs.h"
+
+
+struct sched_test
+{
+	GMainLoop *loop;
+	SoupServer *server;
+	struct request_sched *reqs;
+	int done, want, cancelled;
+	int remaining;			/* rate limit left, or -1 for no headers */
+	int not_modified;		/* 304s sent */
+	GString *order;			/* request paths, in order of completion */
+};
+
+
+static void ok_handler(
+	SoupServer *server,
+	SoupMessage *msg,
+	const char *path,
+	GHashTable *query,
+	SoupClientContext *client,
+	gpointer dataptr)
+{
+	struct sched_test *t = dataptr;
+	soup_message_set_status(msg, SOUP_STATUS_OK);
+	soup_message_set_response(msg, "text/plain", SOUP_MEMORY_STATIC,
+		"ok", 2);
+	if(t->remaining >= 0) {
+		char buf[32];
+		t->remaining = MAX(0, t->remaining - 1);
+		snprintf(buf, sizeof(buf), "%d", t->remaining);
+		soup_message_headers_append(msg->response_headers,
+			"X-RateLimit-Remaining", buf);
+		soup_message_headers_append(msg->response_headers,
+			"X-RateLimit-Limit", "8");
+		snprintf(buf, sizeof(buf), "%lld", (long long)time(NULL) + 3600);
+		soup_message_headers_append(msg->response_headers,
+			"X-RateLimit-Reset", buf);
+	}
+}
+
+
+/* "/etag" has the same body all along, and says so to those who ask. */
+static void etag_handler(
+	SoupServer *server,
+	SoupMessage *msg,
+	const char *path,
+	GHashTable *query,
+	SoupClientContext *client,
+	gpointer dataptr)
+{
+	struct sched_test *t = dataptr;
+	soup_message_headers_append(msg->response_headers, "ETag", "\"v1\"");
+	const char *match = soup_message_headers_get_one(msg->request_headers,
+		"If-None-Match");
+	if(match != NULL && strcmp(match, "\"v1\"") == 0) {
+		t->not_modified++;
+		soup_message_set_status(msg, SOUP_STATUS_NOT_MODIFIED);
+	} else {
+		soup_message_set_status(msg, SOUP_STATUS_OK);
+		soup_message_set_response(msg, "text/plain", SOUP_MEMORY_STATIC,
+			"etag body", 9);
+	}
+}
+
+
+static void on_test_done(SoupSession *session, SoupMessage *msg, gpointer dataptr)
+{
+	struct sched_test *t = dataptr;
+	if(msg->status_code == SOUP_STATUS_CANCELLED) t->cancelled++;
+	else {
+		fail_unless(msg->status_code == SOUP_STATUS_OK);
+		const char *path = soup_uri_get_path(soup_message_get_uri(msg));
+		g_string_append(t->order, path);
+		if(strcmp(path, "/etag") == 0) {
+			fail_unless(msg->response_body->length == 9);
+			fail_unless(memcmp(msg->response_body->data, "etag body", 9) == 0);
+		}
+	}
+	if(t->reqs != NULL) {
+		/* this one's been taken off the running count already. */
+		for(int c=0; c < REQ__NUM_CLASSES; c++) {
+			fail_unless(request_sched_running(t->reqs, c) <= 1);
+		}
+	}
+	if(++t->done == t->want && t->loop != NULL) g_main_loop_quit(t->loop);
+}
+
+
+static gboolean on_test_timeout(gpointer dataptr)
+{
+	struct sched_test *t = dataptr;
+	g_main_loop_quit(t->loop);
+	return FALSE;
+}
+
+
+static SoupMessage *test_msg(SoupServer *server, const char *path)
+{
+	char *uri = g_strdup_printf("http://127.0.0.1:%u%s",
+		soup_server_get_port(server), path);
+	SoupMessage *msg = soup_message_new("GET", uri);
+	g_free(uri);
+	return msg;
+}
+
+
+static void sched_test_setup(struct sched_test *t, SoupSession *ss)
+{
+	memset(t, 0, sizeof(*t));
+	t->loop = g_main_loop_new(NULL, FALSE);
+	t->server = soup_server_new(SOUP_SERVER_PORT, SOUP_ADDRESS_ANY_PORT, NULL);
+	fail_if(t->server == NULL);
+	soup_server_add_handler(t->server, NULL, &ok_handler, t, NULL);
+	soup_server_add_handler(t->server, "/etag", &etag_handler, t, NULL);
+	soup_server_run_async(t->server);
+	t->reqs = request_sched_new(ss);
+	for(int c=0; c < REQ__NUM_CLASSES; c++) {
+		request_sched_set_limit(t->reqs, c, 1);
+	}
+	t->order = g_string_new("");
+	t->remaining = -1;
+}
+
+
+static void run_until_done(struct sched_test *t, int want)
+{
+	t->want = want;
+	guint timeout = g_timeout_add_seconds(10, &on_test_timeout, t);
+	g_main_loop_run(t->loop);
+	g_source_remove(timeout);
+	fail_unless(t->done == want, "done %d, wanted %d", t->done, want);
+}
+
+
+static void sched_test_teardown(struct sched_test *t)
+{
+	soup_server_quit(t->server);
+	g_object_unref(t->server);
+	g_string_free(t->order, TRUE);
+	g_main_loop_unref(t->loop);
+}
+
+
+/* each class keeps to its limit. userpics wait newest first, and a
+ * waiting one that's promoted goes out under its new class.
+ */
+START_TEST(limits_and_promotion)
+{
+	SoupSession *ss = soup_session_async_new();
+	struct sched_test t;
+	sched_test_setup(&t, ss);
+	t.want = 5;
+
+	request_sched_queue(t.reqs, REQ_USERPIC_PREFETCH,
+		test_msg(t.server, "/p1"), &on_test_done, &t);
+	SoupMessage *p2 = test_msg(t.server, "/p2");
+	request_sched_queue(t.reqs, REQ_USERPIC_PREFETCH, p2, &on_test_done, &t);
+	request_sched_queue(t.reqs, REQ_USERPIC_PREFETCH,
+		test_msg(t.server, "/p3"), &on_test_done, &t);
+	request_sched_queue(t.reqs, REQ_TIMELINE,
+		test_msg(t.server, "/t1"), &on_test_done, &t);
+	request_sched_queue(t.reqs, REQ_TIMELINE,
+		test_msg(t.server, "/t2"), &on_test_done, &t);
+	fail_unless(request_sched_running(t.reqs, REQ_USERPIC_PREFETCH) == 1);
+	fail_unless(request_sched_waiting(t.reqs, REQ_USERPIC_PREFETCH) == 2);
+	fail_unless(request_sched_running(t.reqs, REQ_TIMELINE) == 1);
+	fail_unless(request_sched_waiting(t.reqs, REQ_TIMELINE) == 1);
+
+	/* never demoted; promoted past p3 into a class with room. */
+	fail_unless(request_sched_promote(t.reqs, p2, REQ_USERPIC_PREFETCH));
+	fail_unless(request_sched_promote(t.reqs, p2, REQ_USERPIC));
+	fail_unless(request_sched_running(t.reqs, REQ_USERPIC) == 1);
+	fail_unless(request_sched_waiting(t.reqs, REQ_USERPIC_PREFETCH) == 1);
+	fail_if(request_sched_promote(t.reqs, p2, REQ_TIMELINE));
+
+	guint timeout = g_timeout_add_seconds(10, &on_test_timeout, &t);
+	g_main_loop_run(t.loop);
+	g_source_remove(timeout);
+
+	fail_unless(t.done == 5 && t.cancelled == 0, "done %d, cancelled %d",
+		t.done, t.cancelled);
+	/* the second of each queue went after the first. */
+	const char *o = t.order->str;
+	fail_unless(strstr(o, "/t1") < strstr(o, "/t2"), "order `%s'", o);
+	fail_unless(strstr(o, "/p1") < strstr(o, "/p3"), "order `%s'", o);
+
+	request_sched_free(t.reqs);
+	t.reqs = NULL;
+	g_object_unref(ss);
+	sched_test_teardown(&t);
+}
+END_TEST
+
+
+/* requests that are still waiting are called back as cancelled right away;
+ * those that went out finish normally.
+ */
+START_TEST(free_cancels_waiting)
+{
+	SoupSession *ss = soup_session_async_new();
+	struct sched_test t;
+	sched_test_setup(&t, ss);
+	t.want = 3;
+
+	for(int i=0; i < 3; i++) {
+		char path[16];
+		snprintf(path, sizeof(path), "/l%d", i);
+		request_sched_queue(t.reqs, REQ_LOOKUP, test_msg(t.server, path),
+			&on_test_done, &t);
+	}
+	struct request_sched *reqs = t.reqs;
+	t.reqs = NULL;
+	request_sched_free(reqs);
+	fail_unless(t.cancelled == 2);
+
+	guint timeout = g_timeout_add_seconds(10, &on_test_timeout, &t);
+	g_main_loop_run(t.loop);
+	g_source_remove(timeout);
+	fail_unless(t.done == 3);
+	fail_unless(strcmp(t.order->str, "/l0") == 0, "order `%s'",
+		t.order->str);
+
+	g_object_unref(ss);
+	sched_test_teardown(&t);
+}
+END_TEST
+
+
+/* a waiting request is called back as cancelled right away, one that was
+ * sent once the session lets go of it. the rest go on.
+ */
+START_TEST(cancel_one)
+{
+	SoupSession *ss = soup_session_async_new();
+	struct sched_test t;
+	sched_test_setup(&t, ss);
+
+	SoupMessage *msgs[3];
+	for(int i=0; i < 3; i++) {
+		char path[16];
+		snprintf(path, sizeof(path), "/l%d", i);
+		msgs[i] = test_msg(t.server, path);
+		request_sched_queue(t.reqs, REQ_LOOKUP, msgs[i], &on_test_done, &t);
+	}
+	request_sched_cancel(t.reqs, msgs[1]);
+	fail_unless(t.cancelled == 1);
+	fail_unless(request_sched_waiting(t.reqs, REQ_LOOKUP) == 1);
+	request_sched_cancel(t.reqs, msgs[0]);
+
+	run_until_done(&t, 3);
+	fail_unless(t.cancelled == 2);
+	fail_unless(strcmp(t.order->str, "/l2") == 0, "order `%s'",
+		t.order->str);
+
+	request_sched_free(t.reqs);
+	t.reqs = NULL;
+	g_object_unref(ss);
+	sched_test_teardown(&t);
+}
+END_TEST
+
+
+/* background requests leave a quarter of the limit to the rest, and
+ * nothing goes out to a spent endpoint until its window resets.
+ */
+START_TEST(budget_reserve_and_lockout)
+{
+	SoupSession *ss = soup_session_async_new();
+	struct sched_test t;
+	sched_test_setup(&t, ss);
+	t.remaining = 3;
+
+	request_sched_queue(t.reqs, REQ_LOOKUP, test_msg(t.server, "/api?a"),
+		&on_test_done, &t);
+	run_until_done(&t, 1);
+	struct rate_limit rl;
+	fail_unless(request_sched_get_rate_limit(t.reqs, 0, "/api", &rl));
+	fail_unless(rl.limit == 8 && rl.remaining == 2);
+	fail_unless(rl.reset > (int64_t)time(NULL));
+
+	request_sched_queue(t.reqs, REQ_BACKGROUND, test_msg(t.server, "/api?b"),
+		&on_test_done, &t);
+	fail_unless(request_sched_running(t.reqs, REQ_BACKGROUND) == 0);
+	fail_unless(request_sched_waiting(t.reqs, REQ_BACKGROUND) == 1);
+
+	/* interactive ones go ahead, down to the last one. */
+	request_sched_queue(t.reqs, REQ_LOOKUP, test_msg(t.server, "/api?c"),
+		&on_test_done, &t);
+	run_until_done(&t, 2);
+	request_sched_queue(t.reqs, REQ_LOOKUP, test_msg(t.server, "/api?d"),
+		&on_test_done, &t);
+	run_until_done(&t, 3);
+	fail_unless(request_sched_get_rate_limit(t.reqs, 0, "/api", &rl));
+	fail_unless(rl.remaining == 0);
+
+	request_sched_queue(t.reqs, REQ_LOOKUP, test_msg(t.server, "/api?e"),
+		&on_test_done, &t);
+	fail_unless(request_sched_running(t.reqs, REQ_LOOKUP) == 0);
+	fail_unless(request_sched_waiting(t.reqs, REQ_LOOKUP) == 1);
+	/* other endpoints aren't affected. */
+	request_sched_queue(t.reqs, REQ_LOOKUP, test_msg(t.server, "/other"),
+		&on_test_done, &t);
+	run_until_done(&t, 4);
+	fail_unless(request_sched_waiting(t.reqs, REQ_BACKGROUND) == 1);
+
+	struct request_sched *reqs = t.reqs;
+	t.reqs = NULL;
+	request_sched_free(reqs);
+	fail_unless(t.cancelled == 2 && t.done == 6);
+
+	g_object_unref(ss);
+	sched_test_teardown(&t);
+}
+END_TEST
+
+
+/* the same endpoint under different accounts draws on separate budgets. */
+START_TEST(budget_per_account)
+{
+	SoupSession *ss = soup_session_async_new();
+	struct sched_test t;
+	sched_test_setup(&t, ss);
+	t.remaining = 1;
+
+	SoupMessage *msg = test_msg(t.server, "/api?a");
+	request_sched_set_account(msg, 1001);
+	request_sched_queue(t.reqs, REQ_LOOKUP, msg, &on_test_done, &t);
+	run_until_done(&t, 1);
+	struct rate_limit rl;
+	fail_unless(request_sched_get_rate_limit(t.reqs, 1001, "/api", &rl));
+	fail_unless(rl.remaining == 0);
+	fail_if(request_sched_get_rate_limit(t.reqs, 1002, "/api", &rl));
+	fail_if(request_sched_get_rate_limit(t.reqs, 0, "/api", &rl));
+
+	msg = test_msg(t.server, "/api?b");
+	request_sched_set_account(msg, 1001);
+	request_sched_queue(t.reqs, REQ_LOOKUP, msg, &on_test_done, &t);
+	fail_unless(request_sched_waiting(t.reqs, REQ_LOOKUP) == 1);
+
+	/* bob's request passes alice's waiting one. */
+	msg = test_msg(t.server, "/api?c");
+	request_sched_set_account(msg, 1002);
+	request_sched_queue(t.reqs, REQ_LOOKUP, msg, &on_test_done, &t);
+	run_until_done(&t, 2);
+	fail_unless(request_sched_get_rate_limit(t.reqs, 1002, "/api", &rl));
+	fail_unless(request_sched_waiting(t.reqs, REQ_LOOKUP) == 1);
+
+	struct request_sched *reqs = t.reqs;
+	t.reqs = NULL;
+	request_sched_free(reqs);
+	fail_unless(t.cancelled == 1 && t.done == 3);
+
+	g_object_unref(ss);
+	sched_test_teardown(&t);
+}
+END_TEST
+
+
+/* the second request for the same thing, OAuth parameters aside, is
+ * conditional. the caller sees the kept body either way, and the counters
+ * tell the two apart.
+ */
+START_TEST(revalidation)
+{
+	SoupSession *ss = soup_session_async_new();
+	struct sched_test t;
+	sched_test_setup(&t, ss);
+
+	request_sched_queue(t.reqs, REQ_LOOKUP,
+		test_msg(t.server, "/etag?id=1&oauth_nonce=a"), &on_test_done, &t);
+	run_until_done(&t, 1);
+	request_sched_queue(t.reqs, REQ_LOOKUP,
+		test_msg(t.server, "/etag?oauth_nonce=b&id=1"), &on_test_done, &t);
+	run_until_done(&t, 2);
+	fail_unless(t.not_modified == 1);
+
+	/* a different query is a different thing. */
+	request_sched_queue(t.reqs, REQ_LOOKUP,
+		test_msg(t.server, "/etag?id=2&oauth_nonce=c"), &on_test_done, &t);
+	run_until_done(&t, 3);
+	fail_unless(t.not_modified == 1);
+
+	struct traffic_stats ts;
+	fail_unless(request_sched_get_traffic(t.reqs, "/etag", &ts));
+	fail_unless(ts.requests == 3 && ts.not_modified == 1);
+	fail_unless(ts.wire_bytes == 18, "wire_bytes %llu",
+		(unsigned long long)ts.wire_bytes);
+	fail_unless(ts.decoded_bytes == 27, "decoded_bytes %llu",
+		(unsigned long long)ts.decoded_bytes);
+	fail_if(request_sched_get_traffic(t.reqs, "/other", &ts));
+
+	request_sched_free(t.reqs);
+	t.reqs = NULL;
+	g_object_unref(ss);
+	sched_test_teardown(&t);
+}
+END_TEST
+
+
+Suite *request_sched_suite(void)
+{
+	Suite *s = suite_create("request_sched");
+
+	TCase *tc_iface = tcase_create("interface");
+	tcase_set_timeout(tc_iface, 20);
+	suite_add_tcase(s, tc_iface);
+	tcase_add_test(tc_iface, limits_and_promotion);
+	tcase_add_test(tc_iface, free_cancels_waiting);
+	tcase_add_test(tc_iface, cancel_one);
+	tcase_add_test(tc_iface, budget_reserve_and_lockout);
+	tcase_add_test(tc_iface, budget_per_account);
+	tcase_add_test(tc_iface, revalidation);
+
+	return s;
+}
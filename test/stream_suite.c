@@ -0,0 +1,194 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <libsoup/soup.h>
+#include <check.h>
+
+#include "defs.h"
+
+
+/* a local stand-in for the streaming endpoint. the first connection gets
+ * messages split awkwardly across chunks, with keep-alives between; later
+ * ones get a single message. unless `hold_open' is set, each response ends
+ * after that, so that the client has to reconnect.
+ */
+struct stream_test
+{
+	GMainLoop *loop;
+	SoupServer *server;
+	char *uri;
+	bool hold_open;
+	int connections;
+	GPtrArray *lines;		/* of char *, owned */
+	size_t want;
+};
+
+
+static const char *const first_chunks[] = {
+	"{\"n\":1}\r\n{\"n\"",
+	":2}\r\n\r\n",
+	"\r\n{\"n\":3}",
+	"\r\n",
+};
+
+
+static void stream_handler(
+	SoupServer *server,
+	SoupMessage *msg,
+	const char *path,
+	GHashTable *query,
+	SoupClientContext *client,
+	gpointer dataptr)
+{
+	struct stream_test *t = dataptr;
+	soup_message_set_status(msg, SOUP_STATUS_OK);
+	soup_message_headers_set_encoding(msg->response_headers,
+		SOUP_ENCODING_CHUNKED);
+	if(t->connections++ == 0) {
+		for(int i=0; i < G_N_ELEMENTS(first_chunks); i++) {
+			soup_message_body_append(msg->response_body, SOUP_MEMORY_STATIC,
+				first_chunks[i], strlen(first_chunks[i]));
+		}
+	} else {
+		const char *last = "{\"n\":4}\n";
+		soup_message_body_append(msg->response_body, SOUP_MEMORY_STATIC,
+			last, strlen(last));
+	}
+	if(!t->hold_open) soup_message_body_complete(msg->response_body);
+}
+
+
+static SoupMessage *test_request(void *dataptr)
+{
+	struct stream_test *t = dataptr;
+	return soup_message_new("GET", t->uri);
+}
+
+
+static void test_lines(
+	const char *const *lines,
+	size_t num_lines,
+	void *dataptr)
+{
+	struct stream_test *t = dataptr;
+	fail_unless(lines[num_lines] == NULL);
+	for(size_t i=0; i < num_lines; i++) {
+		fail_if(strchr(lines[i], '\r') != NULL);
+		fail_if(lines[i][0] == '\0');
+		g_ptr_array_add(t->lines, g_strdup(lines[i]));
+	}
+	if(t->lines->len >= t->want) g_main_loop_quit(t->loop);
+}
+
+
+static gboolean on_test_timeout(gpointer dataptr)
+{
+	struct stream_test *t = dataptr;
+	g_main_loop_quit(t->loop);
+	return FALSE;
+}
+
+
+static void stream_test_setup(struct stream_test *t, bool hold_open)
+{
+	t->loop = g_main_loop_new(NULL, FALSE);
+	t->server = soup_server_new(SOUP_SERVER_PORT, SOUP_ADDRESS_ANY_PORT, NULL);
+	fail_if(t->server == NULL);
+	soup_server_add_handler(t->server, "/stream", &stream_handler, t, NULL);
+	soup_server_run_async(t->server);
+	t->uri = g_strdup_printf("http://127.0.0.1:%u/stream",
+		soup_server_get_port(t->server));
+	t->hold_open = hold_open;
+	t->connections = 0;
+	t->lines = g_ptr_array_new_with_free_func(&g_free);
+}
+
+
+static void stream_test_teardown(struct stream_test *t)
+{
+	soup_server_quit(t->server);
+	g_object_unref(t->server);
+	g_ptr_array_free(t->lines, TRUE);
+	g_free(t->uri);
+	g_main_loop_unref(t->loop);
+}
+
+
+/* lines come out whole however they're split, keep-alives don't come out
+ * at all, and the stream reconnects when the server ends a response.
+ */
+START_TEST(framing_and_reconnect)
+{
+	struct stream_test t;
+	stream_test_setup(&t, false);
+	t.want = 4;
+
+	SoupSession *ss = soup_session_async_new();
+	struct stream *s = stream_new(ss, &test_request, &test_lines, &t);
+	guint timeout = g_timeout_add_seconds(10, &on_test_timeout, &t);
+	g_main_loop_run(t.loop);
+	g_source_remove(timeout);
+
+	fail_unless(t.lines->len == 4);
+	for(guint i=0; i < t.lines->len; i++) {
+		char *expect = g_strdup_printf("{\"n\":%u}", i + 1);
+		fail_unless(strcmp(g_ptr_array_index(t.lines, i), expect) == 0,
+			"line %u is `%s', not `%s'", i,
+			(char *)g_ptr_array_index(t.lines, i), expect);
+		g_free(expect);
+	}
+	fail_unless(t.connections == 2);
+
+	stream_free(s);
+	g_object_unref(ss);
+	stream_test_teardown(&t);
+}
+END_TEST
+
+
+/* freeing a stream that's connected cancels the request, and nothing is
+ * delivered afterward.
+ */
+START_TEST(free_while_connected)
+{
+	struct stream_test t;
+	stream_test_setup(&t, true);
+	t.want = 3;
+
+	SoupSession *ss = soup_session_async_new();
+	struct stream *s = stream_new(ss, &test_request, &test_lines, &t);
+	guint timeout = g_timeout_add_seconds(10, &on_test_timeout, &t);
+	g_main_loop_run(t.loop);
+	g_source_remove(timeout);
+	fail_unless(t.lines->len == 3);
+	fail_unless(stream_is_live(s));
+
+	stream_free(s);
+	/* let the cancellation run its course. */
+	timeout = g_timeout_add(500, &on_test_timeout, &t);
+	g_main_loop_run(t.loop);
+	fail_unless(t.lines->len == 3);
+	fail_unless(t.connections == 1);
+
+	g_object_unref(ss);
+	stream_test_teardown(&t);
+}
+END_TEST
+
+
+Suite *stream_suite(void)
+{
+	Suite *s = suite_create("stream");
+
+	TCase *tc_iface = tcase_create("interface");
+	tcase_set_timeout(tc_iface, 20);
+	suite_add_tcase(s, tc_iface);
+	tcase_add_test(tc_iface, framing_and_reconnect);
+	tcase_add_test(tc_iface, free_while_connected);
+
+	return s;
+}
@@ -6,6 +6,15 @@
 
 
 extern Suite *pt_cache_suite(void);
+extern Suite *id_index_suite(void);
+extern Suite *mute_filter_suite(void);
+extern Suite *stream_suite(void);
+extern Suite *id_ranges_suite(void);
+extern Suite *request_sched_suite(void);
+extern Suite *user_lookup_suite(void);
+extern Suite *oauth_suite(void);
+extern Suite *user_info_suite(void);
+extern Suite *update_store_suite(void);
 
 
 int main(void)
@@ -13,6 +22,15 @@ int main(void)
 	g_type_init();
 
 	SRunner *sr = srunner_create(pt_cache_suite());
+	srunner_add_suite(sr, id_index_suite());
+	srunner_add_suite(sr, mute_filter_suite());
+	srunner_add_suite(sr, stream_suite());
+	srunner_add_suite(sr, id_ranges_suite());
+	srunner_add_suite(sr, request_sched_suite());
+	srunner_add_suite(sr, user_lookup_suite());
+	srunner_add_suite(sr, oauth_suite());
+	srunner_add_suite(sr, user_info_suite());
+	srunner_add_suite(sr, update_store_suite());
 #if 0
 	/* for valgrinding */
 	srunner_set_fork_status(sr, CK_NOFORK);
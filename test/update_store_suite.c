@@ -0,0 +1,326 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <check.h>
+
+#include "defs.h"
+#include "pt-update.h"
+#include "pt-user-info.h"
+#include "pt-cache.h"
+
+
+/* a user cache without a database behind it. the users that updates refer
+ * to are put in by hand, and stay.
+ */
+static PtCache *test_user_cache(void)
+{
+	return PT_CACHE(g_object_new(PT_CACHE_TYPE,
+		"hash-fn", &g_int64_hash, "equal-fn", &g_int64_equal,
+		"high-watermark", 1000, "low-watermark", 900,
+		NULL));
+}
+
+
+static PtUserInfo *test_user(PtCache *uc, uint64_t id, const char *name)
+{
+	PtUserInfo *ui = pt_user_info_new();
+	ui->id = id;
+	ui->screenname = g_strdup(name);
+	pt_cache_put(uc, &ui->id, 0, G_OBJECT(ui));
+	g_object_unref(ui);
+	return ui;
+}
+
+
+/* adds an update with the given fields, and gives the store's reference
+ * back.
+ */
+static bool add(
+	struct update_store *s,
+	uint64_t id,
+	uint64_t parent,
+	const char *text,
+	PtUserInfo *author)
+{
+	PtUpdate *u = pt_update_new();
+	u->id = id;
+	u->in_rep_to_sid = parent;
+	u->text = g_strdup(text);
+	u->source = "web";
+	u->timestamp = g_date_time_new_from_unix_utc(1300000000 + id);
+	if(author != NULL) u->user = g_object_ref(author);
+	bool ok = update_store_add(s, u);
+	g_object_unref(u);
+	return ok;
+}
+
+
+START_TEST(add_and_get)
+{
+	PtCache *uc = test_user_cache();
+	PtUserInfo *alice = test_user(uc, 501, "alice");
+	struct update_store *s = update_store_new(uc);
+
+	fail_unless(update_store_count(s) == 0);
+	fail_if(update_store_has(s, 10));
+	fail_unless(update_store_get(s, 10) == NULL);
+
+	fail_unless(add(s, 10, 0, "first", alice));
+	fail_unless(add(s, 30, 10, "second", NULL));
+	fail_if(add(s, 10, 0, "again", NULL));
+	fail_unless(update_store_count(s) == 2);
+	fail_unless(update_store_has(s, 30));
+	fail_unless(strcmp(update_store_get_text(s, 10), "first") == 0);
+	fail_unless(update_store_get_author(s, 10) == 501);
+	fail_unless(update_store_get_author(s, 30) == 0);
+
+	/* built over from the columns, the facade has the same contents. */
+	update_store_drop_facade(s, 10);
+	PtUpdate *u = update_store_get(s, 10);
+	fail_if(u == NULL);
+	fail_unless(u->id == 10 && u->in_rep_to_sid == 0);
+	fail_unless(strcmp(u->text, "first") == 0);
+	fail_unless(strcmp(u->source, "web") == 0);
+	fail_unless(g_date_time_to_unix(u->timestamp) == 1300000010);
+	fail_unless(u->user == alice);
+	g_object_unref(u);
+
+	update_store_free(s);
+	g_object_unref(uc);
+}
+END_TEST
+
+
+/* enough ids to resize the id -> slot table several times. */
+START_TEST(many_ids)
+{
+	PtCache *uc = test_user_cache();
+	struct update_store *s = update_store_new(uc);
+	GRand *rnd = g_rand_new_with_seed(0x5707e);
+	GHashTable *ref = g_hash_table_new_full(&g_int64_hash, &g_int64_equal,
+		&g_free, NULL);
+	for(int i=0; i < 5000; i++) {
+		uint64_t id = g_rand_int_range(rnd, 1, 1000000);
+		bool fresh = g_hash_table_lookup(ref, &id) == NULL;
+		if(fresh) {
+			uint64_t *key = g_memdup(&id, sizeof(id));
+			g_hash_table_insert(ref, key, key);
+		}
+		char text[32];
+		snprintf(text, sizeof(text), "status %llu", (unsigned long long)id);
+		fail_unless(add(s, id, 0, text, NULL) == fresh);
+	}
+	fail_unless(update_store_count(s) == g_hash_table_size(ref));
+
+	for(uint64_t id = 1; id < 1000000; id += 37) {
+		bool want = g_hash_table_lookup(ref, &id) != NULL;
+		fail_unless(update_store_has(s, id) == want);
+		if(want) {
+			char text[32];
+			snprintf(text, sizeof(text), "status %llu",
+				(unsigned long long)id);
+			fail_unless(strcmp(update_store_get_text(s, id), text) == 0);
+		}
+	}
+
+	g_hash_table_destroy(ref);
+	g_rand_free(rnd);
+	update_store_free(s);
+	g_object_unref(uc);
+}
+END_TEST
+
+
+static bool has_id(GArray *ids, uint64_t id)
+{
+	for(guint i=0; i < ids->len; i++) {
+		if(g_array_index(ids, uint64_t, i) == id) return true;
+	}
+	return false;
+}
+
+
+START_TEST(reply_index)
+{
+	PtCache *uc = test_user_cache();
+	struct update_store *s = update_store_new(uc);
+	add(s, 100, 0, "root", NULL);
+	add(s, 110, 100, "a reply", NULL);
+	add(s, 120, 100, "another", NULL);
+	add(s, 130, 110, "deeper", NULL);
+	/* replies may come before what they reply to. */
+	add(s, 140, 90, "to something unseen", NULL);
+
+	fail_unless(update_store_get_parent(s, 130) == 110);
+	fail_unless(update_store_get_parent(s, 100) == 0);
+	fail_unless(update_store_get_parent(s, 999) == 0);
+
+	GArray *ids = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	fail_unless(update_store_get_replies(s, 100, ids) == 2);
+	fail_unless(has_id(ids, 110) && has_id(ids, 120));
+	g_array_set_size(ids, 0);
+	fail_unless(update_store_get_replies(s, 90, ids) == 1);
+	fail_unless(update_store_get_replies(s, 130, ids) == 0);
+
+	/* trimming a reply takes it out of its parent's list. */
+	update_store_pin(s, 100);
+	update_store_pin(s, 120);
+	update_store_pin(s, 130);
+	update_store_pin(s, 140);
+	fail_unless(update_store_trim(s, 4) == 1);
+	fail_if(update_store_has(s, 110));
+	g_array_set_size(ids, 0);
+	fail_unless(update_store_get_replies(s, 100, ids) == 1);
+	fail_unless(has_id(ids, 120));
+	g_array_set_size(ids, 0);
+	fail_unless(update_store_get_replies(s, 110, ids) == 0);
+	/* the orphan still knows its parent. */
+	fail_unless(update_store_get_parent(s, 130) == 110);
+
+	g_array_free(ids, TRUE);
+	update_store_free(s);
+	g_object_unref(uc);
+}
+END_TEST
+
+
+START_TEST(trim_and_pins)
+{
+	PtCache *uc = test_user_cache();
+	struct update_store *s = update_store_new(uc);
+	for(uint64_t id = 1; id <= 100; id++) add(s, id, 0, "x", NULL);
+	update_store_pin(s, 5);
+	update_store_pin(s, 50);
+	update_store_pin(s, 50);
+
+	fail_unless(update_store_trim(s, 200) == 0);
+	/* keeps the pinned two, and the 18 largest of the rest. */
+	fail_unless(update_store_trim(s, 20) == 80);
+	fail_unless(update_store_count(s) == 20);
+	fail_unless(update_store_has(s, 5) && update_store_has(s, 50));
+	for(uint64_t id = 83; id <= 100; id++) fail_unless(update_store_has(s, id));
+	fail_if(update_store_has(s, 82));
+	fail_unless(strcmp(update_store_get_text(s, 50), "x") == 0);
+
+	/* everything left is pinned. */
+	update_store_unpin(s, 50);
+	for(uint64_t id = 83; id <= 100; id++) update_store_pin(s, id);
+	fail_unless(update_store_trim(s, 1) == 0);
+	update_store_unpin(s, 50);
+	fail_unless(update_store_trim(s, 1) == 1);
+	fail_if(update_store_has(s, 50));
+
+	/* slots are reused after compaction. */
+	fail_unless(add(s, 500, 0, "new", NULL));
+	fail_unless(strcmp(update_store_get_text(s, 500), "new") == 0);
+	fail_unless(strcmp(update_store_get_text(s, 5), "x") == 0);
+
+	update_store_free(s);
+	g_object_unref(uc);
+}
+END_TEST
+
+
+START_TEST(older_pages)
+{
+	PtCache *uc = test_user_cache();
+	struct update_store *s = update_store_new(uc);
+	/* out of order, as backfills make it. */
+	static const uint64_t ids[] = { 70, 20, 90, 10, 50, 30, 80, 60, 40 };
+	for(int i=0; i < G_N_ELEMENTS(ids); i++) add(s, ids[i], 0, "x", NULL);
+
+	GArray *out = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	fail_unless(update_store_older(s, 70, 3, out) == 3);
+	fail_unless(g_array_index(out, uint64_t, 0) == 60);
+	fail_unless(g_array_index(out, uint64_t, 1) == 50);
+	fail_unless(g_array_index(out, uint64_t, 2) == 40);
+
+	/* `below' needn't be stored. */
+	g_array_set_size(out, 0);
+	fail_unless(update_store_older(s, 35, 10, out) == 3);
+	fail_unless(g_array_index(out, uint64_t, 0) == 30);
+	fail_unless(g_array_index(out, uint64_t, 2) == 10);
+
+	g_array_set_size(out, 0);
+	fail_unless(update_store_older(s, 10, 10, out) == 0);
+	fail_unless(update_store_older(s, UINT64_MAX, 100, out) == 9);
+	fail_unless(g_array_index(out, uint64_t, 0) == 90);
+
+	/* trimmed ids are gone from the order too. */
+	update_store_trim(s, 5);
+	g_array_set_size(out, 0);
+	fail_unless(update_store_older(s, 100, 100, out) == 5);
+	fail_unless(g_array_index(out, uint64_t, 4) == 50);
+
+	g_array_free(out, TRUE);
+	update_store_free(s);
+	g_object_unref(uc);
+}
+END_TEST
+
+
+START_TEST(refilter_mutes)
+{
+	PtCache *uc = test_user_cache();
+	PtUserInfo *bob = test_user(uc, 77, "bob");
+	struct update_store *s = update_store_new(uc);
+	add(s, 1, 0, "about cats", NULL);
+	add(s, 2, 0, "about dogs", bob);
+	add(s, 3, 0, "cats and bob", bob);
+
+	struct mute_filter *f = mute_filter_new();
+	GArray *muted = g_array_new(FALSE, FALSE, sizeof(uint64_t)),
+		*unmuted = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	mute_filter_add_word(f, "cats");
+	update_store_refilter(s, f, mute_filter_take_changes(f), muted, unmuted);
+	fail_unless(muted->len == 2 && unmuted->len == 0);
+	fail_unless(has_id(muted, 1) && has_id(muted, 3));
+	fail_unless(update_store_is_muted(s, 3));
+	fail_if(update_store_is_muted(s, 2));
+
+	/* the facade carries the new verdict. */
+	PtUpdate *u = update_store_get(s, 1);
+	fail_unless(u->muted);
+	g_object_unref(u);
+
+	g_array_set_size(muted, 0);
+	mute_filter_add_user(f, 77);
+	mute_filter_remove_word(f, "cats");
+	update_store_refilter(s, f, mute_filter_take_changes(f), muted, unmuted);
+	fail_unless(muted->len == 1 && has_id(muted, 2));
+	fail_unless(unmuted->len == 1 && has_id(unmuted, 1));
+	fail_unless(update_store_is_muted(s, 3));
+
+	GArray *by_bob = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	fail_unless(update_store_find_author(s, 77, by_bob) == 2);
+	fail_unless(has_id(by_bob, 2) && has_id(by_bob, 3));
+
+	g_array_free(by_bob, TRUE);
+	g_array_free(muted, TRUE);
+	g_array_free(unmuted, TRUE);
+	mute_filter_free(f);
+	update_store_free(s);
+	g_object_unref(uc);
+}
+END_TEST
+
+
+Suite *update_store_suite(void)
+{
+	Suite *s = suite_create("update_store");
+
+	TCase *tc_iface = tcase_create("interface");
+	suite_add_tcase(s, tc_iface);
+	tcase_add_test(tc_iface, add_and_get);
+	tcase_add_test(tc_iface, many_ids);
+	tcase_add_test(tc_iface, reply_index);
+	tcase_add_test(tc_iface, trim_and_pins);
+	tcase_add_test(tc_iface, older_pages);
+	tcase_add_test(tc_iface, refilter_mutes);
+
+	return s;
+}
@@ -0,0 +1,103 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <json-glib/json-glib.h>
+#include <check.h>
+
+#include "defs.h"
+#include "pt-user-info.h"
+
+
+/* decodes `json' into `ui', returning the changed mask or -1 on error. */
+static int64_t from_json(PtUserInfo *ui, const char *json)
+{
+	JsonParser *p = json_parser_new();
+	GError *err = NULL;
+	fail_unless(json_parser_load_from_data(p, json, -1, &err),
+		"can't parse `%s'", json);
+	JsonObject *obj = json_node_get_object(json_parser_get_root(p));
+	uint64_t changed = 0xdeadbeef;
+	bool ok = pt_user_info_from_json(ui, obj, &changed, &err);
+	g_object_unref(p);
+	if(!ok) {
+		fail_if(err == NULL);
+		g_error_free(err);
+		return -1;
+	}
+	return changed;
+}
+
+
+/* the mask names exactly the fields that got a different value. */
+START_TEST(changed_mask)
+{
+	PtUserInfo *ui = pt_user_info_new();
+	int64_t m = from_json(ui, "{\"id\": 12, \"name\": \"Long Name\","
+		" \"screen_name\": \"short\", \"protected\": false,"
+		" \"verified\": true}");
+	/* protected was false already. */
+	fail_unless(m == (PT_USER_INFO_ID | PT_USER_INFO_LONGNAME
+		| PT_USER_INFO_SCREENNAME | PT_USER_INFO_VERIFIED),
+		"mask is %#llx", (unsigned long long)m);
+	fail_unless(ui->id == 12 && ui->verified && !ui->protected);
+	fail_unless(strcmp(ui->screenname, "short") == 0);
+
+	/* the same again changes nothing. */
+	m = from_json(ui, "{\"id\": 12, \"name\": \"Long Name\","
+		" \"screen_name\": \"short\", \"verified\": true}");
+	fail_unless(m == 0, "mask is %#llx", (unsigned long long)m);
+
+	/* fields left out stay as they were. */
+	m = from_json(ui, "{\"id\": 12, \"screen_name\": \"other\","
+		" \"protected\": true}");
+	fail_unless(m == (PT_USER_INFO_SCREENNAME | PT_USER_INFO_PROTECTED),
+		"mask is %#llx", (unsigned long long)m);
+	fail_unless(strcmp(ui->longname, "Long Name") == 0);
+	fail_unless(ui->verified);
+
+	/* a string going to null is a change too. */
+	m = from_json(ui, "{\"name\": null}");
+	fail_unless(m == PT_USER_INFO_LONGNAME);
+	fail_unless(ui->longname == NULL);
+
+	g_object_unref(ui);
+}
+END_TEST
+
+
+/* a field that fails to decode leaves the whole object as it was, even the
+ * fields that came before it.
+ */
+START_TEST(failing_field)
+{
+	PtUserInfo *ui = pt_user_info_new();
+	fail_unless(from_json(ui, "{\"id\": 7, \"name\": \"Before\","
+		" \"screen_name\": \"before\", \"verified\": false}") >= 0);
+
+	fail_unless(from_json(ui, "{\"name\": \"After\","
+		" \"screen_name\": \"after\", \"verified\": true,"
+		" \"id\": null}") < 0);
+	fail_unless(ui->id == 7);
+	fail_unless(strcmp(ui->longname, "Before") == 0);
+	fail_unless(strcmp(ui->screenname, "before") == 0);
+	fail_if(ui->verified);
+
+	g_object_unref(ui);
+}
+END_TEST
+
+
+Suite *user_info_suite(void)
+{
+	Suite *s = suite_create("user_info");
+
+	TCase *tc_iface = tcase_create("interface");
+	suite_add_tcase(s, tc_iface);
+	tcase_add_test(tc_iface, changed_mask);
+	tcase_add_test(tc_iface, failing_field);
+
+	return s;
+}
@@ -0,0 +1,244 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <json-glib/json-glib.h>
+#include <libsoup/soup.h>
+#include <check.h>
+
+#include "defs.h"
+
+
+struct lookup_test
+{
+	GMainLoop *loop;
+	SoupServer *server;
+	struct request_sched *reqs;
+	bool fail;				/* server answers 500 */
+	GArray *batch_sizes;	/* of int, as the server saw them */
+	GHashTable *asked;		/* &id -> GINT_TO_POINTER(times asked) */
+	int done, want, failed;
+	size_t users_got;
+};
+
+
+/* knows every user whose id isn't a multiple of 7. */
+static void users_handler(
+	SoupServer *server,
+	SoupMessage *msg,
+	const char *path,
+	GHashTable *query,
+	SoupClientContext *client,
+	gpointer dataptr)
+{
+	struct lookup_test *t = dataptr;
+	if(t->fail) {
+		soup_message_set_status(msg, SOUP_STATUS_INTERNAL_SERVER_ERROR);
+		return;
+	}
+
+	const char *ids = query != NULL ? g_hash_table_lookup(query, "user_id")
+		: NULL;
+	fail_if(ids == NULL);
+	char **parts = g_strsplit(ids, ",", -1);
+	int n = g_strv_length(parts);
+	g_array_append_val(t->batch_sizes, n);
+	GString *body = g_string_new("[");
+	for(int i=0; i < n; i++) {
+		uint64_t id = g_ascii_strtoull(parts[i], NULL, 10);
+		gpointer key = g_memdup(&id, sizeof(id));
+		int times = GPOINTER_TO_INT(g_hash_table_lookup(t->asked, key));
+		g_hash_table_replace(t->asked, key, GINT_TO_POINTER(times + 1));
+		if(id % 7 == 0) continue;
+		g_string_append_printf(body,
+			"%s{\"id\":%llu,\"screen_name\":\"u%llu\"}",
+			body->len > 1 ? "," : "", (unsigned long long)id,
+			(unsigned long long)id);
+	}
+	g_string_append_c(body, ']');
+	g_strfreev(parts);
+	soup_message_set_status(msg, SOUP_STATUS_OK);
+	size_t len = body->len;
+	soup_message_set_response(msg, "application/json", SOUP_MEMORY_TAKE,
+		g_string_free(body, FALSE), len);
+}
+
+
+static SoupMessage *test_msg_fn(
+	const uint64_t *ids,
+	size_t num_ids,
+	void *dataptr)
+{
+	struct lookup_test *t = dataptr;
+	GString *uri = g_string_new("");
+	g_string_printf(uri, "http://127.0.0.1:%u/users?user_id=",
+		soup_server_get_port(t->server));
+	for(size_t i=0; i < num_ids; i++) {
+		g_string_append_printf(uri, "%s%llu", i > 0 ? "," : "",
+			(unsigned long long)ids[i]);
+	}
+	SoupMessage *msg = soup_message_new("GET", uri->str);
+	g_string_free(uri, TRUE);
+	return msg;
+}
+
+
+static void test_done_fn(
+	const uint64_t *ids,
+	size_t num_ids,
+	JsonArray *users,
+	const GError *err,
+	void *dataptr)
+{
+	struct lookup_test *t = dataptr;
+	if(users == NULL) {
+		fail_unless(err != NULL);
+		t->failed++;
+	} else {
+		fail_unless(json_array_get_length(users) <= num_ids);
+		t->users_got += json_array_get_length(users);
+	}
+	if(++t->done == t->want) g_main_loop_quit(t->loop);
+}
+
+
+static gboolean on_test_timeout(gpointer dataptr)
+{
+	struct lookup_test *t = dataptr;
+	g_main_loop_quit(t->loop);
+	return FALSE;
+}
+
+
+static void run_until_done(struct lookup_test *t, int want)
+{
+	t->want = want;
+	guint timeout = g_timeout_add_seconds(10, &on_test_timeout, t);
+	g_main_loop_run(t->loop);
+	g_source_remove(timeout);
+	fail_unless(t->done == want, "done %d, wanted %d", t->done, want);
+}
+
+
+static void lookup_test_setup(struct lookup_test *t, SoupSession *ss)
+{
+	memset(t, 0, sizeof(*t));
+	t->loop = g_main_loop_new(NULL, FALSE);
+	t->server = soup_server_new(SOUP_SERVER_PORT, SOUP_ADDRESS_ANY_PORT, NULL);
+	fail_if(t->server == NULL);
+	soup_server_add_handler(t->server, "/users", &users_handler, t, NULL);
+	soup_server_run_async(t->server);
+	t->reqs = request_sched_new(ss);
+	t->batch_sizes = g_array_new(FALSE, FALSE, sizeof(int));
+	t->asked = g_hash_table_new_full(&g_int64_hash, &g_int64_equal,
+		&g_free, NULL);
+}
+
+
+static void lookup_test_teardown(struct lookup_test *t)
+{
+	request_sched_free(t->reqs);
+	soup_server_quit(t->server);
+	g_object_unref(t->server);
+	g_array_free(t->batch_sizes, TRUE);
+	g_hash_table_destroy(t->asked);
+	g_main_loop_unref(t->loop);
+}
+
+
+/* full batches go out at once and the rest after a moment. nothing is
+ * asked for twice while it's on its way, and users that didn't come back
+ * aren't asked for again.
+ */
+START_TEST(batches_and_dedup)
+{
+	SoupSession *ss = soup_session_async_new();
+	struct lookup_test t;
+	lookup_test_setup(&t, ss);
+	struct user_lookup *l = user_lookup_new(t.reqs, &test_msg_fn,
+		&test_done_fn, &t);
+
+	for(int round=0; round < 2; round++) {
+		for(uint64_t id=1; id <= 250; id++) user_lookup_want(l, id);
+	}
+	user_lookup_want(l, 0);
+	fail_unless(user_lookup_pending(l) == 250);
+	run_until_done(&t, 3);
+
+	fail_unless(t.batch_sizes->len == 3);
+	int total = 0;
+	for(guint i=0; i < t.batch_sizes->len; i++) {
+		int n = g_array_index(t.batch_sizes, int, i);
+		fail_unless(n <= 100, "batch of %d", n);
+		total += n;
+	}
+	fail_unless(total == 250);
+	fail_unless(g_hash_table_size(t.asked) == 250);
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, t.asked);
+	while(g_hash_table_iter_next(&iter, &key, &value)) {
+		fail_unless(GPOINTER_TO_INT(value) == 1);
+	}
+	fail_unless(t.users_got == 250 - 250 / 7);
+	fail_unless(user_lookup_pending(l) == 0);
+
+	user_lookup_want(l, 7);
+	user_lookup_want(l, 14);
+	fail_unless(user_lookup_pending(l) == 0);
+	user_lookup_want(l, 8);
+	fail_unless(user_lookup_pending(l) == 1);
+	run_until_done(&t, 4);
+	fail_unless(g_array_index(t.batch_sizes, int, 3) == 1);
+
+	user_lookup_free(l);
+	lookup_test_teardown(&t);
+	g_object_unref(ss);
+}
+END_TEST
+
+
+/* a failed batch is reported, and its users may be wanted again. */
+START_TEST(failure_forgets)
+{
+	SoupSession *ss = soup_session_async_new();
+	struct lookup_test t;
+	lookup_test_setup(&t, ss);
+	struct user_lookup *l = user_lookup_new(t.reqs, &test_msg_fn,
+		&test_done_fn, &t);
+
+	t.fail = true;
+	user_lookup_want(l, 3);
+	run_until_done(&t, 1);
+	fail_unless(t.failed == 1);
+	fail_unless(user_lookup_pending(l) == 0);
+
+	t.fail = false;
+	user_lookup_want(l, 3);
+	fail_unless(user_lookup_pending(l) == 1);
+	run_until_done(&t, 2);
+	fail_unless(t.failed == 1 && t.users_got == 1);
+
+	user_lookup_free(l);
+	lookup_test_teardown(&t);
+	g_object_unref(ss);
+}
+END_TEST
+
+
+Suite *user_lookup_suite(void)
+{
+	Suite *s = suite_create("user_lookup");
+
+	TCase *tc_iface = tcase_create("interface");
+	tcase_set_timeout(tc_iface, 20);
+	suite_add_tcase(s, tc_iface);
+	tcase_add_test(tc_iface, batches_and_dedup);
+	tcase_add_test(tc_iface, failure_forgets);
+
+	return s;
+}
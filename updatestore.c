@@ -0,0 +1,549 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <glib.h>
+#include <glib-object.h>
+
+#include "defs.h"
+#include "pt-update.h"
+#include "pt-user-info.h"
+#include "pt-cache.h"
+
+
+#define NO_OFFSET UINT32_MAX
+
+/* flag bits */
+#define UF_FAVORITED 1
+#define UF_TRUNCATED 2
+#define UF_NO_TIMESTAMP 4
+#define UF_MUTED 8
+
+
+/* one entry per distinct "source", as interned by PtUpdateClass. */
+struct store_source {
+	const char *text, *uri;
+};
+
+
+/* a columnar store for updates. slots are assigned in order of arrival; an
+ * id index walks them largest first for paging back, and the views' own
+ * orderings are kept elsewhere (model.c). the store is shared
+ * between views; each pins the updates it shows, and update_store_trim()
+ * compacts away unpinned slots and their strings.
+ *
+ * strings live in a single text arena, NUL-terminated, and are referred to
+ * by offset. PtUpdate objects are only built on demand as facades over a
+ * slot, and are kept in a PtCache so that rows that're being drawn keep
+ * their markup around.
+ */
+struct update_store
+{
+	size_t count, alloc;
+	uint64_t *ids;
+	int64_t *times;			/* unix time, UTC */
+	uint64_t *author_ids;	/* 0 when not known */
+	uint64_t *rep_sids, *rep_uids;
+	uint32_t *text_offs, *rep_name_offs;
+	uint16_t *source_ixs;
+	uint16_t *pins;			/* number of views showing the update */
+	uint8_t *flags;
+
+	char *arena;
+	size_t arena_len, arena_alloc;
+
+	/* id -> slot + 1, open addressing with linear probing. 0 is empty. */
+	uint32_t *slot_hash;
+	size_t hash_mask;
+	struct id_index *order;	/* every stored id */
+
+	GArray *sources;		/* of struct store_source */
+
+	/* in_rep_to_sid -> GArray of the ids of its replies in the store. the
+	 * other direction is rep_sids.
+	 */
+	GHashTable *replies;
+
+	PtCache *user_cache;	/* ref */
+	PtCache *facades;		/* PtUpdate by &update->id */
+};
+
+
+static inline uint32_t id_hash(uint64_t x)
+{
+	/* 64-bit finalizer from MurmurHash3. */
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return (uint32_t)x;
+}
+
+
+static uint32_t *hash_probe(struct update_store *s, uint64_t id)
+{
+	size_t pos = id_hash(id) & s->hash_mask;
+	for(;;) {
+		uint32_t *p = &s->slot_hash[pos];
+		if(*p == 0 || s->ids[*p - 1] == id) return p;
+		pos = (pos + 1) & s->hash_mask;
+	}
+}
+
+
+static void hash_resize(struct update_store *s, size_t new_size)
+{
+	assert((new_size & (new_size - 1)) == 0);
+	g_free(s->slot_hash);
+	s->slot_hash = g_new0(uint32_t, new_size);
+	s->hash_mask = new_size - 1;
+	for(size_t i=0; i < s->count; i++) {
+		uint32_t *p = hash_probe(s, s->ids[i]);
+		assert(*p == 0);
+		*p = i + 1;
+	}
+}
+
+
+static int find_slot(struct update_store *s, uint64_t id)
+{
+	if(s->slot_hash == NULL) return -1;
+	uint32_t p = *hash_probe(s, id);
+	return p == 0 ? -1 : (int)p - 1;
+}
+
+
+static void grow_columns(struct update_store *s)
+{
+	size_t n = s->alloc == 0 ? 256 : s->alloc * 2;
+	s->ids = g_renew(uint64_t, s->ids, n);
+	s->times = g_renew(int64_t, s->times, n);
+	s->author_ids = g_renew(uint64_t, s->author_ids, n);
+	s->rep_sids = g_renew(uint64_t, s->rep_sids, n);
+	s->rep_uids = g_renew(uint64_t, s->rep_uids, n);
+	s->text_offs = g_renew(uint32_t, s->text_offs, n);
+	s->rep_name_offs = g_renew(uint32_t, s->rep_name_offs, n);
+	s->source_ixs = g_renew(uint16_t, s->source_ixs, n);
+	s->pins = g_renew(uint16_t, s->pins, n);
+	s->flags = g_renew(uint8_t, s->flags, n);
+	s->alloc = n;
+}
+
+
+static uint32_t arena_add(struct update_store *s, const char *str)
+{
+	if(str == NULL) return NO_OFFSET;
+
+	size_t len = strlen(str) + 1;
+	if(s->arena_len + len > s->arena_alloc) {
+		size_t n = MAX(s->arena_alloc * 2, 64 * 1024);
+		while(n < s->arena_len + len) n *= 2;
+		s->arena = g_realloc(s->arena, n);
+		s->arena_alloc = n;
+	}
+	assert(s->arena_len + len < NO_OFFSET);
+	uint32_t off = s->arena_len;
+	memcpy(&s->arena[off], str, len);
+	s->arena_len += len;
+	return off;
+}
+
+
+static inline const char *arena_str(struct update_store *s, uint32_t off) {
+	return off == NO_OFFSET ? NULL : &s->arena[off];
+}
+
+
+/* there are only a few dozen of these, so a linear scan is fine. the
+ * strings are interned, so pointer comparison suffices.
+ */
+static uint16_t source_ix(
+	struct update_store *s,
+	const char *text,
+	const char *uri)
+{
+	for(guint i=0; i < s->sources->len; i++) {
+		struct store_source *src = &g_array_index(s->sources,
+			struct store_source, i);
+		if(src->text == text && src->uri == uri) return i;
+	}
+	if(s->sources->len >= UINT16_MAX) {
+		g_warning("%s: too many distinct sources", __func__);
+		return 0;
+	}
+	struct store_source src = { .text = text, .uri = uri };
+	g_array_append_val(s->sources, src);
+	return s->sources->len - 1;
+}
+
+
+static void free_id_array(gpointer dataptr) {
+	g_array_free(dataptr, TRUE);
+}
+
+
+static void link_reply(struct update_store *s, uint64_t parent, uint64_t id)
+{
+	GArray *ids = g_hash_table_lookup(s->replies, &parent);
+	if(ids == NULL) {
+		ids = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+		g_hash_table_insert(s->replies, g_memdup(&parent, sizeof(parent)),
+			ids);
+	}
+	g_array_append_val(ids, id);
+}
+
+
+static void unlink_reply(struct update_store *s, uint64_t parent, uint64_t id)
+{
+	GArray *ids = g_hash_table_lookup(s->replies, &parent);
+	if(ids == NULL) return;
+	for(guint i=0; i < ids->len; i++) {
+		if(g_array_index(ids, uint64_t, i) == id) {
+			g_array_remove_index_fast(ids, i);
+			break;
+		}
+	}
+	if(ids->len == 0) g_hash_table_remove(s->replies, &parent);
+}
+
+
+struct update_store *update_store_new(PtCache *user_cache)
+{
+	struct update_store *s = g_new0(struct update_store, 1);
+	s->sources = g_array_new(FALSE, FALSE, sizeof(struct store_source));
+	s->replies = g_hash_table_new_full(&g_int64_hash, &g_int64_equal,
+		&g_free, &free_id_array);
+	s->order = id_index_new();
+	s->user_cache = g_object_ref(user_cache);
+	/* TODO: get these from config */
+	s->facades = g_object_new(PT_CACHE_TYPE,
+		"hash-fn", &g_int64_hash, "equal-fn", &g_int64_equal,
+		"high-watermark", 600, "low-watermark", 400,
+		NULL);
+	return s;
+}
+
+
+PtCache *update_store_get_user_cache(struct update_store *s) {
+	return s->user_cache;
+}
+
+
+void update_store_free(struct update_store *s)
+{
+	g_object_unref(s->facades);
+	g_object_unref(s->user_cache);
+	g_array_free(s->sources, TRUE);
+	g_hash_table_destroy(s->replies);
+	id_index_free(s->order);
+	g_free(s->slot_hash);
+	g_free(s->arena);
+	g_free(s->ids);
+	g_free(s->times);
+	g_free(s->author_ids);
+	g_free(s->rep_sids);
+	g_free(s->rep_uids);
+	g_free(s->text_offs);
+	g_free(s->rep_name_offs);
+	g_free(s->source_ixs);
+	g_free(s->pins);
+	g_free(s->flags);
+	g_free(s);
+}
+
+
+size_t update_store_count(struct update_store *s) {
+	return s->count;
+}
+
+
+bool update_store_has(struct update_store *s, uint64_t id) {
+	return find_slot(s, id) >= 0;
+}
+
+
+bool update_store_add(struct update_store *s, PtUpdate *u)
+{
+	if(find_slot(s, u->id) >= 0) return false;
+
+	if(s->count == s->alloc) grow_columns(s);
+	if((s->count + 1) * 2 > s->hash_mask + 1) {
+		hash_resize(s, s->slot_hash == NULL ? 512 : (s->hash_mask + 1) * 2);
+	}
+
+	size_t i = s->count++;
+	s->ids[i] = u->id;
+	s->flags[i] = (u->favorited ? UF_FAVORITED : 0)
+		| (u->truncated ? UF_TRUNCATED : 0)
+		| (u->timestamp == NULL ? UF_NO_TIMESTAMP : 0)
+		| (u->muted ? UF_MUTED : 0);
+	s->times[i] = u->timestamp == NULL ? 0 : g_date_time_to_unix(u->timestamp);
+	s->author_ids[i] = u->user != NULL ? u->user->id : 0;
+	s->rep_sids[i] = u->in_rep_to_sid;
+	s->rep_uids[i] = u->in_rep_to_uid;
+	s->text_offs[i] = arena_add(s, u->text);
+	s->rep_name_offs[i] = arena_add(s, u->in_rep_to_screen_name);
+	s->source_ixs[i] = source_ix(s, u->source, u->source_uri);
+	s->pins[i] = 0;
+
+	uint32_t *hp = hash_probe(s, u->id);
+	assert(*hp == 0);
+	*hp = i + 1;
+	id_index_insert(s->order, u->id);
+
+	if(u->in_rep_to_sid != 0) link_reply(s, u->in_rep_to_sid, u->id);
+
+	/* the freshly parsed object is the one most likely to be drawn next. */
+	pt_cache_put(s->facades, &u->id, 0, G_OBJECT(u));
+
+	return true;
+}
+
+
+static PtUpdate *make_facade(struct update_store *s, size_t i)
+{
+	PtUpdate *u = pt_update_new();
+	u->id = s->ids[i];
+	u->favorited = (s->flags[i] & UF_FAVORITED) != 0;
+	u->truncated = (s->flags[i] & UF_TRUNCATED) != 0;
+	u->muted = (s->flags[i] & UF_MUTED) != 0;
+	u->in_rep_to_sid = s->rep_sids[i];
+	u->in_rep_to_uid = s->rep_uids[i];
+	u->in_rep_to_screen_name = g_strdup(arena_str(s, s->rep_name_offs[i]));
+	u->text = g_strdup(arena_str(s, s->text_offs[i]));
+	const struct store_source *src = &g_array_index(s->sources,
+		struct store_source, s->source_ixs[i]);
+	u->source = src->text;
+	u->source_uri = src->uri;
+	if((s->flags[i] & UF_NO_TIMESTAMP) == 0) {
+		u->timestamp = g_date_time_new_from_unix_utc(s->times[i]);
+	}
+	if(s->author_ids[i] != 0) {
+		u->user = get_user_info(s->user_cache, s->author_ids[i]);
+		if(u->user != NULL) g_object_ref(u->user);
+	}
+	return u;
+}
+
+
+bool update_store_is_muted(struct update_store *s, uint64_t id)
+{
+	int slot = find_slot(s, id);
+	return slot >= 0 && (s->flags[slot] & UF_MUTED) != 0;
+}
+
+
+void update_store_refilter(
+	struct update_store *s,
+	struct mute_filter *f,
+	unsigned changes,
+	GArray *muted_out,
+	GArray *unmuted_out)
+{
+	/* added rules can only mute, and removed ones only unmute. */
+	bool check_unmuted = (changes & MUTE_RULES_ADDED) != 0,
+		check_muted = (changes & MUTE_RULES_REMOVED) != 0;
+	for(size_t i=0; i < s->count; i++) {
+		bool was = (s->flags[i] & UF_MUTED) != 0;
+		if(was ? !check_muted : !check_unmuted) continue;
+
+		const struct store_source *src = &g_array_index(s->sources,
+			struct store_source, s->source_ixs[i]);
+		bool now = mute_filter_match(f, arena_str(s, s->text_offs[i]),
+			s->author_ids[i], src->text);
+		if(now == was) continue;
+
+		if(now) {
+			s->flags[i] |= UF_MUTED;
+			if(muted_out != NULL) g_array_append_val(muted_out, s->ids[i]);
+		} else {
+			s->flags[i] &= ~UF_MUTED;
+			if(unmuted_out != NULL) {
+				g_array_append_val(unmuted_out, s->ids[i]);
+			}
+		}
+		/* the facade would carry the old verdict. */
+		pt_cache_remove(s->facades, &s->ids[i]);
+	}
+}
+
+
+uint64_t update_store_get_parent(struct update_store *s, uint64_t id)
+{
+	int slot = find_slot(s, id);
+	return slot < 0 ? 0 : s->rep_sids[slot];
+}
+
+
+size_t update_store_get_replies(
+	struct update_store *s,
+	uint64_t id,
+	GArray *ids_out)
+{
+	GArray *ids = g_hash_table_lookup(s->replies, &id);
+	if(ids == NULL) return 0;
+	g_array_append_vals(ids_out, ids->data, ids->len);
+	return ids->len;
+}
+
+
+const char *update_store_get_text(struct update_store *s, uint64_t id)
+{
+	int slot = find_slot(s, id);
+	return slot < 0 ? NULL : arena_str(s, s->text_offs[slot]);
+}
+
+
+uint64_t update_store_get_author(struct update_store *s, uint64_t id)
+{
+	int slot = find_slot(s, id);
+	return slot < 0 ? 0 : s->author_ids[slot];
+}
+
+
+void update_store_drop_facade(struct update_store *s, uint64_t id) {
+	pt_cache_remove(s->facades, &id);
+}
+
+
+PtUpdate *update_store_get(struct update_store *s, uint64_t id)
+{
+	GObject *obj = pt_cache_get(s->facades, &id);
+	if(obj != NULL) return PT_UPDATE(g_object_ref(obj));
+
+	int slot = find_slot(s, id);
+	if(slot < 0) return NULL;
+	PtUpdate *u = make_facade(s, slot);
+	pt_cache_put(s->facades, &u->id, 0, G_OBJECT(u));
+	return u;
+}
+
+
+static int cmp_id_desc(const void *ap, const void *bp)
+{
+	uint64_t a = *(const uint64_t *)ap, b = *(const uint64_t *)bp;
+	return a > b ? -1 : (a < b ? 1 : 0);
+}
+
+
+void update_store_pin(struct update_store *s, uint64_t id)
+{
+	int slot = find_slot(s, id);
+	g_return_if_fail(slot >= 0);
+	g_return_if_fail(s->pins[slot] < UINT16_MAX);
+	s->pins[slot]++;
+}
+
+
+void update_store_unpin(struct update_store *s, uint64_t id)
+{
+	int slot = find_slot(s, id);
+	g_return_if_fail(slot >= 0);
+	g_return_if_fail(s->pins[slot] > 0);
+	s->pins[slot]--;
+}
+
+
+size_t update_store_trim(struct update_store *s, size_t max_count)
+{
+	if(s->count <= max_count) return 0;
+
+	/* find the smallest unpinned id that stays. */
+	uint64_t *unpinned = g_new(uint64_t, s->count);
+	size_t n_unpinned = 0;
+	for(size_t i=0; i < s->count; i++) {
+		if(s->pins[i] == 0) unpinned[n_unpinned++] = s->ids[i];
+	}
+	size_t n_pinned = s->count - n_unpinned,
+		allowed = max_count > n_pinned ? max_count - n_pinned : 0;
+	if(n_unpinned <= allowed) {
+		g_free(unpinned);
+		return 0;
+	}
+	uint64_t floor = UINT64_MAX;
+	if(allowed > 0) {
+		qsort(unpinned, n_unpinned, sizeof(uint64_t), &cmp_id_desc);
+		floor = unpinned[allowed - 1];
+	}
+	g_free(unpinned);
+
+	/* compact the columns in place, and strings into a new arena. */
+	char *old_arena = s->arena;
+	s->arena = NULL;
+	s->arena_len = 0;
+	s->arena_alloc = 0;
+	size_t j = 0;
+	for(size_t i=0; i < s->count; i++) {
+		if(s->pins[i] == 0 && s->ids[i] < floor) {
+			/* takes the facade's markup along with it. */
+			pt_cache_remove(s->facades, &s->ids[i]);
+			id_index_remove(s->order, s->ids[i]);
+			if(s->rep_sids[i] != 0) {
+				unlink_reply(s, s->rep_sids[i], s->ids[i]);
+			}
+			continue;
+		}
+		s->ids[j] = s->ids[i];
+		s->times[j] = s->times[i];
+		s->author_ids[j] = s->author_ids[i];
+		s->rep_sids[j] = s->rep_sids[i];
+		s->rep_uids[j] = s->rep_uids[i];
+		s->source_ixs[j] = s->source_ixs[i];
+		s->pins[j] = s->pins[i];
+		s->flags[j] = s->flags[i];
+		s->text_offs[j] = s->text_offs[i] == NO_OFFSET ? NO_OFFSET
+			: arena_add(s, &old_arena[s->text_offs[i]]);
+		s->rep_name_offs[j] = s->rep_name_offs[i] == NO_OFFSET ? NO_OFFSET
+			: arena_add(s, &old_arena[s->rep_name_offs[i]]);
+		j++;
+	}
+	g_free(old_arena);
+
+	size_t dropped = s->count - j;
+	s->count = j;
+	size_t hash_size = 512;
+	while(s->count * 2 > hash_size) hash_size *= 2;
+	hash_resize(s, hash_size);
+
+	return dropped;
+}
+
+
+size_t update_store_older(
+	struct update_store *s,
+	uint64_t below,
+	size_t max_count,
+	GArray *ids_out)
+{
+	size_t count = id_index_count(s->order), n = 0;
+	for(size_t pos = id_index_rank(s->order, below);
+		pos < count && n < max_count;
+		pos++)
+	{
+		uint64_t id = id_index_nth(s->order, pos);
+		if(id >= below) continue;	/* `below' itself */
+		g_array_append_val(ids_out, id);
+		n++;
+	}
+	return n;
+}
+
+
+size_t update_store_find_author(
+	struct update_store *s,
+	uint64_t author_id,
+	GArray *ids_out)
+{
+	size_t found = 0;
+	for(size_t i=0; i < s->count; i++) {
+		if(s->author_ids[i] == author_id) {
+			g_array_append_val(ids_out, s->ids[i]);
+			found++;
+		}
+	}
+	return found;
+}
@@ -290,12 +290,18 @@ PtUserInfo *get_user_info(PtCache *cache, uint64_t uid)
  * - if not present, parse from object
  * - otherwise, update it and set the dirty flag when the object's data
  *   differs from stored
+ * - unless the object is trimmed down to its id, in which case it's left
+ *   as it was
  *
  * this function's purpose is a bit confused. the design isn't at all clean. i
  * blame the pipeweed.
  */
-PtUserInfo *get_user_info_from_json(PtCache *cache, JsonObject *obj)
+PtUserInfo *get_user_info_from_json(
+	PtCache *cache,
+	JsonObject *obj,
+	uint64_t *changed_p)
 {
+	if(changed_p != NULL) *changed_p = 0;
 	uint64_t uid = json_object_get_int_member(obj, "id");
 	if(uid == 0) return NULL;
 
@@ -307,23 +313,23 @@ PtUserInfo *get_user_info_from_json(PtCache *cache, JsonObject *obj)
 		if(inf == NULL) return NULL;
 	}
 
+	/* a trimmed user (trim_user=true) carries nothing but the id. what's
+	 * known comes from the cache or the database; the rest is looked up
+	 * when the user is shown.
+	 */
+	if(!json_object_has_member(obj, "screen_name")) return inf;
+
 	bool bare = (inf->screenname == NULL);
-	bool changed = true;	/* TODO: hunt */
+	uint64_t changed = 0;
 	GError *err = NULL;
-	/* FIXME: on failure pt_user_info_from_json() may leave *inf in a halfway
-	 * state. really what should be done is deserialize into a distinct object
-	 * and copy changed values one at a time, returning number of such fields.
-	 */
-	if(!pt_user_info_from_json(inf, obj, &err)) {
+	if(!pt_user_info_from_json(inf, obj, &changed, &err)) {
+		/* the cached record is left as it was. */
 		g_warning("%s: parsing user info json: %s", __func__, err->message);
 		g_error_free(err);
-
-		/* should remove the item from the cache. (store a NULL on top?)
-		 * but see fixme above.
-		 */
 		inf = NULL;
 	} else {
-		inf->dirty = inf->dirty || bare || changed;
+		inf->dirty = inf->dirty || bare || changed != 0;
+		if(changed_p != NULL) *changed_p = changed;
 	}
 
 	return inf;
@@ -0,0 +1,241 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <json-glib/json-glib.h>
+#include <libsoup/soup.h>
+
+#include "defs.h"
+
+
+/* most ids one users/lookup request may carry. */
+#define MAX_LOOKUP_IDS 100
+
+/* users wanted within this long of each other go out together. */
+#define LOOKUP_DELAY_MS 250
+
+
+/* bare users are collected into `pending', and sent for in batches of up
+ * to MAX_LOOKUP_IDS. an id is only ever in one batch at a time, and those
+ * that a batch doesn't bring back (suspended, deleted) aren't asked for
+ * again.
+ */
+struct user_lookup
+{
+	struct request_sched *reqs;
+	user_lookup_msg_fn msg_fn;
+	user_lookup_done_fn done_fn;
+	void *dataptr;
+
+	GArray *pending;		/* of uint64_t, in order of asking */
+	GHashTable *queued;		/* &id -> same; pending or in flight */
+	GHashTable *unavailable;
+	guint flush_id;
+	int batches;			/* in flight */
+	bool closing;
+};
+
+
+/* one users/lookup request in flight. */
+struct batch
+{
+	struct user_lookup *l;
+	size_t num_ids;
+	uint64_t ids[];
+};
+
+
+static inline bool id_in_set(GHashTable *set, uint64_t id) {
+	return g_hash_table_lookup(set, &id) != NULL;
+}
+
+
+static bool id_set_add(GHashTable *set, uint64_t id)
+{
+	if(id_in_set(set, id)) return false;
+	uint64_t *key = g_memdup(&id, sizeof(id));
+	g_hash_table_insert(set, key, key);
+	return true;
+}
+
+
+static GHashTable *id_set_new(void) {
+	return g_hash_table_new_full(&g_int64_hash, &g_int64_equal, &g_free, NULL);
+}
+
+
+static void lookup_destroy(struct user_lookup *l)
+{
+	g_array_free(l->pending, TRUE);
+	g_hash_table_destroy(l->queued);
+	g_hash_table_destroy(l->unavailable);
+	g_free(l);
+}
+
+
+/* the response is small enough to parse right here. */
+static JsonArray *parse_users(SoupMessage *msg, GError **err_p)
+{
+	if(msg->status_code != SOUP_STATUS_OK) {
+		g_set_error(err_p, SOUP_HTTP_ERROR, msg->status_code, "HTTP %u %s",
+			msg->status_code, soup_status_get_phrase(msg->status_code));
+		return NULL;
+	}
+
+	JsonParser *parser = json_parser_new();
+	JsonArray *users = NULL;
+	if(json_parser_load_from_data(parser, msg->response_body->data,
+		msg->response_body->length, err_p))
+	{
+		JsonNode *root = json_parser_get_root(parser);
+		if(root != NULL && JSON_NODE_HOLDS_ARRAY(root)) {
+			users = json_array_ref(json_node_get_array(root));
+		} else {
+			g_set_error(err_p, JSON_PARSER_ERROR, JSON_PARSER_ERROR_PARSE,
+				"response is not an array");
+		}
+	}
+	g_object_unref(parser);
+	return users;
+}
+
+
+static void on_batch_done(
+	SoupSession *session,
+	SoupMessage *msg,
+	gpointer dataptr)
+{
+	struct batch *b = dataptr;
+	struct user_lookup *l = b->l;
+	l->batches--;
+	for(size_t i=0; i < b->num_ids; i++) {
+		g_hash_table_remove(l->queued, &b->ids[i]);
+	}
+	if(l->closing) {
+		if(l->batches == 0) lookup_destroy(l);
+		g_free(b);
+		return;
+	}
+
+	GError *err = NULL;
+	JsonArray *users = parse_users(msg, &err);
+	if(users == NULL) {
+		/* they'll be asked for again when they're wanted again. */
+		g_debug("%s: lookup of %zu users failed: %s", __func__,
+			b->num_ids, err->message);
+	} else {
+		GHashTable *got = id_set_new();
+		guint len = json_array_get_length(users);
+		for(guint i=0; i < len; i++) {
+			JsonObject *obj = json_array_get_object_element(users, i);
+			if(obj != NULL && json_object_has_member(obj, "id")) {
+				id_set_add(got, json_object_get_int_member(obj, "id"));
+			}
+		}
+		for(size_t i=0; i < b->num_ids; i++) {
+			if(!id_in_set(got, b->ids[i])) {
+				id_set_add(l->unavailable, b->ids[i]);
+			}
+		}
+		g_hash_table_destroy(got);
+	}
+	(*l->done_fn)(b->ids, b->num_ids, users, err, l->dataptr);
+
+	if(users != NULL) json_array_unref(users);
+	if(err != NULL) g_error_free(err);
+	g_free(b);
+}
+
+
+static void send_batch(struct user_lookup *l, const uint64_t *ids, size_t n)
+{
+	struct batch *b = g_malloc(sizeof(struct batch) + sizeof(uint64_t) * n);
+	b->l = l;
+	b->num_ids = n;
+	memcpy(b->ids, ids, sizeof(uint64_t) * n);
+
+	SoupMessage *msg = (*l->msg_fn)(ids, n, l->dataptr);
+	if(msg == NULL) {
+		for(size_t i=0; i < n; i++) g_hash_table_remove(l->queued, &ids[i]);
+		g_free(b);
+		return;
+	}
+	l->batches++;
+	request_sched_queue(l->reqs, REQ_LOOKUP, msg, &on_batch_done, b);
+}
+
+
+static void flush(struct user_lookup *l)
+{
+	if(l->flush_id != 0) {
+		g_source_remove(l->flush_id);
+		l->flush_id = 0;
+	}
+	for(guint i=0; i < l->pending->len; i += MAX_LOOKUP_IDS) {
+		send_batch(l, &g_array_index(l->pending, uint64_t, i),
+			MIN(MAX_LOOKUP_IDS, l->pending->len - i));
+	}
+	g_array_set_size(l->pending, 0);
+}
+
+
+static gboolean on_flush_timeout(gpointer dataptr)
+{
+	struct user_lookup *l = dataptr;
+	l->flush_id = 0;
+	flush(l);
+	return FALSE;
+}
+
+
+struct user_lookup *user_lookup_new(
+	struct request_sched *reqs,
+	user_lookup_msg_fn msg_fn,
+	user_lookup_done_fn done_fn,
+	void *dataptr)
+{
+	struct user_lookup *l = g_new0(struct user_lookup, 1);
+	l->reqs = reqs;
+	l->msg_fn = msg_fn;
+	l->done_fn = done_fn;
+	l->dataptr = dataptr;
+	l->pending = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	l->queued = id_set_new();
+	l->unavailable = id_set_new();
+	return l;
+}
+
+
+/* batches in flight finish without a callback. */
+void user_lookup_free(struct user_lookup *l)
+{
+	if(l == NULL) return;
+	if(l->flush_id != 0) g_source_remove(l->flush_id);
+	l->flush_id = 0;
+	l->closing = true;
+	if(l->batches == 0) lookup_destroy(l);
+}
+
+
+void user_lookup_want(struct user_lookup *l, uint64_t user_id)
+{
+	if(user_id == 0 || id_in_set(l->unavailable, user_id)
+		|| !id_set_add(l->queued, user_id))
+	{
+		return;
+	}
+
+	g_array_append_val(l->pending, user_id);
+	if(l->pending->len >= MAX_LOOKUP_IDS) flush(l);
+	else if(l->flush_id == 0) {
+		l->flush_id = g_timeout_add(LOOKUP_DELAY_MS, &on_flush_timeout, l);
+	}
+}
+
+
+size_t user_lookup_pending(struct user_lookup *l) {
+	return g_hash_table_size(l->queued);
+}
@@ -0,0 +1,1026 @@
+/* a local stand-in for the parts of the twitter API that piiptyyt uses, for
+ * running the client and its benchmarks offline.
+ *
+ * it serves a home timeline (synthetic, or recorded from the real thing),
+ * status and user lookups, the user stream, and userpics, with optional
+ * latency, bandwidth limits, page size caps, rate limits and injected
+ * errors. JSON is gzipped and revalidated as a real server would. point the client at it with
+ *
+ *   PIIPTYYT_API_BASE=http://127.0.0.1:PORT \
+ *   PIIPTYYT_STREAM_BASE=http://127.0.0.1:PORT ./piiptyyt
+ *
+ * OAuth signatures aren't checked, and the OAuth endpoints hand out the
+ * same token to everyone. the first line on stdout is the base URI; a
+ * summary of what was served goes to stdout at exit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <gio/gio.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <json-glib/json-glib.h>
+#include <libsoup/soup.h>
+
+
+/* snowflake ids: milliseconds since this, shifted up by 22 bits. */
+#define TWEPOCH_MS 1288834974657LL
+
+#define USER_STREAM_PATH "/2/user.json"
+
+#define KEEPALIVE_SEC 30
+#define TICK_MS 100			/* for bandwidth-limited writes */
+
+
+/* options. */
+static int opt_port = 0;
+static char *opt_timeline = NULL;
+static int opt_history = 2000;
+static int opt_users = 150;
+static double opt_rate = 0.2;
+static double opt_reply_fraction = 0.1;
+static int opt_latency_ms = 0;
+static int opt_bandwidth_kbps = 0;
+static int opt_default_count = 20;
+static int opt_max_count = 200;
+static double opt_error_rate = 0;
+static int opt_error_status = SOUP_STATUS_SERVICE_UNAVAILABLE;
+static int opt_rate_limit = 350;
+static int opt_rate_window = 3600;
+static int opt_stream_drop_sec = 0;
+static int opt_avatar_size = 48;
+static int opt_duration = 0;
+static int opt_seed = 0;
+static gboolean opt_compress = TRUE;
+
+static const GOptionEntry option_entries[] = {
+	{ "port", 'p', 0, G_OPTION_ARG_INT, &opt_port,
+		"port to listen on (default: any)", "N" },
+	{ "timeline", 't', 0, G_OPTION_ARG_FILENAME, &opt_timeline,
+		"serve the JSON array of statuses in FILE instead of synthetic ones",
+		"FILE" },
+	{ "history", 0, 0, G_OPTION_ARG_INT, &opt_history,
+		"synthetic statuses to start with (2000)", "N" },
+	{ "users", 0, 0, G_OPTION_ARG_INT, &opt_users,
+		"synthetic users (150)", "N" },
+	{ "rate", 'r', 0, G_OPTION_ARG_DOUBLE, &opt_rate,
+		"new statuses per second (0.2)", "R" },
+	{ "reply-fraction", 0, 0, G_OPTION_ARG_DOUBLE, &opt_reply_fraction,
+		"share of synthetic statuses that are replies (0.1)", "F" },
+	{ "latency", 'l', 0, G_OPTION_ARG_INT, &opt_latency_ms,
+		"delay before each response (0)", "MS" },
+	{ "bandwidth", 'b', 0, G_OPTION_ARG_INT, &opt_bandwidth_kbps,
+		"response bandwidth, per response (unlimited)", "KBPS" },
+	{ "default-count", 0, 0, G_OPTION_ARG_INT, &opt_default_count,
+		"page size when `count' isn't given (20)", "N" },
+	{ "max-count", 0, 0, G_OPTION_ARG_INT, &opt_max_count,
+		"largest page served (200)", "N" },
+	{ "error-rate", 'e', 0, G_OPTION_ARG_DOUBLE, &opt_error_rate,
+		"share of API requests that fail (0)", "P" },
+	{ "error-status", 0, 0, G_OPTION_ARG_INT, &opt_error_status,
+		"HTTP status of those failures (503)", "CODE" },
+	{ "rate-limit", 0, 0, G_OPTION_ARG_INT, &opt_rate_limit,
+		"requests per endpoint per window (350; 0 for none)", "N" },
+	{ "rate-window", 0, 0, G_OPTION_ARG_INT, &opt_rate_window,
+		"rate limit window (3600)", "SEC" },
+	{ "stream-drop", 0, 0, G_OPTION_ARG_INT, &opt_stream_drop_sec,
+		"end stream connections after this long (never)", "SEC" },
+	{ "avatar-size", 0, 0, G_OPTION_ARG_INT, &opt_avatar_size,
+		"userpic width and height (48)", "PX" },
+	{ "duration", 'd', 0, G_OPTION_ARG_INT, &opt_duration,
+		"exit after this long (never)", "SEC" },
+	{ "seed", 0, 0, G_OPTION_ARG_INT, &opt_seed,
+		"random seed for synthetic data and errors (0)", "N" },
+	{ "no-compress", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE,
+		&opt_compress, "don't gzip JSON for clients that accept it", NULL },
+	{ NULL },
+};
+
+
+struct mock_status
+{
+	uint64_t id;
+	JsonObject *obj;
+};
+
+
+struct rate_window
+{
+	int remaining;
+	int64_t reset;			/* unix time */
+};
+
+
+struct endpoint_stats
+{
+	unsigned long requests, errors, limited, not_modified;
+	uint64_t bytes;			/* response bodies as sent */
+};
+
+
+/* a response that's held back for latency, or trickled out for bandwidth. */
+struct slow_response
+{
+	SoupServer *server;
+	SoupMessage *msg;
+	char *body;
+	size_t length, offset;
+	bool gone;				/* client went away */
+	gulong finished_id;
+};
+
+
+struct stream_client
+{
+	SoupMessage *msg;
+	guint drop_id;
+};
+
+
+static SoupServer *server = NULL;
+static char *base_uri = NULL;
+static GRand *rng = NULL;
+
+static GPtrArray *statuses = NULL;		/* of struct mock_status *, by id */
+static GHashTable *users = NULL;		/* &id -> JsonObject */
+static GArray *user_ids = NULL;			/* of uint64_t, authors of new ones */
+static GHashTable *avatars = NULL;		/* &id -> GString (PNG) */
+static GHashTable *rate_windows = NULL;	/* path -> struct rate_window */
+static GHashTable *stats = NULL;		/* path -> struct endpoint_stats */
+static GList *stream_clients = NULL;	/* of struct stream_client * */
+static uint64_t last_id = 0;
+
+static const char *const words[] = {
+	"the", "a", "coffee", "train", "late", "again", "new", "release",
+	"anyone", "know", "why", "build", "broke", "lunch", "meeting", "ok",
+	"weekend", "rain", "just", "shipped", "read", "this", "thread", "lol",
+	"patch", "review", "tomorrow", "cat", "bug", "fixed", "finally", "now",
+};
+
+
+static struct endpoint_stats *stats_for(const char *path)
+{
+	/* userpics all count as one. */
+	const char *key = g_str_has_prefix(path, "/avatars/") ? "/avatars/" : path;
+	struct endpoint_stats *st = g_hash_table_lookup(stats, key);
+	if(st == NULL) {
+		st = g_new0(struct endpoint_stats, 1);
+		g_hash_table_insert(stats, g_strdup(key), st);
+	}
+	return st;
+}
+
+
+static uint64_t next_id(int64_t unix_ms)
+{
+	uint64_t id = (uint64_t)(unix_ms - TWEPOCH_MS) << 22;
+	if(id <= last_id) id = last_id + 1;
+	last_id = id;
+	return id;
+}
+
+
+static char *format_created_at(int64_t unix_ms)
+{
+	GDateTime *dt = g_date_time_new_from_unix_utc(unix_ms / 1000);
+	char *s = g_date_time_format(dt, "%a %b %d %H:%M:%S +0000 %Y");
+	g_date_time_unref(dt);
+	return s;
+}
+
+
+static char *avatar_uri(uint64_t uid)
+{
+	return g_strdup_printf("%s/avatars/%llu.png", base_uri,
+		(unsigned long long)uid);
+}
+
+
+static JsonObject *make_user(uint64_t uid)
+{
+	JsonObject *u = json_object_new();
+	char *name = g_strdup_printf("user%llu", (unsigned long long)uid),
+		*longname = g_strdup_printf("Mock User %llu", (unsigned long long)uid),
+		*pic = avatar_uri(uid);
+	json_object_set_int_member(u, "id", uid);
+	json_object_set_string_member(u, "screen_name", name);
+	json_object_set_string_member(u, "name", longname);
+	json_object_set_string_member(u, "profile_image_url", pic);
+	json_object_set_boolean_member(u, "protected", FALSE);
+	json_object_set_boolean_member(u, "verified", uid % 17 == 0);
+	json_object_set_boolean_member(u, "following", TRUE);
+	g_free(name);
+	g_free(longname);
+	g_free(pic);
+	return u;
+}
+
+
+static void add_status(uint64_t id, JsonObject *obj)
+{
+	struct mock_status *st = g_new(struct mock_status, 1);
+	st->id = id;
+	st->obj = obj;
+	g_ptr_array_add(statuses, st);
+}
+
+
+/* a status by a random user, now or in the past. some are replies to
+ * earlier ones.
+ */
+static JsonObject *make_status(int64_t unix_ms)
+{
+	uint64_t id = next_id(unix_ms),
+		uid = g_array_index(user_ids, uint64_t,
+			g_rand_int_range(rng, 0, user_ids->len));
+	JsonObject *user = g_hash_table_lookup(users, &uid);
+
+	GString *text = g_string_new("");
+	JsonObject *parent = NULL;
+	if(statuses->len > 0 && g_rand_double(rng) < opt_reply_fraction) {
+		/* to one of the latest few hundred. */
+		guint back = g_rand_int_range(rng, 0, MIN(statuses->len, 300));
+		struct mock_status *p = g_ptr_array_index(statuses,
+			statuses->len - 1 - back);
+		parent = p->obj;
+		JsonObject *pu = json_object_get_object_member(parent, "user");
+		g_string_append_printf(text, "@%s ",
+			json_object_get_string_member(pu, "screen_name"));
+	}
+	int n_words = g_rand_int_range(rng, 3, 20);
+	for(int i=0; i < n_words; i++) {
+		g_string_append_printf(text, "%s%s", i > 0 ? " " : "",
+			words[g_rand_int_range(rng, 0, G_N_ELEMENTS(words))]);
+	}
+
+	JsonObject *st = json_object_new();
+	char *created = format_created_at(unix_ms);
+	json_object_set_int_member(st, "id", id);
+	json_object_set_string_member(st, "text", text->str);
+	json_object_set_string_member(st, "created_at", created);
+	json_object_set_string_member(st, "source",
+		"<a href=\"http://example.com/\" rel=\"nofollow\">mockapi</a>");
+	json_object_set_boolean_member(st, "favorited", FALSE);
+	json_object_set_boolean_member(st, "truncated", FALSE);
+	if(parent != NULL) {
+		JsonObject *pu = json_object_get_object_member(parent, "user");
+		json_object_set_int_member(st, "in_reply_to_status_id",
+			json_object_get_int_member(parent, "id"));
+		json_object_set_int_member(st, "in_reply_to_user_id",
+			json_object_get_int_member(pu, "id"));
+		json_object_set_string_member(st, "in_reply_to_screen_name",
+			json_object_get_string_member(pu, "screen_name"));
+	} else {
+		json_object_set_null_member(st, "in_reply_to_status_id");
+		json_object_set_null_member(st, "in_reply_to_user_id");
+		json_object_set_null_member(st, "in_reply_to_screen_name");
+	}
+	json_object_set_object_member(st, "user", json_object_ref(user));
+	g_free(created);
+	g_string_free(text, TRUE);
+
+	add_status(id, st);
+	return st;
+}
+
+
+static void make_synthetic(void)
+{
+	for(int i=1; i <= opt_users; i++) {
+		uint64_t *key = g_new(uint64_t, 1);
+		*key = i;
+		g_hash_table_insert(users, key, make_user(i));
+		g_array_append_val(user_ids, *key);
+	}
+
+	/* history at the same pace as what's to come. */
+	int64_t now_ms = g_get_real_time() / 1000,
+		step_ms = opt_rate > 0 ? 1000 / opt_rate : 30 * 1000;
+	for(int i = opt_history; i > 0; i--) {
+		make_status(now_ms - i * step_ms);
+	}
+}
+
+
+static int cmp_status_ptr(const void *a, const void *b)
+{
+	const struct mock_status *x = *(struct mock_status *const *)a,
+		*y = *(struct mock_status *const *)b;
+	return x->id < y->id ? -1 : (x->id > y->id ? 1 : 0);
+}
+
+
+/* statuses from a file, as saved from home_timeline.json or similar. their
+ * users' userpics are redirected here.
+ */
+static bool load_recorded(const char *path, GError **err_p)
+{
+	JsonParser *parser = json_parser_new();
+	if(!json_parser_load_from_file(parser, path, err_p)) {
+		g_object_unref(parser);
+		return false;
+	}
+	JsonNode *root = json_parser_get_root(parser);
+	if(root == NULL || json_node_get_node_type(root) != JSON_NODE_ARRAY) {
+		g_set_error(err_p, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+			"`%s' isn't a JSON array", path);
+		g_object_unref(parser);
+		return false;
+	}
+
+	JsonArray *arr = json_node_get_array(root);
+	for(guint i=0; i < json_array_get_length(arr); i++) {
+		JsonObject *st = json_array_get_object_element(arr, i);
+		if(st == NULL || !json_object_has_member(st, "id")
+			|| !json_object_has_member(st, "user"))
+		{
+			continue;
+		}
+		JsonObject *user = json_object_get_object_member(st, "user");
+		uint64_t uid = json_object_get_int_member(user, "id");
+		char *pic = avatar_uri(uid);
+		json_object_set_string_member(user, "profile_image_url", pic);
+		g_free(pic);
+		if(g_hash_table_lookup(users, &uid) == NULL) {
+			uint64_t *key = g_new(uint64_t, 1);
+			*key = uid;
+			g_hash_table_insert(users, key, json_object_ref(user));
+			g_array_append_val(user_ids, uid);
+		}
+		add_status(json_object_get_int_member(st, "id"),
+			json_object_ref(st));
+	}
+	g_ptr_array_sort(statuses, &cmp_status_ptr);
+	if(statuses->len > 0) {
+		last_id = ((struct mock_status *)g_ptr_array_index(statuses,
+			statuses->len - 1))->id;
+	}
+	g_object_unref(parser);
+	return true;
+}
+
+
+/* index of the first status with an id greater than `id'. */
+static guint status_upper_bound(uint64_t id)
+{
+	guint lo = 0, hi = statuses->len;
+	while(lo < hi) {
+		guint mid = (lo + hi) / 2;
+		if(((struct mock_status *)g_ptr_array_index(statuses, mid))->id <= id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+
+static char *to_json(JsonNode *node, gsize *len_p)
+{
+	JsonGenerator *gen = json_generator_new();
+	json_generator_set_root(gen, node);
+	char *data = json_generator_to_data(gen, len_p);
+	g_object_unref(gen);
+	return data;
+}
+
+
+static char *array_to_json(JsonArray *arr, gsize *len_p)
+{
+	JsonNode *node = json_node_new(JSON_NODE_ARRAY);
+	json_node_take_array(node, arr);
+	char *data = to_json(node, len_p);
+	json_node_free(node);
+	return data;
+}
+
+
+static uint64_t query_u64(GHashTable *query, const char *key, uint64_t dflt)
+{
+	const char *val = query != NULL ? g_hash_table_lookup(query, key) : NULL;
+	return val != NULL ? g_ascii_strtoull(val, NULL, 10) : dflt;
+}
+
+
+/* as the API reads booleans: "true", "t" or "1". */
+static bool query_flag(GHashTable *query, const char *key)
+{
+	const char *val = query != NULL ? g_hash_table_lookup(query, key) : NULL;
+	return val != NULL && (strcmp(val, "true") == 0 || strcmp(val, "t") == 0
+		|| strcmp(val, "1") == 0);
+}
+
+
+/* a status as it goes out. trim_user leaves just the author's id. */
+static JsonObject *status_out(JsonObject *st, bool trim_user)
+{
+	if(!trim_user) return json_object_ref(st);
+
+	JsonObject *out = json_object_new();
+	GList *names = json_object_get_members(st);
+	for(GList *cur = names; cur != NULL; cur = g_list_next(cur)) {
+		const char *name = cur->data;
+		if(strcmp(name, "user") == 0) continue;
+		json_object_set_member(out, name, json_object_dup_member(st, name));
+	}
+	g_list_free(names);
+
+	JsonObject *user = json_object_get_object_member(st, "user"),
+		*bare = json_object_new();
+	uint64_t uid = json_object_get_int_member(user, "id");
+	char *id_str = g_strdup_printf("%llu", (unsigned long long)uid);
+	json_object_set_int_member(bare, "id", uid);
+	json_object_set_string_member(bare, "id_str", id_str);
+	json_object_set_object_member(out, "user", bare);
+	g_free(id_str);
+	return out;
+}
+
+
+static void on_slow_finished(SoupMessage *msg, gpointer dataptr)
+{
+	struct slow_response *r = dataptr;
+	r->gone = true;
+}
+
+
+static void slow_response_free(struct slow_response *r)
+{
+	g_signal_handler_disconnect(r->msg, r->finished_id);
+	g_object_unref(r->msg);
+	g_free(r->body);
+	g_free(r);
+}
+
+
+static gboolean on_trickle(gpointer dataptr)
+{
+	struct slow_response *r = dataptr;
+	if(r->gone) {
+		slow_response_free(r);
+		return FALSE;
+	}
+
+	size_t piece = MAX(1, (size_t)opt_bandwidth_kbps * 1024 * TICK_MS / 1000);
+	if(opt_bandwidth_kbps == 0) piece = r->length;
+	piece = MIN(piece, r->length - r->offset);
+	if(piece > 0) {
+		soup_message_body_append(r->msg->response_body, SOUP_MEMORY_COPY,
+			r->body + r->offset, piece);
+		r->offset += piece;
+	}
+	bool done = r->offset == r->length;
+	if(done) soup_message_body_complete(r->msg->response_body);
+	soup_server_unpause_message(r->server, r->msg);
+	if(done) slow_response_free(r);
+	return !done;
+}
+
+
+static gboolean on_latency_over(gpointer dataptr)
+{
+	struct slow_response *r = dataptr;
+	if(opt_bandwidth_kbps > 0) {
+		g_timeout_add(TICK_MS, &on_trickle, r);
+		return FALSE;
+	}
+	on_trickle(r);
+	return FALSE;
+}
+
+
+/* returns a gzip of `body', or NULL on failure. */
+static char *gzip_body(const char *body, size_t length, size_t *len_p)
+{
+	GZlibCompressor *gz = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP,
+		-1);
+	size_t alloc = length / 2 + 64, out_len = 0, in_off = 0;
+	char *out = g_malloc(alloc);
+	GConverterResult res;
+	do {
+		if(out_len == alloc) out = g_realloc(out, alloc *= 2);
+		gsize n_read = 0, n_written = 0;
+		GError *err = NULL;
+		res = g_converter_convert(G_CONVERTER(gz), body + in_off,
+			length - in_off, out + out_len, alloc - out_len,
+			G_CONVERTER_INPUT_AT_END, &n_read, &n_written, &err);
+		if(res == G_CONVERTER_ERROR) {
+			bool no_space = g_error_matches(err, G_IO_ERROR,
+				G_IO_ERROR_NO_SPACE);
+			g_error_free(err);
+			if(no_space) {
+				out = g_realloc(out, alloc *= 2);
+				continue;
+			}
+			g_free(out);
+			out = NULL;
+			break;
+		}
+		in_off += n_read;
+		out_len += n_written;
+	} while(res != G_CONVERTER_FINISHED);
+	g_object_unref(gz);
+	*len_p = out_len;
+	return out;
+}
+
+
+/* JSON gets an ETag, and a 304 when the client has it already. otherwise
+ * it goes out gzipped to those that accept it. returns false when `msg'
+ * has been answered.
+ */
+static bool encode_json(SoupMessage *msg, char **body_p, size_t *len_p)
+{
+	char *sum = g_compute_checksum_for_data(G_CHECKSUM_MD5,
+		(const guchar *)*body_p, *len_p);
+	char *etag = g_strdup_printf("\"%s\"", sum);
+	g_free(sum);
+	soup_message_headers_replace(msg->response_headers, "ETag", etag);
+	const char *match = soup_message_headers_get_one(msg->request_headers,
+		"If-None-Match");
+	bool fresh = match != NULL && strcmp(match, etag) == 0;
+	g_free(etag);
+	if(fresh) {
+		const char *path = soup_uri_get_path(soup_message_get_uri(msg));
+		stats_for(path)->not_modified++;
+		soup_message_set_status(msg, SOUP_STATUS_NOT_MODIFIED);
+		g_free(*body_p);
+		return false;
+	}
+
+	const char *accept = soup_message_headers_get_one(msg->request_headers,
+		"Accept-Encoding");
+	if(opt_compress && accept != NULL && strstr(accept, "gzip") != NULL) {
+		size_t len;
+		char *gz = gzip_body(*body_p, *len_p, &len);
+		if(gz != NULL) {
+			g_free(*body_p);
+			*body_p = gz;
+			*len_p = len;
+			soup_message_headers_replace(msg->response_headers,
+				"Content-Encoding", "gzip");
+		}
+	}
+	return true;
+}
+
+
+/* takes `body'. */
+static void respond(
+	SoupMessage *msg,
+	guint status,
+	const char *content_type,
+	char *body,
+	size_t length)
+{
+	if(status == SOUP_STATUS_OK
+		&& strcmp(content_type, "application/json") == 0
+		&& !encode_json(msg, &body, &length))
+	{
+		return;
+	}
+
+	const char *path = soup_uri_get_path(soup_message_get_uri(msg));
+	stats_for(path)->bytes += length;
+	soup_message_set_status(msg, status);
+	if(opt_latency_ms == 0 && opt_bandwidth_kbps == 0) {
+		soup_message_set_response(msg, content_type, SOUP_MEMORY_TAKE,
+			body, length);
+		return;
+	}
+
+	soup_message_headers_set_content_type(msg->response_headers,
+		content_type, NULL);
+	soup_message_headers_set_encoding(msg->response_headers,
+		SOUP_ENCODING_CHUNKED);
+	struct slow_response *r = g_new0(struct slow_response, 1);
+	r->server = server;
+	r->msg = g_object_ref(msg);
+	r->body = body;
+	r->length = length;
+	r->finished_id = g_signal_connect(msg, "finished",
+		G_CALLBACK(&on_slow_finished), r);
+	soup_server_pause_message(server, msg);
+	g_timeout_add(opt_latency_ms, &on_latency_over, r);
+}
+
+
+static void respond_error(SoupMessage *msg, guint status, const char *what)
+{
+	char *body = g_strdup_printf("{\"error\":\"%s\"}", what);
+	respond(msg, status, "application/json", body, strlen(body));
+}
+
+
+/* applies the rate limit and error injection to API endpoints. returns
+ * false when `msg' has been answered already.
+ */
+static bool admit(SoupMessage *msg, const char *path)
+{
+	struct endpoint_stats *st = stats_for(path);
+	st->requests++;
+
+	if(opt_rate_limit > 0 && g_str_has_prefix(path, "/1/")) {
+		int64_t now = g_get_real_time() / G_USEC_PER_SEC;
+		struct rate_window *w = g_hash_table_lookup(rate_windows, path);
+		if(w == NULL) {
+			w = g_new0(struct rate_window, 1);
+			g_hash_table_insert(rate_windows, g_strdup(path), w);
+		}
+		if(w->reset <= now) {
+			w->remaining = opt_rate_limit;
+			w->reset = now + opt_rate_window;
+		}
+		if(w->remaining > 0) w->remaining--;
+		else {
+			st->limited++;
+			soup_message_headers_replace(msg->response_headers,
+				"X-RateLimit-Remaining", "0");
+			char buf[32];
+			snprintf(buf, sizeof(buf), "%lld", (long long)w->reset);
+			soup_message_headers_replace(msg->response_headers,
+				"X-RateLimit-Reset", buf);
+			respond_error(msg, 429, "rate limit exceeded");
+			return false;
+		}
+
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%d", opt_rate_limit);
+		soup_message_headers_replace(msg->response_headers,
+			"X-RateLimit-Limit", buf);
+		snprintf(buf, sizeof(buf), "%d", w->remaining);
+		soup_message_headers_replace(msg->response_headers,
+			"X-RateLimit-Remaining", buf);
+		snprintf(buf, sizeof(buf), "%lld", (long long)w->reset);
+		soup_message_headers_replace(msg->response_headers,
+			"X-RateLimit-Reset", buf);
+	}
+
+	if(opt_error_rate > 0 && g_rand_double(rng) < opt_error_rate) {
+		st->errors++;
+		respond_error(msg, opt_error_status, "injected");
+		return false;
+	}
+	return true;
+}
+
+
+static void home_timeline_handler(
+	SoupServer *server,
+	SoupMessage *msg,
+	const char *path,
+	GHashTable *query,
+	SoupClientContext *client,
+	gpointer dataptr)
+{
+	if(!admit(msg, path)) return;
+
+	int count = CLAMP(query_u64(query, "count", opt_default_count),
+		1, opt_max_count);
+	uint64_t since_id = query_u64(query, "since_id", 0),
+		max_id = query_u64(query, "max_id", UINT64_MAX);
+	bool trim = query_flag(query, "trim_user");
+
+	JsonArray *arr = json_array_new();
+	guint top = status_upper_bound(max_id),
+		bottom = status_upper_bound(since_id);
+	for(guint i = top; i > bottom && count > 0; i--, count--) {
+		struct mock_status *st = g_ptr_array_index(statuses, i - 1);
+		json_array_add_object_element(arr, status_out(st->obj, trim));
+	}
+	gsize len;
+	char *body = array_to_json(arr, &len);
+	respond(msg, SOUP_STATUS_OK, "application/json", body, len);
+}
+
+
+static void status_lookup_handler(
+	SoupServer *server,
+	SoupMessage *msg,
+	const char *path,
+	GHashTable *query,
+	SoupClientContext *client,
+	gpointer dataptr)
+{
+	if(!admit(msg, path)) return;
+
+	const char *ids = query != NULL ? g_hash_table_lookup(query, "id") : NULL;
+	bool trim = query_flag(query, "trim_user");
+	char **parts = g_strsplit(ids != NULL ? ids : "", ",", -1);
+	JsonArray *arr = json_array_new();
+	for(int i=0; parts[i] != NULL; i++) {
+		uint64_t id = g_ascii_strtoull(parts[i], NULL, 10);
+		guint pos = status_upper_bound(id);
+		if(pos == 0) continue;
+		struct mock_status *st = g_ptr_array_index(statuses, pos - 1);
+		if(st->id == id) {
+			json_array_add_object_element(arr, status_out(st->obj, trim));
+		}
+	}
+	g_strfreev(parts);
+	gsize len;
+	char *body = array_to_json(arr, &len);
+	respond(msg, SOUP_STATUS_OK, "application/json", body, len);
+}
+
+
+static void user_lookup_handler(
+	SoupServer *server,
+	SoupMessage *msg,
+	const char *path,
+	GHashTable *query,
+	SoupClientContext *client,
+	gpointer dataptr)
+{
+	if(!admit(msg, path)) return;
+
+	const char *ids = query != NULL
+		? g_hash_table_lookup(query, "user_id") : NULL;
+	char **parts = g_strsplit(ids != NULL ? ids : "", ",", -1);
+	JsonArray *arr = json_array_new();
+	for(int i=0; parts[i] != NULL; i++) {
+		uint64_t uid = g_ascii_strtoull(parts[i], NULL, 10);
+		JsonObject *u = g_hash_table_lookup(users, &uid);
+		if(u != NULL) json_array_add_object_element(arr, json_object_ref(u));
+	}
+	g_strfreev(parts);
+	gsize len;
+	char *body = array_to_json(arr, &len);
+	respond(msg, SOUP_STATUS_OK, "application/json", body, len);
+}
+
+
+/* a flat square in a colour of the user's own. */
+static void avatar_handler(
+	SoupServer *server,
+	SoupMessage *msg,
+	const char *path,
+	GHashTable *query,
+	SoupClientContext *client,
+	gpointer dataptr)
+{
+	if(!admit(msg, path)) return;
+
+	uint64_t uid = g_ascii_strtoull(path + strlen("/avatars/"), NULL, 10);
+	if(g_hash_table_lookup(users, &uid) == NULL) {
+		respond_error(msg, SOUP_STATUS_NOT_FOUND, "no such user");
+		return;
+	}
+	GString *png = g_hash_table_lookup(avatars, &uid);
+	if(png == NULL) {
+		GdkPixbuf *pb = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8,
+			opt_avatar_size, opt_avatar_size);
+		gdk_pixbuf_fill(pb, (guint32)(g_int64_hash(&uid) * 2654435761u) | 0xff);
+		gchar *data = NULL;
+		gsize len = 0;
+		GError *err = NULL;
+		if(!gdk_pixbuf_save_to_buffer(pb, &data, &len, "png", &err, NULL)) {
+			g_warning("can't encode userpic: %s", err->message);
+			g_error_free(err);
+			g_object_unref(pb);
+			respond_error(msg, SOUP_STATUS_INTERNAL_SERVER_ERROR, "png");
+			return;
+		}
+		g_object_unref(pb);
+		png = g_string_new_len(data, len);
+		g_free(data);
+		g_hash_table_insert(avatars, g_memdup(&uid, sizeof(uid)), png);
+	}
+	respond(msg, SOUP_STATUS_OK, "image/png", g_memdup(png->str, png->len),
+		png->len);
+}
+
+
+static void oauth_handler(
+	SoupServer *server,
+	SoupMessage *msg,
+	const char *path,
+	GHashTable *query,
+	SoupClientContext *client,
+	gpointer dataptr)
+{
+	stats_for(path)->requests++;
+	char *body;
+	const char *type = "application/x-www-form-urlencoded";
+	if(strcmp(path, "/oauth/request_token") == 0) {
+		body = g_strdup("oauth_token=mockrequest&oauth_token_secret=mock"
+			"&oauth_callback_confirmed=true");
+	} else if(strcmp(path, "/oauth/access_token") == 0) {
+		body = g_strdup("oauth_token=mockaccess&oauth_token_secret=mock"
+			"&user_id=1&screen_name=user1");
+	} else {
+		/* "authorize", for the browser. */
+		type = "text/html";
+		body = g_strdup("<html><body><p>PIN: 0000</p></body></html>");
+	}
+	respond(msg, SOUP_STATUS_OK, type, body, strlen(body));
+}
+
+
+static void stream_client_free(struct stream_client *c)
+{
+	if(c->drop_id != 0) g_source_remove(c->drop_id);
+	g_object_unref(c->msg);
+	g_free(c);
+}
+
+
+static void on_stream_client_finished(SoupMessage *msg, gpointer dataptr)
+{
+	struct stream_client *c = dataptr;
+	stream_clients = g_list_remove(stream_clients, c);
+	g_signal_handlers_disconnect_by_func(msg, &on_stream_client_finished, c);
+	stream_client_free(c);
+}
+
+
+static void stream_write(struct stream_client *c, const char *data, size_t len)
+{
+	soup_message_body_append(c->msg->response_body, SOUP_MEMORY_COPY,
+		data, len);
+	stats_for(USER_STREAM_PATH)->bytes += len;
+	soup_server_unpause_message(server, c->msg);
+}
+
+
+static gboolean on_stream_drop(gpointer dataptr)
+{
+	struct stream_client *c = dataptr;
+	c->drop_id = 0;
+	soup_message_body_complete(c->msg->response_body);
+	soup_server_unpause_message(server, c->msg);
+	return FALSE;
+}
+
+
+static void user_stream_handler(
+	SoupServer *server,
+	SoupMessage *msg,
+	const char *path,
+	GHashTable *query,
+	SoupClientContext *client,
+	gpointer dataptr)
+{
+	stats_for(path)->requests++;
+	if(opt_error_rate > 0 && g_rand_double(rng) < opt_error_rate) {
+		stats_for(path)->errors++;
+		respond_error(msg, opt_error_status, "injected");
+		return;
+	}
+
+	soup_message_set_status(msg, SOUP_STATUS_OK);
+	soup_message_headers_set_content_type(msg->response_headers,
+		"application/json", NULL);
+	soup_message_headers_set_encoding(msg->response_headers,
+		SOUP_ENCODING_CHUNKED);
+	struct stream_client *c = g_new0(struct stream_client, 1);
+	c->msg = g_object_ref(msg);
+	if(opt_stream_drop_sec > 0) {
+		c->drop_id = g_timeout_add_seconds(opt_stream_drop_sec,
+			&on_stream_drop, c);
+	}
+	g_signal_connect(msg, "finished", G_CALLBACK(&on_stream_client_finished),
+		c);
+	stream_clients = g_list_prepend(stream_clients, c);
+
+	/* the friends list comes first; the client skips what isn't a status. */
+	const char *hello = "{\"friends\":[]}\r\n";
+	stream_write(c, hello, strlen(hello));
+}
+
+
+static gboolean on_keepalive(gpointer dataptr)
+{
+	for(GList *cur = stream_clients; cur != NULL; cur = g_list_next(cur)) {
+		stream_write(cur->data, "\r\n", 2);
+	}
+	return TRUE;
+}
+
+
+/* a new status, also written to each stream. */
+static gboolean on_new_status(gpointer dataptr)
+{
+	JsonObject *st = make_status(g_get_real_time() / 1000);
+	JsonNode *node = json_node_new(JSON_NODE_OBJECT);
+	json_node_set_object(node, st);
+	gsize len;
+	char *json = to_json(node, &len);
+	json_node_free(node);
+	GString *line = g_string_new_len(json, len);
+	g_string_append(line, "\r\n");
+	for(GList *cur = stream_clients; cur != NULL; cur = g_list_next(cur)) {
+		stream_write(cur->data, line->str, line->len);
+	}
+	g_string_free(line, TRUE);
+	g_free(json);
+	return TRUE;
+}
+
+
+static void print_stats(void)
+{
+	GList *keys = g_list_sort(g_hash_table_get_keys(stats),
+		(GCompareFunc)&strcmp);
+	printf("%-34s %9s %7s %7s %7s %12s\n", "endpoint", "requests", "errors",
+		"limited", "notmod", "bytes");
+	for(GList *cur = keys; cur != NULL; cur = g_list_next(cur)) {
+		const struct endpoint_stats *st = g_hash_table_lookup(stats,
+			cur->data);
+		printf("%-34s %9lu %7lu %7lu %7lu %12llu\n", (const char *)cur->data,
+			st->requests, st->errors, st->limited, st->not_modified,
+			(unsigned long long)st->bytes);
+	}
+	g_list_free(keys);
+}
+
+
+static gboolean on_duration_over(gpointer dataptr)
+{
+	g_main_loop_quit(dataptr);
+	return FALSE;
+}
+
+
+int main(int argc, char *argv[])
+{
+	g_type_init();
+
+	GError *err = NULL;
+	GOptionContext *oc = g_option_context_new("- mock twitter API server");
+	g_option_context_add_main_entries(oc, option_entries, NULL);
+	if(!g_option_context_parse(oc, &argc, &argv, &err)) {
+		fprintf(stderr, "%s\n", err->message);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(oc);
+	if(opt_users < 1 || opt_max_count < 1 || opt_rate < 0) {
+		fprintf(stderr, "invalid --users, --max-count or --rate\n");
+		return EXIT_FAILURE;
+	}
+
+	rng = g_rand_new_with_seed(opt_seed);
+	statuses = g_ptr_array_new();
+	user_ids = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	users = g_hash_table_new_full(&g_int64_hash, &g_int64_equal,
+		&g_free, (GDestroyNotify)&json_object_unref);
+	avatars = g_hash_table_new(&g_int64_hash, &g_int64_equal);
+	rate_windows = g_hash_table_new_full(&g_str_hash, &g_str_equal,
+		&g_free, &g_free);
+	stats = g_hash_table_new_full(&g_str_hash, &g_str_equal,
+		&g_free, &g_free);
+
+	server = soup_server_new(SOUP_SERVER_PORT, opt_port, NULL);
+	if(server == NULL) {
+		fprintf(stderr, "can't listen on port %d\n", opt_port);
+		return EXIT_FAILURE;
+	}
+	base_uri = g_strdup_printf("http://127.0.0.1:%u",
+		soup_server_get_port(server));
+
+	if(opt_timeline != NULL) {
+		if(!load_recorded(opt_timeline, &err)) {
+			fprintf(stderr, "can't load `%s': %s\n", opt_timeline,
+				err->message);
+			return EXIT_FAILURE;
+		}
+	} else {
+		make_synthetic();
+	}
+
+	soup_server_add_handler(server, "/1/statuses/home_timeline.json",
+		&home_timeline_handler, NULL, NULL);
+	soup_server_add_handler(server, "/1/statuses/lookup.json",
+		&status_lookup_handler, NULL, NULL);
+	soup_server_add_handler(server, "/1/users/lookup.json",
+		&user_lookup_handler, NULL, NULL);
+	soup_server_add_handler(server, USER_STREAM_PATH,
+		&user_stream_handler, NULL, NULL);
+	soup_server_add_handler(server, "/avatars/", &avatar_handler, NULL, NULL);
+	soup_server_add_handler(server, "/oauth/", &oauth_handler, NULL, NULL);
+	soup_server_run_async(server);
+
+	/* new ones are by the recorded users, if that's what there is. */
+	if(opt_rate > 0 && user_ids->len > 0) {
+		g_timeout_add(1000 / opt_rate, &on_new_status, NULL);
+	}
+	g_timeout_add_seconds(KEEPALIVE_SEC, &on_keepalive, NULL);
+
+	printf("%s\n", base_uri);
+	fflush(stdout);
+
+	GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+	if(opt_duration > 0) {
+		g_timeout_add_seconds(opt_duration, &on_duration_over, loop);
+	}
+	g_main_loop_run(loop);
+
+	print_stats();
+	soup_server_quit(server);
+	return EXIT_SUCCESS;
+}
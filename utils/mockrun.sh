@@ -0,0 +1,57 @@
+#!/bin/sh
+# runs piiptyyt against utils/mockapi for $DURATION seconds (default 60), then
+# prints the mock's summary of what it served. arguments go to mockapi, e.g.
+# --latency or --error-rate.
+#
+# the client gets a scratch config and cache, with made-up tokens for one
+# account, so that it neither logs in nor touches the user's own files. it
+# runs under xvfb-run when there's no $DISPLAY. run from the top directory,
+# after `make piiptyyt utils/mockapi'.
+
+set -e
+
+DURATION=${DURATION:-60}
+tmp=$(mktemp -d)
+mock=
+cleanup() {
+	[ -n "$mock" ] && kill "$mock" 2>/dev/null || true
+	rm -rf "$tmp"
+}
+trap cleanup EXIT
+
+export XDG_CONFIG_HOME="$tmp/config" XDG_CACHE_HOME="$tmp/cache"
+mkdir -p "$XDG_CONFIG_HOME/piiptyyt" "$XDG_CACHE_HOME/piiptyyt"
+sqlite3 "$XDG_CACHE_HOME/piiptyyt/cache.sqlite3" < sql/10_caches.sql
+# the mock doesn't check signatures.
+cat > "$XDG_CACHE_HOME/piiptyyt/state" <<EOF
+[auth]
+username=mockuser
+auth_token=mocktoken
+auth_secret=mocksecret
+userid=1
+EOF
+
+# the mock outlives the client a little, so that its summary covers the run.
+utils/mockapi --duration $((DURATION + 2)) "$@" > "$tmp/mockapi.out" &
+mock=$!
+# the base URI comes on the first line.
+while [ ! -s "$tmp/mockapi.out" ]; do
+	kill -0 "$mock" 2>/dev/null || { echo "mockapi didn't start" >&2; exit 1; }
+	sleep 0.1
+done
+base=$(head -n 1 "$tmp/mockapi.out")
+
+xrun=
+[ -z "$DISPLAY" ] && xrun="xvfb-run -a"
+status=0
+PIIPTYYT_API_BASE=$base PIIPTYYT_STREAM_BASE=$base \
+	$xrun timeout "$DURATION" ./piiptyyt || status=$?
+# 124 is timeout(1) ending the run, which is the point.
+if [ $status -ne 0 ] && [ $status -ne 124 ]; then
+	echo "piiptyyt exited with status $status" >&2
+	exit $status
+fi
+
+wait "$mock"
+mock=
+tail -n +2 "$tmp/mockapi.out"